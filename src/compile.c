@@ -0,0 +1,74 @@
+/*
+ * compile.c
+ * ---------
+ *
+ * touka-compile, translates a game file into
+ * a compiled image. The image can be given to
+ * the engine instead of the game file.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "game.h"
+#include "image.h"
+#include "log.h"
+#include "misc.h"
+
+// --------
+
+// Name of the log file
+#define COMPILELOG "compile"
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                               Main                                *
+ *                                                                   *
+ *********************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+	char homedir[PATH_MAX];
+	char logdir[PATH_MAX];
+	struct stat sb;
+
+	if (argc != 3)
+	{
+		fprintf(stderr, "USAGE: %s /path/to/game /path/to/image\n", argv[0]);
+		exit(1);
+	}
+
+	// Same log directory as the engine
+	snprintf(homedir, sizeof(homedir), "%s/%s", getenv("HOME"), HOMEDIR);
+	snprintf(logdir, sizeof(logdir), "%s/%s", homedir, LOGDIR);
+
+	if ((stat(homedir, &sb)) == 0)
+	{
+		if (!S_ISDIR(sb.st_mode))
+		{
+			printf("PANIC: %s is not a directory\n", homedir);
+			exit(1);
+		}
+	}
+	else
+	{
+		misc_rmkdir(homedir);
+	}
+
+	log_init(logdir, COMPILELOG, LOGNUM);
+
+	// No need to cache, we're writing an image anyway
+	game_init(argv[1], NULL);
+	image_write(argv[2]);
+	game_quit();
+
+	log_close();
+
+	return 0;
+}
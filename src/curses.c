@@ -8,6 +8,7 @@
  */
 
 #define _XOPEN_SOURCE_EXTENDED
+#define LOG_MODULE LOG_CURSES
 
 #include <assert.h>
 #include <curses.h>
@@ -151,17 +152,46 @@ curses_utf8strlen(const char *s)
 }
 
 /*
- * Prints text into the main window.
+ * Returns the number of characters in the first
+ * len bytes of an UTF-8 string.
  *
- * highlight: Highlight status of the text
- * msg: Text to print
+ * s: String to measure, needn't be terminated
+ * len: Length in bytes
+ */
+static size_t
+curses_utf8width(const char *s, size_t len)
+{
+	size_t i;
+	size_t width;
+
+	width = 0;
+
+	for (i = 0; i < len; i++)
+	{
+		if ((s[i] & 0xc0) != 0x80)
+		{
+			width++;
+		}
+	}
+
+	return width;
+}
+
+/*
+ * Prints text into the main window. Lines are
+ * broken between words, a word that doesn't
+ * fit into the current line starts a new one.
+ *
+ * color: Color in which the text is printed
+ * msg: Text to print, needn't be terminated
+ * len: Length of the text in bytes
  */
 static void
-curses_print(uint32_t color, const char *msg)
+curses_print(uint32_t color, const char *msg, size_t len)
 {
-	char *first;
-	char *last;
-	int16_t i;
+	const char *cur;
+	const char *end;
+	const char *word;
 	int32_t x;
 
 	if (color == TINT_GLOSSARY)
@@ -189,45 +219,107 @@ curses_print(uint32_t color, const char *msg)
 		wattron(text, COLOR_PAIR(PAIR_TEXT));
 	}
 
-	x = getcurx(text);
+	cur = msg;
+	end = msg + len;
 
-	// Split line
-	if (COLS - x < curses_utf8strlen(msg))
+	while (cur < end)
 	{
-		first = strdup(msg);
-		last = NULL;
+		word = cur;
 
-		for (i = curses_utf8strlen(first); i >= 0; i--)
+		while (cur < end && *cur != ' ' && *cur != '\n')
 		{
-			if (first[i] == ' ')
-			{
-				if (i < COLS - x)
-				{
-					first[i] = '\0';
-					last = first + i + 1;
-
-					break;
-				}
-			}
+			cur++;
 		}
 
-		if (last)
+		if (cur > word)
 		{
-			waddstr(text, first);
-			waddstr(text, "\n");
-			waddstr(text, last);
+			x = getcurx(text);
+
+			// Split line
+			if (x && COLS - x < curses_utf8width(word, cur - word))
+			{
+				waddch(text, '\n');
+			}
+
+			waddnstr(text, word, cur - word);
 
-			return;
+			// The word filled the line, drop the space
+			if (cur < end && *cur == ' ' && getcurx(text) == 0)
+			{
+				cur++;
+
+				continue;
+			}
 		}
-		else
+
+		if (cur < end)
 		{
-			waddstr(text, "\n");
+			waddch(text, *cur);
+			cur++;
 		}
+	}
+}
+
+/*
+ * Shows the end of the main window. Called
+ * after new text was printed.
+ */
+static void
+curses_show(void)
+{
+	int32_t y;
 
-		free(first);
+	y = getcury(text);
+
+	if (y < LINES - 3)
+	{
+		/* If the cursor hasn't reached the bottom
+		   of the pad, just show it's beginning. */
+		pnoutrefresh(text, 0, 0, 0, 0, LINES - 3, COLS);
+	}
+	else
+	{
+		/* If the cursor has reached the bottom of
+		   the pad, show the last filled lines. Math:
+			y:     Cursor position.
+			LINES: Screen height
+			+2:    Compensate input und status lines
+			-1:    Compensate cursor height */
+		pnoutrefresh(text, y - LINES + 2 - 1, 0, 0, 0, LINES - 3, COLS);
 	}
 
-	waddstr(text, msg);
+	scrolled = 0;
+	doupdate();
+}
+
+/*
+ * Saves a message to the replay buffer. The
+ * buffer takes ownership of the message.
+ *
+ * color: Color in which the text was printed
+ * msg: Text that was printed
+ */
+static void
+curses_remember(uint32_t color, char *msg)
+{
+	repl_msg_s *rep;
+
+	if ((rep = malloc(sizeof(repl_msg_s))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	rep->msg = msg;
+	rep->color = color;
+	list_push(repl_buf, rep);
+
+	while (repl_buf->count > REPLAY)
+	{
+		rep = list_shift(repl_buf);
+
+		free(rep->msg);
+		free(rep);
+	}
 }
 
 /*
@@ -267,7 +359,7 @@ curses_resize(void)
 	while (cur)
 	{
 		rep = cur->data;
-		curses_print(rep->color, rep->msg);
+		curses_print(rep->color, rep->msg, strlen(rep->msg));
 		cur = cur->next;
 	}
 
@@ -960,12 +1052,39 @@ curses_status(const char *fmt, ...)
 	free(msg);
 }
 
+void
+curses_render(const curses_op_s *ops, uint32_t count)
+{
+	char *msg;
+	uint32_t i;
+
+	assert(ops || !count);
+
+	for (i = 0; i < count; i++)
+	{
+		curses_print(ops[i].color, ops[i].text, ops[i].length);
+	}
+
+	curses_show();
+
+	for (i = 0; i < count; i++)
+	{
+		if ((msg = malloc(ops[i].length + 1)) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
+
+		memcpy(msg, ops[i].text, ops[i].length);
+		msg[ops[i].length] = '\0';
+
+		curses_remember(ops[i].color, msg);
+	}
+}
+
 void
 curses_text(uint32_t color, const char *fmt, ...)
 {
 	char *msg;
-	int32_t y;
-	repl_msg_s *rep;
 	size_t len;
 	va_list args;
 
@@ -984,44 +1103,8 @@ curses_text(uint32_t color, const char *fmt, ...)
 	vsnprintf(msg, len, fmt, args);
 	va_end(args);
 
-	curses_print(color, msg);
-	y = getcury(text);
+	curses_print(color, msg, len - 1);
+	curses_show();
 
-	if (y < LINES - 3)
-	{
-		/* If the cursor hasn't reached the bottom
-		   of the pad, just show it's beginning. */
-		pnoutrefresh(text, 0, 0, 0, 0, LINES - 3, COLS);
-	}
-	else
-	{
-		/* If the cursor has reached the bottom of
-		   the pad, show the last filled lines. Math:
-			y:     Cursor position.
-			LINES: Screen height
-			+2:    Compensate input und status lines
-			-1:    Compensate cursor height */
-		pnoutrefresh(text, y - LINES + 2 - 1, 0, 0, 0, LINES - 3, COLS);
-	}
-
-	scrolled = 0;
-	doupdate();
-
-	// Save to replay buffer
-	if ((rep = malloc(sizeof(repl_msg_s))) == NULL)
-	{
-		quit_error(POUTOFMEM);
-	}
-
-	rep->msg = msg;
-	rep->color = color;
-	list_push(repl_buf, rep);
-
-	while (repl_buf->count > REPLAY)
-	{
-		rep = list_shift(repl_buf);
-
-		free(rep->msg);
-		free(rep);
-	}
+	curses_remember(color, msg);
 }
@@ -31,6 +31,18 @@ enum
 	TINT_SCENE
 };
 
+/*
+ * A run of text printed in one color.
+ */
+typedef struct
+{
+	uint32_t color;
+	uint32_t length;
+
+	// Needn't be terminated
+	const char *text;
+} curses_op_s;
+
 // The prompt
 extern char *curses_prompt;
 
@@ -67,6 +79,16 @@ void curses_input(void);
  */
 void curses_status(const char *fmt, ...);
 
+/*
+ * Prints a stream of text runs into the main
+ * window. The screen is updated once, after
+ * all runs were printed.
+ *
+ * ops: Runs to print
+ * count: Number of runs
+ */
+void curses_render(const curses_op_s *ops, uint32_t count);
+
 /*
  * Prints a string into the main window.
  *
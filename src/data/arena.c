@@ -0,0 +1,208 @@
+/*
+ * arena.c
+ * -------
+ *
+ * A bump allocator. Allocations are served from
+ * the first block in the chain until it's full,
+ * than a new block is put in front of it.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#include "../quit.h"
+
+// --------
+
+// Alignment of allocations
+#define ALIGN 8
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                        Support Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Hands out a chunk of memory with the given
+ * alignment. If the current block is too small
+ * a new one is allocated.
+ *
+ * pool: Arena to allocate from
+ * size: Size of the chunk
+ * align: Alignment, must be a power of two
+ */
+static void
+*arena_reserve(arena *pool, size_t size, size_t align)
+{
+	arenablock *block;
+	size_t offset;
+
+	assert(pool);
+
+	// Even empty chunks must point into the block
+	if (size == 0)
+	{
+		size = 1;
+	}
+
+	block = pool->blocks;
+
+	if (block)
+	{
+		offset = (block->used + align - 1) & ~(align - 1);
+
+		if (offset + size <= block->size)
+		{
+			pool->used += offset - block->used + size;
+			block->used = offset + size;
+
+			return block->data + offset;
+		}
+	}
+
+	if ((block = calloc(1, sizeof(arenablock) + (size > pool->blocksize ? size : pool->blocksize))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	block->size = size > pool->blocksize ? size : pool->blocksize;
+	block->used = size;
+
+	pool->reserved += block->size;
+	pool->used += size;
+
+	/* Oversized blocks are put behind the
+	   current one, so it can be filled up. */
+	if (pool->blocks && block->size > pool->blocksize)
+	{
+		block->next = pool->blocks->next;
+		pool->blocks->next = block;
+	}
+	else
+	{
+		block->next = pool->blocks;
+		pool->blocks = block;
+	}
+
+	return block->data;
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                         Public Interface                          *
+ *                                                                   *
+ *********************************************************************/
+
+void
+*arena_alloc(arena *pool, size_t size)
+{
+	return arena_reserve(pool, size, ALIGN);
+}
+
+arena
+*arena_create(size_t blocksize)
+{
+	arena *new;
+
+	assert(blocksize);
+
+	if ((new = calloc(1, sizeof(arena))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	new->blocksize = blocksize;
+
+	return new;
+}
+
+void
+arena_destroy(arena *pool)
+{
+	arenablock *block;
+
+	assert(pool);
+
+	while (pool->blocks)
+	{
+		block = pool->blocks;
+		pool->blocks = block->next;
+
+		free(block);
+	}
+
+	free(pool);
+}
+
+void
+arena_merge(arena *dst, arena *src)
+{
+	arenablock *last;
+
+	assert(dst);
+	assert(src);
+
+	if (src->blocks)
+	{
+		for (last = src->blocks; last->next; last = last->next)
+		{
+			continue;
+		}
+
+		// Behind the current block, so it can be filled up
+		if (dst->blocks)
+		{
+			last->next = dst->blocks->next;
+			dst->blocks->next = src->blocks;
+		}
+		else
+		{
+			dst->blocks = src->blocks;
+		}
+	}
+
+	dst->reserved += src->reserved;
+	dst->used += src->used;
+
+	free(src);
+}
+
+char
+*arena_strdup(arena *pool, const char *str)
+{
+	char *new;
+	size_t len;
+
+	assert(str);
+
+	len = strlen(str) + 1;
+
+	// Strings need no alignment
+	new = arena_reserve(pool, len, 1);
+	memcpy(new, str, len);
+
+	return new;
+}
+
+char
+*arena_strndup(arena *pool, const char *str, size_t len)
+{
+	char *new;
+
+	assert(str);
+
+	new = arena_reserve(pool, len + 1, 1);
+	memcpy(new, str, len);
+	new[len] = '\0';
+
+	return new;
+}
@@ -0,0 +1,107 @@
+/*
+ * arena.h
+ * -------
+ *
+ * A simple bump allocator. Memory is handed out
+ * from big blocks and can't be freed one by one.
+ * Instead everything is released at once when
+ * the arena is destroyed.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+// --------
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// --------
+
+/*
+ * One block of memory.
+ */
+typedef struct arenablock
+{
+	struct arenablock *next;
+	size_t size;
+	size_t used;
+	char data[];
+} arenablock;
+
+/*
+ * Header of an arena.
+ */
+typedef struct arena
+{
+	arenablock *blocks;
+	size_t blocksize;
+
+	// Bytes allocated from the system
+	size_t reserved;
+
+	// Bytes handed out to the caller
+	size_t used;
+} arena;
+
+// --------
+
+/*
+ * Returns a chunk of memory from the arena. The
+ * memory is zeroed and suitable aligned for all
+ * types.
+ *
+ * pool: Arena to allocate from
+ * size: Size of the chunk
+ */
+void *arena_alloc(arena *pool, size_t size);
+
+/*
+ * Creates a new arena.
+ *
+ * blocksize: Size of the blocks allocated from
+ *            the system. Bigger allocations get
+ *            their own block.
+ */
+arena *arena_create(size_t blocksize);
+
+/*
+ * Destroys an arena, all memory handed out
+ * by it is released.
+ *
+ * pool: Arena to destroy
+ */
+void arena_destroy(arena *pool);
+
+/*
+ * Moves all memory of an arena into another
+ * one and destroys it. The memory handed out
+ * by it stays valid until the other arena is
+ * destroyed.
+ *
+ * dst: Arena to move the memory into
+ * src: Arena to destroy
+ */
+void arena_merge(arena *dst, arena *src);
+
+/*
+ * Copies a string into the arena.
+ *
+ * pool: Arena to copy the string into
+ * str: String to copy
+ */
+char *arena_strdup(arena *pool, const char *str);
+
+/*
+ * Copies the first len characters of a string
+ * into the arena. The copy is terminated.
+ *
+ * pool: Arena to copy the string into
+ * str: String to copy, needn't be terminated
+ * len: Number of characters to copy
+ */
+char *arena_strndup(arena *pool, const char *str, size_t len);
+
+// --------
+
+#endif // ARENA_H_
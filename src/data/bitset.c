@@ -0,0 +1,111 @@
+/*
+ * bitset.c
+ * --------
+ *
+ * A fixed size set of bits, stored in 64 bit
+ * words. Bits behind the size are always 0,
+ * so whole words can be counted and scanned.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+
+#include "../quit.h"
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                         Public Interface                          *
+ *                                                                   *
+ *********************************************************************/
+
+void
+bitset_clear(bitset *set)
+{
+	assert(set);
+
+	memset(set->words, 0, BITSET_WORDS(set->size) * sizeof(uint64_t));
+}
+
+uint32_t
+bitset_count(const bitset *set)
+{
+	uint32_t count;
+	uint32_t i;
+
+	assert(set);
+
+	count = 0;
+
+	for (i = 0; i < BITSET_WORDS(set->size); i++)
+	{
+		count += __builtin_popcountll(set->words[i]);
+	}
+
+	return count;
+}
+
+bitset
+*bitset_create(uint32_t size)
+{
+	bitset *new;
+
+	if ((new = malloc(sizeof(bitset))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	// At least one word, calloc(0) may return NULL
+	if ((new->words = calloc(BITSET_WORDS(size) + 1, sizeof(uint64_t))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	new->size = size;
+
+	return new;
+}
+
+void
+bitset_destroy(bitset *set)
+{
+	assert(set);
+
+	free(set->words);
+	free(set);
+}
+
+uint32_t
+bitset_next(const bitset *set, uint32_t from)
+{
+	uint64_t word;
+	uint32_t i;
+
+	assert(set);
+
+	if (from >= set->size)
+	{
+		return set->size;
+	}
+
+	// Mask the bits before 'from' in the first word
+	i = from / 64;
+	word = set->words[i] & (~(uint64_t)0 << (from % 64));
+
+	while (!word)
+	{
+		if (++i >= BITSET_WORDS(set->size))
+		{
+			return set->size;
+		}
+
+		word = set->words[i];
+	}
+
+	return i * 64 + __builtin_ctzll(word);
+}
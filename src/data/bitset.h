@@ -0,0 +1,110 @@
+/*
+ * bitset.h
+ * --------
+ *
+ * A fixed size set of bits. Bits are addressed
+ * by their index, the whole set can be cleared,
+ * counted and scanned a machine word at a time.
+ */
+
+#ifndef BITSET_H_
+#define BITSET_H_
+
+// --------
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// --------
+
+// Number of words in a set of n bits
+#define BITSET_WORDS(n) (((n) + 63) / 64)
+
+typedef struct
+{
+	// Number of bits
+	uint32_t size;
+
+	// The bits, lowest bit of words[0] first
+	uint64_t *words;
+} bitset;
+
+// --------
+
+/*
+ * Clears all bits.
+ *
+ * set: Set to clear
+ */
+void bitset_clear(bitset *set);
+
+/*
+ * Returns the number of set bits.
+ *
+ * set: Set to count
+ */
+uint32_t bitset_count(const bitset *set);
+
+/*
+ * Creates a new set with all bits cleared.
+ *
+ * size: Number of bits
+ */
+bitset *bitset_create(uint32_t size);
+
+/*
+ * Destroys a set.
+ *
+ * set: Set to destroy
+ */
+void bitset_destroy(bitset *set);
+
+/*
+ * Returns the index of the first set bit at
+ * or after 'from'. If there's none, the size
+ * of the set is returned.
+ *
+ * set: Set to scan
+ * from: First index to look at
+ */
+uint32_t bitset_next(const bitset *set, uint32_t from);
+
+/*
+ * Returns a bit.
+ *
+ * set: Set to read from
+ * index: Index of the bit
+ */
+static inline int
+bitset_get(const bitset *set, uint32_t index)
+{
+	return (set->words[index / 64] >> (index % 64)) & 1;
+}
+
+/*
+ * Sets a bit.
+ *
+ * set: Set to write to
+ * index: Index of the bit
+ */
+static inline void
+bitset_set(bitset *set, uint32_t index)
+{
+	set->words[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+/*
+ * Clears a bit.
+ *
+ * set: Set to write to
+ * index: Index of the bit
+ */
+static inline void
+bitset_unset(bitset *set, uint32_t index)
+{
+	set->words[index / 64] &= ~((uint64_t)1 << (index % 64));
+}
+
+// --------
+
+#endif // BITSET_H_
@@ -0,0 +1,153 @@
+/*
+ * dict.c
+ * ------
+ *
+ * A dictionary of words, build around our
+ * hashmap. The hashmap maps the words to
+ * their IDs, an array maps them back.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "dict.h"
+#include "hashmap.h"
+
+#include "../quit.h"
+
+// Initial number of words
+#define INT_WORDS 1024
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                       Callback Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Callback for hashmap_destroy(). The data
+ * are IDs and not pointers, so there's
+ * nothing to free.
+ */
+static void
+dict_destroy_callback(void *data)
+{
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                         Public Interface                          *
+ *                                                                   *
+ *********************************************************************/
+
+uint32_t
+dict_add(dict *words, const char *word, size_t len)
+{
+	const char *new;
+	uintptr_t id;
+
+	assert(words);
+	assert(words->ids);
+	assert(word);
+
+	// IDs are stored + 1, since NULL means 'not found'
+	if ((id = (uintptr_t)hashmap_get_len(words->ids, word, len)) != 0)
+	{
+		return id - 1;
+	}
+
+	if (words->elements == words->size)
+	{
+		words->size *= 2;
+
+		if ((words->words = realloc(words->words, words->size * sizeof(char *))) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
+	}
+
+	new = arena_strndup(words->pool, word, len);
+	id = words->elements;
+
+	words->words[id] = new;
+	words->elements++;
+
+	hashmap_add(words->ids, new, (void *)(id + 1));
+
+	return id;
+}
+
+dict
+*dict_attach(uint32_t elements)
+{
+	dict *new;
+
+	if ((new = calloc(1, sizeof(dict))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	// At least one word, malloc(0) may return NULL
+	if ((new->words = malloc((elements + 1) * sizeof(char *))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	new->elements = elements;
+	new->size = elements;
+
+	return new;
+}
+
+dict
+*dict_create(arena *pool)
+{
+	dict *new;
+
+	assert(pool);
+
+	if ((new = calloc(1, sizeof(dict))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	if ((new->words = malloc(INT_WORDS * sizeof(char *))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	new->pool = pool;
+	new->ids = hashmap_create(INT_WORDS);
+	new->size = INT_WORDS;
+
+	return new;
+}
+
+void
+dict_destroy(dict *words)
+{
+	assert(words);
+
+	if (words->ids)
+	{
+		hashmap_destroy(words->ids, dict_destroy_callback);
+	}
+
+	free(words->words);
+	free(words);
+}
+
+const char
+*dict_get(dict *words, uint32_t id)
+{
+	assert(words);
+	assert(id < words->elements);
+
+	return words->words[id];
+}
@@ -0,0 +1,92 @@
+/*
+ * dict.h
+ * ------
+ *
+ * A dictionary of words. Each distinct word is
+ * stored exactly once and identified by a small
+ * integer ID. IDs are handed out in order, the
+ * first word added gets 0.
+ *
+ * A dictionary can also be attached to words
+ * stored elsewhere, e.g. in a compiled game
+ * image. Such dictionaries are read only.
+ */
+
+#ifndef DICT_H_
+#define DICT_H_
+
+// --------
+
+#include <stdint.h>
+
+#include "arena.h"
+#include "hashmap.h"
+
+// --------
+
+typedef struct
+{
+	// The words are copied into this arena
+	arena *pool;
+
+	// Maps words to their ID + 1, NULL if attached
+	hashmap *ids;
+
+	// Maps IDs to words
+	const char **words;
+
+	// Number of words
+	uint32_t elements;
+
+	// Allocated IDs
+	uint32_t size;
+} dict;
+
+// --------
+
+/*
+ * Adds a word to the dictionary and returns it's
+ * ID. If the word is already there, the existing
+ * ID is returned.
+ *
+ * words: Dictionary to add to
+ * word: Word to add, needn't be terminated
+ * len: Length of the word
+ */
+uint32_t dict_add(dict *words, const char *word, size_t len);
+
+/*
+ * Creates a read only dictionary. Space for the
+ * words is allocated, the caller must point each
+ * of them to the word with that ID.
+ *
+ * elements: Number of words
+ */
+dict *dict_attach(uint32_t elements);
+
+/*
+ * Creates a new dictionary.
+ *
+ * pool: Arena which holds the words
+ */
+dict *dict_create(arena *pool);
+
+/*
+ * Destroys a dictionary. The words itself
+ * are released with the arena.
+ *
+ * words: Dictionary to destroy
+ */
+void dict_destroy(dict *words);
+
+/*
+ * Returns the word with the given ID.
+ *
+ * words: Dictionary to retrieve from
+ * id: ID of the word
+ */
+const char *dict_get(dict *words, uint32_t id);
+
+// --------
+
+#endif // DICT_H_
@@ -2,15 +2,30 @@
  * hashmap.c
  * ---------
  *
- * A very simple hashmap, build around
- * our dynamic array and jenkins hash.
+ * A hashmap with open addressing and jenkins hash.
+ *
+ * Each slot has a control byte. It's either EMPTY
+ * or holds the lower 7 bits of the elements hash.
+ * The slots are organized in groups of 16, a group
+ * is matched against the hash in one go. With SSE2
+ * that's a single compare, otherwise a tight loop.
+ * The full hash and the key are only compared for
+ * slots which control byte matches.
+ *
+ * The nodes itself are stored in order of insertion
+ * and the slots just point to them. Elements can't
+ * be removed, so there's no need for tombstones.
  */
 
-#include "assert.h"
-#include "stdint.h"
-#include "stdio.h"
-#include "stdlib.h"
-#include "string.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "darray.h"
 #include "hashmap.h"
@@ -19,6 +34,17 @@
 
 // --------
 
+// Slots per group
+#define GROUP 16
+
+// Control byte of an empty slot
+#define EMPTY 0x80
+
+// Maximum load factor is 7/8
+#define LOAD(capacity) ((capacity) - (capacity) / 8)
+
+// --------
+
 /*********************************************************************
  *                                                                   *
  *                        Support Functions                          *
@@ -26,30 +52,130 @@
  *********************************************************************/
 
 /*
- * An implementation of Jenkins Hash
+ * Returns a bitmask with one bit set for each
+ * slot of the group which control byte equals
+ * the given byte.
+ *
+ * ctrl: First control byte of the group
+ * byte: Byte to match against
  */
-static uint32_t
-hashmap_hash(const char *key)
+static inline uint32_t
+hashmap_match(const uint8_t *ctrl, uint8_t byte)
 {
-	int32_t i;
-	size_t len;
-	uint32_t hash;
+#ifdef __SSE2__
+	__m128i group;
 
-	hash = 0;
-	len = strlen(key);
+	group = _mm_loadu_si128((const __m128i *)ctrl);
 
-	for (i = 0; i < len; i++)
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte)));
+#else
+	uint32_t i;
+	uint32_t mask;
+
+	mask = 0;
+
+	for (i = 0; i < GROUP; i++)
 	{
-		hash += key[i];
-		hash += (hash << 10);
-		hash ^= (hash >> 6);
+		if (ctrl[i] == byte)
+		{
+			mask |= 1 << i;
+		}
 	}
 
-	hash += (hash << 3);
-	hash ^= (hash >> 11);
-	hash += (hash << 15);
+	return mask;
+#endif
+}
 
-	return hash;
+/*
+ * Returns the number of the lowest bit
+ * set in the given mask.
+ *
+ * mask: Mask to check, must not be 0
+ */
+static inline uint32_t
+hashmap_lowest(uint32_t mask)
+{
+	assert(mask);
+
+	return __builtin_ctz(mask);
+}
+
+/*
+ * Puts a node into the first empty slot
+ * of its probe sequence. The caller must
+ * make sure that there's enough room.
+ *
+ * map: Map to insert into
+ * index: Index of the node
+ */
+static void
+hashmap_insert(hashmap *map, uint32_t index)
+{
+	uint32_t group;
+	uint32_t mask;
+	uint32_t slot;
+	uint32_t step;
+
+	group = (map->nodes[index].hash >> 7) & (map->capacity / GROUP - 1);
+	step = 0;
+
+	while (TRUE)
+	{
+		if ((mask = hashmap_match(&map->ctrl[group * GROUP], EMPTY)) != 0)
+		{
+			slot = group * GROUP + hashmap_lowest(mask);
+
+			map->ctrl[slot] = map->nodes[index].hash & 0x7f;
+			map->slots[slot] = index;
+
+			return;
+		}
+
+		// Triangular probing visits all groups
+		step++;
+		group = (group + step) & (map->capacity / GROUP - 1);
+	}
+}
+
+/*
+ * (Re)allocates the slots for the given
+ * capacity and inserts all nodes. They're
+ * inserted in order, so elements with the
+ * same key keep their relative position.
+ *
+ * map: Map to resize
+ * capacity: New number of slots
+ */
+static void
+hashmap_resize(hashmap *map, uint32_t capacity)
+{
+	uint32_t i;
+
+	assert(capacity >= GROUP);
+	assert(!(capacity & (capacity - 1)));
+
+	free(map->ctrl);
+	free(map->slots);
+
+	if ((map->ctrl = malloc(capacity)) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	if ((map->slots = malloc(capacity * sizeof(uint32_t))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	memset(map->ctrl, EMPTY, capacity);
+
+	map->capacity = capacity;
+	map->growth = LOAD(capacity);
+
+	for (i = 0; i < map->elements; i++)
+	{
+		hashmap_insert(map, i);
+	}
 }
 
 // --------
@@ -61,54 +187,108 @@ hashmap_hash(const char *key)
  *********************************************************************/
 
 void
-hashmap_add(hashmap *map, const char *key, void *data, boolean is_alias)
+hashmap_add(hashmap *map, const char *key, void *data)
+{
+	assert(key);
+
+	hashmap_add_hashed(map, key, hashmap_hash(key, strlen(key)), data);
+}
+
+void
+hashmap_add_hashed(hashmap *map, const char *key, uint32_t hash, void *data)
 {
 	hashnode *node;
-	uint16_t bucket;
 
 	assert(map);
 	assert(key);
 	assert(data);
+	assert(!map->attached);
 
-	if ((node = malloc(sizeof(hashnode))) == NULL)
+	if (map->elements == map->growth)
 	{
-		quit_error(POUTOFMEM);
+		hashmap_resize(map, map->capacity * 2);
+	}
+
+	if (map->elements == map->size)
+	{
+		map->size *= 2;
+
+		if ((map->nodes = realloc(map->nodes, map->size * sizeof(hashnode))) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
 	}
 
+	node = &map->nodes[map->elements];
+
 	node->key = key;
 	node->data = data;
-	node->hash = hashmap_hash(key);
-	node->is_alias = is_alias;
+	node->hash = hash;
+
+	hashmap_insert(map, map->elements);
+	map->elements++;
+}
+
+hashmap
+*hashmap_attach(uint32_t capacity, uint32_t elements,
+		const uint8_t *ctrl, const uint32_t *slots)
+{
+	hashmap *new;
 
-	bucket = node->hash % map->buckets;
+	assert(ctrl);
+	assert(slots);
+	assert(capacity >= GROUP);
+	assert(!(capacity & (capacity - 1)));
+	assert(elements <= LOAD(capacity));
 
-	if (!map->data[bucket])
+	if ((new = calloc(1, sizeof(hashmap))) == NULL)
 	{
-		map->data[bucket] = darray_create();
-		darray_push(map->data[bucket], node);
+		quit_error(POUTOFMEM);
 	}
-	else
+
+	// At least one node, malloc(0) may return NULL
+	if ((new->nodes = malloc((elements + 1) * sizeof(hashnode))) == NULL)
 	{
-		darray_push(map->data[bucket], node);
+		quit_error(POUTOFMEM);
 	}
+
+	new->capacity = capacity;
+	new->elements = elements;
+	new->growth = elements;
+	new->size = elements;
+	new->ctrl = (uint8_t *)ctrl;
+	new->slots = (uint32_t *)slots;
+	new->attached = TRUE;
+
+	return new;
 }
 
 hashmap
-*hashmap_create(uint16_t buckets)
+*hashmap_create(uint32_t size)
 {
 	hashmap *new;
+	uint32_t capacity;
 
-	if ((new = malloc(sizeof(hashmap))) == NULL)
+	if ((new = calloc(1, sizeof(hashmap))) == NULL)
 	{
 		quit_error(POUTOFMEM);
 	}
 
-	if ((new->data = calloc(buckets, sizeof(darray *))) == NULL)
+	capacity = GROUP;
+
+	while (LOAD(capacity) < size)
+	{
+		capacity *= 2;
+	}
+
+	new->size = LOAD(capacity);
+
+	if ((new->nodes = malloc(new->size * sizeof(hashnode))) == NULL)
 	{
 		quit_error(POUTOFMEM);
 	}
 
-	new->buckets = buckets;
+	hashmap_resize(new, capacity);
 
 	return new;
 }
@@ -116,111 +296,131 @@ hashmap
 void
 hashmap_destroy(hashmap *map, void (callback)(void *data))
 {
-	darray *array;
 	hashnode *node;
-	uint16_t i;
+	uint32_t i;
 
 	assert(map);
 
-	for (i = 0; i < map->buckets; i++)
+	for (i = 0; i < map->elements; i++)
 	{
-		if (map->data[i])
-		{
-			array = map->data[i];
-
-			while (array->elements)
-			{
-				node = darray_pop(array);
-
-				// Contents isn't freed on aliases
-				if (!node->is_alias)
-				{
-					if (callback)
-					{
-						callback(node->data);
-					}
-					else
-					{
-						free(node->data);
-					}
-				}
-
-				free(node);
-			}
+		node = &map->nodes[i];
 
-			darray_destroy(array, NULL);
+		if (callback)
+		{
+			callback(node->data);
+		}
+		else
+		{
+			free(node->data);
 		}
 	}
 
-	free(map->data);
+	if (!map->attached)
+	{
+		free(map->ctrl);
+		free(map->slots);
+	}
+
+	free(map->nodes);
 	free(map);
 }
 
 void
 *hashmap_get(hashmap *map, const char *key)
 {
-	darray *array;
+	assert(key);
+
+	return hashmap_get_len(map, key, strlen(key));
+}
+
+void
+*hashmap_get_hashed(hashmap *map, const char *key, size_t len, uint32_t hash)
+{
 	hashnode *node;
-	uint16_t bucket;
-	uint16_t i;
-	uint32_t hash;
+	uint32_t group;
+	uint32_t mask;
+	uint32_t step;
 
 	assert(map);
 	assert(key);
 
-	hash = hashmap_hash(key);
-	bucket = hash % map->buckets;
+	group = (hash >> 7) & (map->capacity / GROUP - 1);
+	step = 0;
 
-	if (!map->data[bucket])
+	while (TRUE)
 	{
-		return NULL;
-	}
-	else
-	{
-		array = map->data[bucket];
+		mask = hashmap_match(&map->ctrl[group * GROUP], hash & 0x7f);
 
-		for (i = 0; i < array->elements; i++)
+		while (mask)
 		{
-			node = darray_get(array, i);
+			node = &map->nodes[map->slots[group * GROUP + hashmap_lowest(mask)]];
 
-			if (node->hash == hash)
+			// The key may continue after len
+			if (node->hash == hash && (node->key == key
+					|| (!strncmp(node->key, key, len) && node->key[len] == '\0')))
 			{
 				return node->data;
 			}
+
+			mask &= mask - 1;
+		}
+
+		// An empty slot ends the probe sequence
+		if (hashmap_match(&map->ctrl[group * GROUP], EMPTY))
+		{
+			return NULL;
 		}
+
+		step++;
+		group = (group + step) & (map->capacity / GROUP - 1);
 	}
+}
 
-	return NULL;
+void
+*hashmap_get_len(hashmap *map, const char *key, size_t len)
+{
+	assert(key);
+
+	return hashmap_get_hashed(map, key, len, hashmap_hash(key, len));
+}
+
+uint32_t
+hashmap_hash(const char *key, size_t len)
+{
+	size_t i;
+	uint32_t hash;
+
+	hash = 0;
+
+	for (i = 0; i < len; i++)
+	{
+		hash += key[i];
+		hash += (hash << 10);
+		hash ^= (hash >> 6);
+	}
+
+	hash += (hash << 3);
+	hash ^= (hash >> 11);
+	hash += (hash << 15);
+
+	return hash;
 }
 
 list
 *hashmap_to_list(hashmap *map)
 {
-	darray *cur;
 	hashnode *node;
-	int32_t i, j;
 	list *content;
+	uint32_t i;
 
 	assert(map);
 
 	content = list_create();
 
-	for (i = 0; i < map->buckets; i++)
+	for (i = 0; i < map->elements; i++)
 	{
-		if (map->data[i])
-		{
-			cur = map->data[i];
-
-			for (j = 0; j < cur->elements; j++)
-			{
-				node = darray_get(cur, j);
-
-				if (!node->is_alias)
-				{
-					list_push(content, node->data);
-				}
-			}
-		}
+		node = &map->nodes[i];
+		list_push(content, node->data);
 	}
 
 	return content;
@@ -2,8 +2,11 @@
  * hashmap.h
  * ---------
  *
- * A simple hashmap implementattion, based
- * around dynamic arrays and jenkins hash.
+ * A hashmap implementation with open addressing.
+ * The slots are managed in groups of 16 control
+ * bytes, which are probed in one go. The map is
+ * grown automatically, so lookups stay O(1) for
+ * any number of elements.
  */
 
 // --------
@@ -17,7 +20,6 @@
 
 #include "darray.h"
 #include "list.h"
-#include "list.h"
 
 #include "../main.h"
 
@@ -28,13 +30,33 @@ typedef struct
 	const char *key;
 	uint32_t hash;
 	void *data;
-	int8_t is_alias;
 } hashnode;
 
 typedef struct
 {
-	int32_t buckets;
-	void **data;
+	// Number of slots, always a power of two
+	uint32_t capacity;
+
+	// Elements in the map
+	uint32_t elements;
+
+	// Elements that fit in before the map grows
+	uint32_t growth;
+
+	// Allocated nodes
+	uint32_t size;
+
+	// One control byte per slot
+	uint8_t *ctrl;
+
+	// Index into the nodes for each slot
+	uint32_t *slots;
+
+	// The nodes, in order of insertion
+	hashnode *nodes;
+
+	// Slots are borrowed and read only
+	boolean attached;
 } hashmap;
 
 // --------
@@ -46,14 +68,45 @@ typedef struct
  * key: Key
  * data: Data
  */
-void hashmap_add(hashmap *map, const char *key, void *data, boolean alias);
+void hashmap_add(hashmap *map, const char *key, void *data);
+
+/*
+ * Like hashmap_add(), but the hash of the key
+ * is already known. It must have been computed
+ * by hashmap_hash().
+ *
+ * map: Map to add the element to
+ * key: Key
+ * hash: Hash of the key
+ * data: Data
+ */
+void hashmap_add_hashed(hashmap *map, const char *key, uint32_t hash, void *data);
+
+/*
+ * Creates a hashmap around prebuilt slots, e.g.
+ * from a compiled game image. The slots must have
+ * been filled by this implementation. Space for
+ * the nodes is allocated, the caller fills them
+ * in the same order as they were inserted when
+ * the slots were built. Such a map can't grow,
+ * so nothing can be added. The slots itself are
+ * never freed.
+ *
+ * capacity: Number of slots
+ * elements: Number of nodes
+ * ctrl: Control bytes
+ * slots: Node index of each slot
+ */
+hashmap *hashmap_attach(uint32_t capacity, uint32_t elements,
+		const uint8_t *ctrl, const uint32_t *slots);
 
 /*
  * Creates a new hashmap.
  *
- * buckets: Number of buckets in the map
+ * size: Expected number of elements. The map
+ *       grows as necessary, this is just a hint.
  */
-hashmap *hashmap_create(uint16_t buckets);
+hashmap *hashmap_create(uint32_t size);
 
 /*
  * Destroys a hashmap. Each element is passed
@@ -66,16 +119,51 @@ hashmap *hashmap_create(uint16_t buckets);
 void hashmap_destroy(hashmap *map, void (callback)(void *data));
 
 /*
- * Retrieves an element from the hashmap.
+ * Retrieves an element from the hashmap. If
+ * a key was added more than once, the first
+ * element is returned.
  *
  * map: Mat to retrieve from
  * key: Key of the element
  */
 void *hashmap_get(hashmap *map, const char *key);
 
+/*
+ * Like hashmap_get(), but the key needn't
+ * be terminated. It must not contain '\0'.
+ *
+ * map: Map to retrieve from
+ * key: Key of the element
+ * len: Length of the key
+ */
+void *hashmap_get_len(hashmap *map, const char *key, size_t len);
+
+/*
+ * Like hashmap_get_len(), but the hash of the
+ * key is already known. It must have been
+ * computed by hashmap_hash().
+ *
+ * map: Map to retrieve from
+ * key: Key of the element
+ * len: Length of the key
+ * hash: Hash of the key
+ */
+void *hashmap_get_hashed(hashmap *map, const char *key, size_t len, uint32_t hash);
+
+/*
+ * Hashes a key. Keys with the same hash may
+ * be stored in an image, so this must never
+ * change without changing the image version.
+ *
+ * key: Key to hash, needn't be terminated
+ * len: Length of the key
+ */
+uint32_t hashmap_hash(const char *key, size_t len);
+
 /*
  * Returns a list with all elements of the
- * hashmap. The list is not sorted.
+ * hashmap. The list is sorted by order of
+ * insertion.
  *
  * map: Map to create the list from
  */
@@ -33,12 +33,26 @@ list
 	return new;
 }
 
+list
+*list_create_arena(arena *pool)
+{
+	list *new;
+
+	assert(pool);
+
+	new = arena_alloc(pool, sizeof(list));
+	new->pool = pool;
+
+	return new;
+}
+
 void
 list_destroy(list *lheader, void (*callback)(void *data))
 {
 	listnode *cur;
 
 	assert(lheader);
+	assert(!lheader->pool);
 
 	while (lheader->last)
 	{
@@ -100,7 +114,11 @@ void
 	}
 
 	lheader->count--;
-	free(cur);
+
+	if (!lheader->pool)
+	{
+		free(cur);
+	}
 
 	return data;
 }
@@ -113,7 +131,11 @@ list_push(list *lheader, void *data)
 	assert(lheader);
 	assert(data);
 
-	if ((new = calloc(1, sizeof(listnode))) == NULL)
+	if (lheader->pool)
+	{
+		new = arena_alloc(lheader->pool, sizeof(listnode));
+	}
+	else if ((new = calloc(1, sizeof(listnode))) == NULL)
 	{
 		quit_error(POUTOFMEM);
 	}
@@ -159,7 +181,11 @@ void
 	}
 
 	lheader->count--;
-	free(cur);
+
+	if (!lheader->pool)
+	{
+		free(cur);
+	}
 
 	return data;
 
@@ -231,7 +257,11 @@ list_unshift(list *lheader, void *data)
 	assert(lheader);
 	assert(data);
 
-	if ((new = calloc(1, sizeof(listnode))) == NULL)
+	if (lheader->pool)
+	{
+		new = arena_alloc(lheader->pool, sizeof(listnode));
+	}
+	else if ((new = calloc(1, sizeof(listnode))) == NULL)
 	{
 		quit_error(POUTOFMEM);
 	}
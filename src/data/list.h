@@ -13,6 +13,8 @@
 
 #include <stdint.h>
 
+#include "arena.h"
+
 // --------
 
 /*
@@ -33,6 +35,7 @@ typedef struct list
 	listnode *first;
 	listnode *last;
 	int count;
+	arena *pool;
 } list;
 
 // --------
@@ -42,6 +45,15 @@ typedef struct list
  */
 list *list_create(void);
 
+/*
+ * Creates a new list inside an arena. The
+ * list and its nodes are released with the
+ * arena and must not be destroyed.
+ *
+ * pool: Arena to allocate from
+ */
+list *list_create_arena(arena *pool);
+
 /*
  * Destroys a list. All elements (including
  * *data) are freed. If a callback function
@@ -0,0 +1,133 @@
+/*
+ * strpool.c
+ * ---------
+ *
+ * A pool of interned strings, build around our
+ * hashmap. Each string is prefixed by its hash,
+ * the hashmap maps the strings to themself.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "hashmap.h"
+#include "strpool.h"
+
+#include "../quit.h"
+
+// Initial number of strings
+#define INT_STRINGS 1024
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                       Callback Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Callback for hashmap_destroy(). The strings
+ * are owned by the arena, so there's nothing
+ * to free.
+ */
+static void
+strpool_destroy_callback(void *data)
+{
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                        Support Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Interns a string with a known hash.
+ *
+ * strings: Pool to add to
+ * str: String to add, needn't be terminated
+ * len: Length of the string
+ * hash: Hash of the string
+ */
+static const char
+*strpool_insert(strpool *strings, const char *str, size_t len, uint32_t hash)
+{
+	char *new;
+	const char *found;
+
+	if ((found = hashmap_get_hashed(strings->strings, str, len, hash)) != NULL)
+	{
+		return found;
+	}
+
+	// The hash is stored in front of the string
+	new = arena_alloc(strings->pool, sizeof(uint32_t) + len + 1);
+	memcpy(new, &hash, sizeof(uint32_t));
+
+	new += sizeof(uint32_t);
+	memcpy(new, str, len);
+	new[len] = '\0';
+
+	hashmap_add_hashed(strings->strings, new, hash, new);
+
+	return new;
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                         Public Interface                          *
+ *                                                                   *
+ *********************************************************************/
+
+const char
+*strpool_add(strpool *strings, const char *str, size_t len)
+{
+	assert(strings);
+	assert(str);
+
+	return strpool_insert(strings, str, len, hashmap_hash(str, len));
+}
+
+strpool
+*strpool_create(arena *pool)
+{
+	strpool *new;
+
+	assert(pool);
+
+	if ((new = calloc(1, sizeof(strpool))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	new->pool = pool;
+	new->strings = hashmap_create(INT_STRINGS);
+
+	return new;
+}
+
+void
+strpool_destroy(strpool *strings)
+{
+	assert(strings);
+
+	hashmap_destroy(strings->strings, strpool_destroy_callback);
+	free(strings);
+}
+
+const char
+*strpool_import(strpool *strings, const char *str)
+{
+	assert(strings);
+	assert(str);
+
+	return strpool_insert(strings, str, strlen(str), strpool_hash(str));
+}
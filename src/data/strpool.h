@@ -0,0 +1,90 @@
+/*
+ * strpool.h
+ * ---------
+ *
+ * A pool of interned strings. Each distinct
+ * string is stored exactly once, so interned
+ * strings can be compared by their address.
+ * The hash of each string is stored in front
+ * of it and needn't be computed again.
+ */
+
+#ifndef STRPOOL_H_
+#define STRPOOL_H_
+
+// --------
+
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "hashmap.h"
+
+// --------
+
+typedef struct
+{
+	// The strings are copied into this arena
+	arena *pool;
+
+	// Maps the strings to themself
+	hashmap *strings;
+} strpool;
+
+// --------
+
+/*
+ * Interns a string and returns the interned
+ * copy. If the string is already in the pool,
+ * the existing copy is returned.
+ *
+ * strings: Pool to add to
+ * str: String to add, needn't be terminated
+ * len: Length of the string
+ */
+const char *strpool_add(strpool *strings, const char *str, size_t len);
+
+/*
+ * Creates a new string pool.
+ *
+ * pool: Arena which holds the strings
+ */
+strpool *strpool_create(arena *pool);
+
+/*
+ * Destroys a string pool. The strings itself
+ * are released with the arena.
+ *
+ * strings: Pool to destroy
+ */
+void strpool_destroy(strpool *strings);
+
+/*
+ * Like strpool_add(), but for a string which
+ * was interned by another pool. Its hash is
+ * reused.
+ *
+ * strings: Pool to add to
+ * str: Interned string to add
+ */
+const char *strpool_import(strpool *strings, const char *str);
+
+/*
+ * Returns the hash of an interned string. It's
+ * the same as computed by the hashmap.
+ *
+ * str: Interned string
+ */
+static inline uint32_t
+strpool_hash(const char *str)
+{
+	uint32_t hash;
+
+	memcpy(&hash, str - sizeof(uint32_t), sizeof(uint32_t));
+
+	return hash;
+}
+
+// --------
+
+#endif // STRPOOL_H_
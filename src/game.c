@@ -8,6 +8,8 @@
  * glossary and links.
  */
 
+#define LOG_MODULE LOG_GAME
+
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -15,10 +17,13 @@
 
 #include "curses.h"
 #include "game.h"
+#include "image.h"
 #include "log.h"
 #include "misc.h"
 #include "parser.h"
 #include "quit.h"
+#include "save.h"
+#include "scan.h"
 
 #include "i18n/i18n.h"
 
@@ -27,14 +32,23 @@
 // Game header
 game_header_s *game_header;
 
-// Glossary
-hashmap *game_glossary;
+// Game data
+arena *game_arena;
+
+// Dictionary
+dict *game_words;
+
+// Names and aliases of all objects
+hashmap *game_symbols;
+
+// Interned strings of all objects
+strpool *game_names;
 
-// Rooms
-hashmap *game_rooms;
+// Objects of each kind
+game_objects_s game_objects[GAME_KINDS];
 
-// Scenes
-hashmap *game_scenes;
+// State of all objects
+bitset *game_state[GAME_KINDS][GAME_STATES];
 
 // Statistics
 game_stats_s *game_stats;
@@ -42,9 +56,85 @@ game_stats_s *game_stats;
 // Current scene
 game_scene_s *current_scene;
 
+// Scene the game starts with
+static game_scene_s *first_scene;
+
 // Has the game ended?
 boolean game_end;
 
+/*
+ * Links found in a description, while
+ * it's resolved.
+ */
+typedef struct
+{
+	game_link_s *links;
+	uint32_t count;
+	uint32_t size_links;
+
+	// Text of the link under construction
+	char *text;
+	size_t len;
+	size_t size;
+} game_linklist;
+
+/*
+ * Text runs of a description, while it's
+ * compiled. The runs are contiguous in
+ * 'text', so only their lengths are kept
+ * until the end.
+ */
+typedef struct
+{
+	curses_op_s *ops;
+	uint32_t count;
+	uint32_t size_ops;
+
+	char *text;
+	size_t len;
+	size_t size;
+} game_opstream;
+
+// Bodies loaded on demand, newest first
+static struct
+{
+	game_text_s *newest;
+	game_text_s *oldest;
+	size_t size;
+} bodies;
+
+/*
+ * Kinds of undo entries.
+ */
+enum
+{
+	// A choice, 'id' and 'value' are the scene and end flag before it
+	GAME_UNDO_STEP,
+
+	// 'id' got into state 'value'
+	GAME_UNDO_STATE
+};
+
+/*
+ * An entry of the undo ring. Each choice starts
+ * with a step, followed by the states it set.
+ */
+typedef struct
+{
+	game_id id;
+	uint8_t type;
+	uint8_t value;
+} game_undo_s;
+
+// Changes that can be undone, oldest first
+static struct
+{
+	game_undo_s *entries;
+	uint32_t first;
+	uint32_t count;
+	uint32_t size;
+} undo;
+
 // --------
 
 /*********************************************************************
@@ -53,339 +143,1102 @@ boolean game_end;
  *                                                                   *
  *********************************************************************/
 
+/*
+ * Records a change, so it can be undone. If the
+ * ring is full, the oldest choices are dropped.
+ * A choice larger than the whole ring can't be
+ * undone, its states are ignored.
+ *
+ * type: Kind of the entry
+ * id: ID of the object or scene
+ * value: State or end flag
+ */
+static void
+game_undo_push(uint8_t type, game_id id, uint8_t value)
+{
+	game_undo_s *entry;
+
+	if (!undo.size || (type != GAME_UNDO_STEP && !undo.count))
+	{
+		return;
+	}
+
+	while (undo.count == undo.size)
+	{
+		// Drop the oldest choice as a whole
+		do
+		{
+			undo.first = (undo.first + 1) % undo.size;
+			undo.count--;
+		}
+		while (undo.count && undo.entries[undo.first].type != GAME_UNDO_STEP);
+
+		if (!undo.count && type != GAME_UNDO_STEP)
+		{
+			return;
+		}
+	}
+
+	entry = &undo.entries[(undo.first + undo.count++) % undo.size];
+	entry->id = id;
+	entry->type = type;
+	entry->value = value;
+}
+
+/*
+ * Returns the memory used by the IDs of a
+ * loaded body.
+ *
+ * text: Loaded body
+ */
+static size_t
+game_text_size(const game_text_s *text)
+{
+	return text->words * (text->wide ? sizeof(uint32_t) : sizeof(uint16_t));
+}
+
+/*
+ * Removes a body from the LRU list.
+ *
+ * text: Body to remove
+ */
+static void
+game_text_unlink(game_text_s *text)
+{
+	if (text->newer)
+	{
+		text->newer->older = text->older;
+	}
+	else
+	{
+		bodies.newest = text->older;
+	}
+
+	if (text->older)
+	{
+		text->older->newer = text->newer;
+	}
+	else
+	{
+		bodies.oldest = text->newer;
+	}
+
+	text->newer = NULL;
+	text->older = NULL;
+}
+
+/*
+ * Throws the oldest body out of memory. It's
+ * loaded again when needed.
+ */
+static void
+game_text_evict(void)
+{
+	game_text_s *text;
+
+	text = bodies.oldest;
+
+	assert(text);
+
+	game_text_unlink(text);
+	bodies.size -= game_text_size(text);
+
+	free((void *)text->ids);
+	text->ids = NULL;
+
+	// Compiled again when printed
+	if (text->ops)
+	{
+		bodies.size -= text->ops_size;
+
+		free((void *)text->ops);
+		text->ops = NULL;
+		text->op_count = 0;
+	}
+}
+
+/*
+ * Returns the ID of a word of a description.
+ *
+ * text: Description
+ * word: Number of the word
+ */
+static uint32_t
+game_text_id(const game_text_s *text, uint32_t word)
+{
+	assert(word < text->words);
+
+	if (text->wide)
+	{
+		return ((const uint32_t *)text->ids)[word];
+	}
+	else
+	{
+		return ((const uint16_t *)text->ids)[word];
+	}
+}
+
+/*
+ * Returns a word of a description.
+ *
+ * text: Description
+ * word: Number of the word
+ */
+static const char
+*game_text_word(const game_text_s *text, uint32_t word)
+{
+	return dict_get(game_words, game_text_id(text, word));
+}
+
 /*
  * Link handling. The link must be passed with
  * links markers (|) around it. They're removed
  * and the link is matched against all objects.
- * If a match is found, the corresponding color
- * is returned. If there's no match, TINT_NORM
- * is returned.
+ * The kind of the matched object and the object
+ * itself are stored in the link.
  *
  * Please note that the matcher uses a "first
  * match serves" approach, e.g.  if a match is
  * found it shadows all other objects.
  *
- * link: Link to match.
+ * dst: Link to fill
+ * link: Link to match, modified in place
  */
-static uint32_t
-game_match_link(char *link)
+static void
+game_link_match(game_link_s *dst, char *link)
 {
-	game_glossary_s *glossary;
-	game_room_s *room;
-
-	uint32_t i;
+	const game_symbol_s *symbol;
+	size_t len;
+	uint8_t kind;
 
+	assert(dst);
 	assert(link);
 
+	len = strlen(link);
+
 	// Remove | at the end
-	link[strlen(link) - 1] = '\0';
+	if (len)
+	{
+		link[--len] = '\0';
+	}
 
 	// Remove | at the beginning
-	for (i = 0; i < strlen(link); i++)
+	if (len)
 	{
-		link[i] = link[i + 1];
+		memmove(link, link + 1, len);
 	}
 
-	// Glossary
-	if ((glossary = hashmap_get(game_glossary, link)) != NULL)
+	// Kinds are tried in order
+	if ((symbol = hashmap_get(game_symbols, link)) != NULL)
 	{
-		if (!glossary->mentioned)
+		for (kind = 0; kind < GAME_KINDS; kind++)
 		{
-			glossary->mentioned = 1;
-			game_stats->glossary_mentioned++;
-		}
+			if (symbol->ids[kind])
+			{
+				dst->target = game_object_get(symbol->ids[kind]);
+				dst->kind = kind;
 
-		return TINT_GLOSSARY;
+				return;
+			}
+		}
 	}
 
-	// Room
-	if ((room = hashmap_get(game_rooms, link)) != NULL)
+	log_warn_f("%s: %s", i18n_link_didntmatch, link);
+
+	dst->kind = GAME_LINK_NONE;
+}
+
+/*
+ * Appends a word to the link under construction.
+ *
+ * links: List with the link
+ * word: Word to append
+ * len: Length of the word
+ */
+static void
+game_link_append(game_linklist *links, const char *word, size_t len)
+{
+	if (links->len + len + 1 > links->size)
 	{
-		if (!room->mentioned)
+		while (links->len + len + 1 > links->size)
 		{
-			room->mentioned = 1;
+			links->size = links->size ? links->size * 2 : 256;
 		}
 
-		return TINT_ROOM;
+		if ((links->text = realloc(links->text, links->size)) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
 	}
 
-	// Scene
-	if (hashmap_get(game_scenes, link))
+	memcpy(links->text + links->len, word, len);
+	links->len += len;
+	links->text[links->len] = '\0';
+}
+
+/*
+ * Adds a link to the list of links.
+ *
+ * links: List to add to
+ * link: Link to add
+ */
+static void
+game_link_push(game_linklist *links, const game_link_s *link)
+{
+	if (links->count == links->size_links)
 	{
-		return TINT_SCENE;
-	}
+		links->size_links = links->size_links ? links->size_links * 2 : 16;
 
-	log_warn_f("%s: %s", i18n_link_didntmatch, link);
+		if ((links->links = realloc(links->links, links->size_links * sizeof(game_link_s))) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
+	}
 
-	return TINT_NORM;
+	links->links[links->count] = *link;
+	links->count++;
 }
 
 /*
- * Prints a description. Link detection is performed
- * and the links are matched by game_link_match().
- * Links are printed in a specific color.
+ * Completes the link under construction. A
+ * punctuation mark after the closing marker
+ * is split off, than the link is matched and
+ * added to the list of links.
  *
- * words: List with words to print
+ * links: List with the link
+ * first: First word of the link
+ * last: Last word of the link
  */
 static void
-game_print_description(list *words)
+game_link_finish(game_linklist *links, uint32_t first, uint32_t last)
 {
-	char *cur;
-	char *link;
-	char tmp[3];
-	listnode *node;
-	size_t len, oldlen;
-	uint32_t color;
+	game_link_s new;
 
-	assert (words);
+	memset(&new, 0, sizeof(new));
 
-	len = 0;
-	link = NULL;
-	node = words->first;
-	memset(tmp, 0, sizeof(tmp));
+	new.first = first;
+	new.last = last;
 
-	while (node)
+	if (links->len >= 2 && links->text[links->len - 2] == '|')
 	{
-		cur = node->data;
+		new.suffix[0] = links->text[links->len - 1];
+		links->text[--links->len] = '\0';
+	}
 
-		// Word starts a link
-		if (!strncmp(cur, "|", 1))
-		{
-			if (link)
-			{
-				log_error(i18n_link_nestedlink);
+	game_link_match(&new, links->text);
 
-				if (!node->next || !strcmp(cur, "\n"))
-				{
-					curses_text(TINT_NORM, cur);
-				}
-				else
-				{
-					curses_text(TINT_NORM, "%s ", cur);
-				}
+	new.text = arena_strdup(game_arena, links->text);
+	game_link_push(links, &new);
 
-				node = node->next;
-				continue;
-			}
+	links->len = 0;
+}
 
-			if (!strncmp(&cur[strlen(cur) - 1], "|", 1)
-				|| !strncmp(&cur[strlen(cur) - 2], "|", 1))
-			{
-				link = strdup(cur);
+/*
+ * Finds and resolves all links in a description.
+ * This is done once, when the description is
+ * printed for the first time. Broken links are
+ * logged here. The links are stored in the arena,
+ * so they survive when a lazy body is thrown out.
+ *
+ * text: Description to resolve
+ */
+static void
+game_text_resolve(game_text_s *text)
+{
+	boolean open;
+	const char *cur;
+	game_link_s new;
+	game_linklist links;
+	size_t wordlen;
+	uint32_t first;
+	uint32_t i;
 
-				if (!strncmp(&link[strlen(link) - 2], "|", 1))
-				{
-					misc_strlcpy(tmp, &link[strlen(link) - 1], sizeof(tmp));
-					link[strlen(link) - 1] = '\0';
-				}
+	assert(text);
 
-				color = game_match_link(link);
+	if (text->resolved)
+	{
+		return;
+	}
 
-				curses_text(color, link);
+	first = 0;
+	open = FALSE;
+	memset(&links, 0, sizeof(links));
 
-				if (!node->next || !strcmp(cur, "\n"))
-				{
-					curses_text(color, tmp);
-				}
-				else
-				{
-					curses_text(color, "%s ", tmp);
-				}
+	for (i = 0; i < text->words; i++)
+	{
+		cur = game_text_word(text, i);
+		wordlen = strlen(cur);
 
-				free(link);
-				link = NULL;
-				memset(tmp, 0, sizeof(tmp));
+		// Word starts a link
+		if (cur[0] == '|')
+		{
+			if (open)
+			{
+				log_error(i18n_link_nestedlink);
 
-				node = node->next;
 				continue;
 			}
 
-			len = strlen(cur) + 2;
+			game_link_append(&links, cur, wordlen);
 
-			if ((link = calloc(1, len)) == 0)
+			if (cur[wordlen - 1] == '|' || (wordlen >= 2 && cur[wordlen - 2] == '|'))
 			{
-				quit_error(POUTOFMEM);
+				game_link_finish(&links, i, i);
+
+				continue;
 			}
 
-			misc_strlcat(link, cur, len);
-			misc_strlcat(link, " ", len);
+			game_link_append(&links, " ", 1);
+
+			first = i;
+			open = TRUE;
 
-			node = node->next;
 			continue;
 		}
 
 		// Word ends a link
-		if (strlen(cur) >= 3)
+		if (wordlen >= 3)
 		{
-			if (!strncmp(&cur[strlen(cur) - 1], "|", 1)
-				|| !strncmp(&cur[strlen(cur) - 2], "|", 1))
+			if (cur[wordlen - 1] == '|' || cur[wordlen - 2] == '|')
 			{
-				if (!link)
+				if (!open)
 				{
 					log_error(i18n_link_notopened);
 
-					if (!node->next || !strcmp(cur, "\n"))
-					{
-						curses_text(TINT_NORM, cur);
-					}
-					else
-					{
-						curses_text(TINT_NORM, "%s ", cur);
-					}
-
-					node = node->next;
 					continue;
 				}
 
-				oldlen = len;
-				len = strlen(cur) + len + 2;
-
-				if ((link = realloc(link, len)) == NULL)
-				{
-					quit_error(POUTOFMEM);
-				}
-
-				memset(link + len, 0, len - oldlen);
-				misc_strlcat(link, cur, len);
-
-				if (!strncmp(&link[strlen(link) - 2], "|", 1))
-				{
-					misc_strlcpy(tmp, &link[strlen(link) - 1], sizeof(tmp));
-					link[strlen(link) - 1] = '\0';
-				}
-
-				color = game_match_link(link);
-
-				curses_text(color, link);
-
-				if (!node->next || !strcmp(cur, "\n"))
-				{
-					curses_text(color, tmp);
-				}
-				else
-				{
-					curses_text(color, "%s ", tmp);
-				}
+				game_link_append(&links, cur, wordlen);
+				game_link_finish(&links, first, i);
 
-				free(link);
-				link = NULL;
-				memset(tmp, 0, sizeof(tmp));
+				open = FALSE;
 
-				node = node->next;
 				continue;
 			}
 		}
 
 		// Word is part of a link
-		if (link)
+		if (open)
 		{
 			if (!strcmp(cur, "\n"))
 			{
 				log_error(i18n_link_linebreak);
 
-				if (!node->next || !strcmp(cur, "\n"))
-				{
-					curses_text(TINT_NORM, "%s ", link);
-					curses_text(TINT_NORM, cur);
-				}
-				else
-				{
-					curses_text(TINT_NORM, "%s ", link);
-					curses_text(TINT_NORM, "%s ", cur);
-				}
+				memset(&new, 0, sizeof(new));
+				new.first = first;
+				new.last = i;
+				new.kind = GAME_LINK_BROKEN;
+				new.text = arena_strdup(game_arena, links.text);
+				game_link_push(&links, &new);
 
-				free(link);
-				link = NULL;
+				links.len = 0;
+				open = FALSE;
 
-				node = node->next;
 				continue;
 			}
 
-			oldlen = len;
-			len = strlen(cur) + len + 2;
+			game_link_append(&links, cur, wordlen);
+			game_link_append(&links, " ", 1);
+		}
+	}
 
-			if ((link = realloc(link, len)) == NULL)
-			{
-				quit_error(POUTOFMEM);
-			}
+	// Link still open, it's swallowed
+	if (open)
+	{
+		log_error(i18n_link_openatend);
+
+		memset(&new, 0, sizeof(new));
+		new.first = first;
+		new.last = text->words;
+		new.kind = GAME_LINK_OPEN;
+		game_link_push(&links, &new);
+	}
 
-			memset(link + len, 0, len - oldlen);
-			misc_strlcat(link, cur, len);
-			misc_strlcat(link, " ", len);
+	if (links.count)
+	{
+		text->links = arena_alloc(game_arena, links.count * sizeof(game_link_s));
+		memcpy((game_link_s *)text->links, links.links, links.count * sizeof(game_link_s));
+		text->link_count = links.count;
+	}
 
-			node = node->next;
-			continue;
+	text->resolved = TRUE;
+
+	free(links.links);
+	free(links.text);
+}
+
+/*
+ * Appends text to a stream of text runs. It's
+ * merged into the last run if it has the same
+ * color.
+ *
+ * stream: Stream to append to
+ * color: Color of the text
+ * str: Text to append
+ * len: Length of the text
+ */
+static void
+game_op_append(game_opstream *stream, uint32_t color, const char *str, size_t len)
+{
+	if (!len)
+	{
+		return;
+	}
+
+	if (stream->len + len > stream->size)
+	{
+		while (stream->len + len > stream->size)
+		{
+			stream->size = stream->size ? stream->size * 2 : 1024;
 		}
 
-		// Normal word
-		if (!node->next || !strcmp(cur, "\n"))
+		if ((stream->text = realloc(stream->text, stream->size)) == NULL)
 		{
-			curses_text(TINT_NORM, cur);
+			quit_error(POUTOFMEM);
 		}
-		else
+	}
+
+	memcpy(stream->text + stream->len, str, len);
+	stream->len += len;
+
+	if (stream->count && stream->ops[stream->count - 1].color == color)
+	{
+		stream->ops[stream->count - 1].length += len;
+
+		return;
+	}
+
+	if (stream->count == stream->size_ops)
+	{
+		stream->size_ops = stream->size_ops ? stream->size_ops * 2 : 16;
+
+		if ((stream->ops = realloc(stream->ops, stream->size_ops * sizeof(curses_op_s))) == NULL)
 		{
-			curses_text(TINT_NORM, "%s ", cur);
+			quit_error(POUTOFMEM);
 		}
+	}
+
+	stream->ops[stream->count].color = color;
+	stream->ops[stream->count].length = len;
+	stream->ops[stream->count].text = NULL;
+	stream->count++;
+}
+
+/*
+ * Appends a resolved link to a stream of text
+ * runs, in the color of the linked object.
+ *
+ * stream: Stream to append to
+ * link: Link to append
+ * last: Link ends the description
+ */
+static void
+game_link_compile(game_opstream *stream, const game_link_s *link, boolean last)
+{
+	uint32_t color;
+
+	switch (link->kind)
+	{
+		case GAME_LINK_GLOSSARY:
+			color = TINT_GLOSSARY;
+			break;
+
+		case GAME_LINK_ROOM:
+			color = TINT_ROOM;
+			break;
+
+		case GAME_LINK_SCENE:
+			color = TINT_SCENE;
+			break;
+
+		case GAME_LINK_BROKEN:
+			// Ends with a paragraph
+			game_op_append(stream, TINT_NORM, link->text, strlen(link->text));
+			game_op_append(stream, TINT_NORM, " \n", 2);
+
+			return;
+
+		case GAME_LINK_OPEN:
+			return;
+
+		default:
+			color = TINT_NORM;
+			break;
+	}
+
+	game_op_append(stream, color, link->text, strlen(link->text));
+	game_op_append(stream, color, link->suffix, strlen(link->suffix));
+
+	if (!last)
+	{
+		game_op_append(stream, color, " ", 1);
+	}
+}
+
+/*
+ * Compiles a description with resolved links
+ * into a stream of text runs. Descriptions of
+ * bodies loaded on demand are thrown out with
+ * the body, all others are kept in the arena.
+ *
+ * text: Description to compile
+ */
+static void
+game_text_compile(game_text_s *text)
+{
+	boolean last;
+	char *buf;
+	const char *cur;
+	const game_link_s *link;
+	curses_op_s *ops;
+	game_opstream stream;
+	size_t size;
+	uint32_t i;
+	uint32_t next;
+
+	assert(text);
+	assert(text->resolved);
+
+	if (text->ops)
+	{
+		return;
+	}
+
+	memset(&stream, 0, sizeof(stream));
+	next = 0;
+
+	for (i = 0; i < text->words; i++)
+	{
+		cur = game_text_word(text, i);
+		last = (i == text->words - 1);
+
+		// Word belongs to a link
+		if (next < text->link_count && i >= text->links[next].first)
+		{
+			link = &text->links[next];
+
+			if (i == link->last)
+			{
+				game_link_compile(&stream, link, last);
+				next++;
+
+				continue;
+			}
+
+			// Nested links are printed as they are
+			if (i == link->first || cur[0] != '|')
+			{
+				continue;
+			}
+		}
+
+		// Normal word
+		game_op_append(&stream, TINT_NORM, cur, strlen(cur));
+
+		if (!last && strcmp(cur, "\n"))
+		{
+			game_op_append(&stream, TINT_NORM, " ", 1);
+		}
+	}
+
+	game_op_append(&stream, TINT_NORM, "\n", 1);
+
+	// Runs and their text in one block
+	size = stream.count * sizeof(curses_op_s) + stream.len;
+
+	if (text->body)
+	{
+		if ((ops = malloc(size)) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
+
+		bodies.size += size;
+	}
+	else
+	{
+		ops = arena_alloc(game_arena, size);
+	}
+
+	buf = (char *)(ops + stream.count);
+	memcpy(buf, stream.text, stream.len);
+
+	for (i = 0; i < stream.count; i++)
+	{
+		ops[i] = stream.ops[i];
+		ops[i].text = buf;
+
+		buf += ops[i].length;
+	}
+
+	text->ops = ops;
+	text->op_count = stream.count;
+	text->ops_size = size;
+
+	free(stream.ops);
+	free(stream.text);
+}
+
+/*
+ * Makes sure that a description is in memory.
+ * Bodies of big game files are loaded on first
+ * access. They're kept in a LRU list, when the
+ * list grows beyond BODYCACHE bytes the least
+ * recently used bodies are thrown out.
+ *
+ * text: Description to load
+ */
+static void
+game_text_load(game_text_s *text)
+{
+	assert(text);
+
+	// Loaded by the parser or from an image
+	if (!text->body)
+	{
+		return;
+	}
+
+	if (text->ids)
+	{
+		game_text_unlink(text);
+	}
+	else
+	{
+		parser_text_load(text);
+		bodies.size += game_text_size(text);
+	}
+
+	text->older = bodies.newest;
+
+	if (bodies.newest)
+	{
+		bodies.newest->newer = text;
+	}
+	else
+	{
+		bodies.oldest = text;
+	}
+
+	bodies.newest = text;
+
+	// The body just loaded is always kept
+	while (bodies.size > BODYCACHE && bodies.oldest != text)
+	{
+		game_text_evict();
+	}
+}
+
+/*
+ * Prints a description. It's compiled on the
+ * first call, afterwards the text runs are just
+ * handed to the renderer. Linked glossary entries
+ * and rooms are marked as mentioned.
+ *
+ * text: Text to print
+ */
+static void
+game_print_description(game_text_s *text)
+{
+	uint32_t i;
+
+	assert(text);
+
+	game_text_load(text);
+	game_text_resolve(text);
+	game_text_compile(text);
+
+	for (i = 0; i < text->link_count; i++)
+	{
+		if (text->links[i].kind == GAME_LINK_GLOSSARY)
+		{
+			game_state_set(((game_glossary_s *)text->links[i].target)->id, GAME_MENTIONED);
+		}
+		else if (text->links[i].kind == GAME_LINK_ROOM)
+		{
+			game_state_set(((game_room_s *)text->links[i].target)->id, GAME_MENTIONED);
+		}
+	}
+
+	curses_render(text->ops, text->op_count);
+}
+
+/*
+ * Callback for hashmap_destroy(). All objects
+ * are owned by 'game_arena', so there's nothing
+ * to do here.
+ *
+ * data: Object to destroy
+ */
+static void
+game_destroy_callback(void *data)
+{
+}
+
+/*
+ * Returns a list with the objects of a kind,
+ * in the order they were defined. If a filter
+ * is given, only the objects in it are added.
+ *
+ * kind: Kind of the objects
+ * filter: Set of objects to add, may be NULL
+ */
+static list
+*game_object_list(uint8_t kind, const bitset *filter)
+{
+	list *content;
+	uint32_t i;
+
+	content = list_create();
+
+	if (!filter)
+	{
+		for (i = 0; i < game_objects[kind].count; i++)
+		{
+			list_push(content, game_objects[kind].objects[i]);
+		}
+
+		return content;
+	}
+
+	for (i = bitset_next(filter, 0); i < filter->size; i = bitset_next(filter, i + 1))
+	{
+		list_push(content, game_objects[kind].objects[i]);
+	}
+
+	return content;
+}
+
+/*
+ * Resolves the first scene. It's looked up at
+ * every load, compiled images bring only the
+ * references between the objects with them.
+ */
+static void
+game_first_resolve(void)
+{
+	game_id id;
+
+	if ((id = game_symbol_get(game_header->first_scene, GAME_SCENE)) == 0)
+	{
+		log_error_f("%s: %s", i18n_scene_firstnotfound, game_header->first_scene);
+		quit_error(PFIRSTSCENENOTFOUND);
+	}
+
+	first_scene = game_object_get(id);
+}
+
+/*
+ * Resolves the room and choices of all scenes.
+ * A reference to an object that doesn't exist
+ * is fatal, so a broken game fails at load and
+ * not when the player reaches the broken scene.
+ */
+static void
+game_scenes_resolve(void)
+{
+	game_id id;
+	game_scene_s *scene;
+	uint32_t i;
+	uint8_t j;
+
+	for (i = 0; i < game_objects[GAME_SCENE].count; i++)
+	{
+		scene = game_objects[GAME_SCENE].objects[i];
+
+		if ((id = game_symbol_find(scene->room, GAME_ROOM)) == 0)
+		{
+			log_error_f("%s: %s", i18n_room_notfound, scene->room);
+			quit_error(PROOMNOTFOUND);
+		}
+
+		scene->location = game_object_get(id);
+
+		for (j = 0; j < scene->next_count; j++)
+		{
+			if (!strcmp(scene->next[j], "END"))
+			{
+				scene->targets[j] = NULL;
+
+				continue;
+			}
+
+			if ((id = game_symbol_find(scene->next[j], GAME_SCENE)) == 0)
+			{
+				log_error_f("%s: %s", i18n_scene_notfound, scene->next[j]);
+				quit_error(PSCENENOTFOUND);
+			}
+
+			scene->targets[j] = game_object_get(id);
+		}
+	}
+}
+
+/*
+ * Resolves the links of all descriptions. Images
+ * carry the resolved links, so this is done before
+ * one is written. The image is written alongside
+ * the game, the links mustn't change afterwards.
+ */
+static void
+game_texts_resolve(void)
+{
+	uint32_t i;
+	uint8_t kind;
+
+	for (kind = 0; kind < GAME_KINDS; kind++)
+	{
+		for (i = 0; i < game_objects[kind].count; i++)
+		{
+			switch (kind)
+			{
+				case GAME_GLOSSARY:
+					game_text_resolve(&((game_glossary_s *)game_objects[kind].objects[i])->text);
+					break;
+
+				case GAME_ROOM:
+					game_text_resolve(&((game_room_s *)game_objects[kind].objects[i])->text);
+					break;
+
+				default:
+					game_text_resolve(&((game_scene_s *)game_objects[kind].objects[i])->text);
+					break;
+			}
+		}
+	}
+}
+
+// --------
+
+/*
+ * Creates the state sets. Must be called
+ * after all objects were added.
+ */
+static void
+game_state_create(void)
+{
+	uint8_t i;
+	uint8_t j;
+
+	for (i = 0; i < GAME_KINDS; i++)
+	{
+		for (j = 0; j < GAME_STATES; j++)
+		{
+			game_state[i][j] = bitset_create(game_objects[i].count);
+		}
+	}
+
+	undo.size = UNDOSIZE / sizeof(game_undo_s);
+
+	if (undo.size && (undo.entries = calloc(undo.size, sizeof(game_undo_s))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                         Object Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+game_id
+game_object_add(uint8_t kind, void *object)
+{
+	game_objects_s *objects;
+
+	assert(kind < GAME_KINDS);
+	assert(object);
+
+	objects = &game_objects[kind];
+
+	if (objects->count == GAME_ID_INDEX(UINT32_MAX))
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	if (objects->count == objects->size)
+	{
+		objects->size = objects->size ? objects->size * 2 : 128;
+
+		if ((objects->objects = realloc(objects->objects, objects->size * sizeof(void *))) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
+	}
+
+	objects->objects[objects->count] = object;
+
+	return GAME_ID(kind, objects->count++);
+}
+
+void
+*game_object_get(game_id id)
+{
+	assert(id);
+	assert(GAME_ID_KIND(id) < GAME_KINDS);
+	assert(GAME_ID_INDEX(id) < game_objects[GAME_ID_KIND(id)].count);
+
+	return game_objects[GAME_ID_KIND(id)].objects[GAME_ID_INDEX(id)];
+}
+
+void
+game_symbol_add(const char *name, game_id id)
+{
+	game_symbol_s *symbol;
+
+	assert(name);
+	assert(id);
+
+	if ((symbol = hashmap_get_hashed(game_symbols, name, strlen(name), strpool_hash(name))) == NULL)
+	{
+		symbol = arena_alloc(game_arena, sizeof(game_symbol_s));
+		hashmap_add_hashed(game_symbols, name, strpool_hash(name), symbol);
+	}
+
+	if (!symbol->ids[GAME_ID_KIND(id)])
+	{
+		symbol->ids[GAME_ID_KIND(id)] = id;
+	}
+}
+
+game_id
+game_symbol_find(const char *name, uint8_t kind)
+{
+	const game_symbol_s *symbol;
+
+	assert(name);
+	assert(kind < GAME_KINDS);
+
+	if ((symbol = hashmap_get_hashed(game_symbols, name, strlen(name), strpool_hash(name))) == NULL)
+	{
+		return 0;
+	}
+
+	return symbol->ids[kind];
+}
+
+game_id
+game_symbol_get(const char *name, uint8_t kind)
+{
+	const game_symbol_s *symbol;
+
+	assert(name);
+	assert(kind < GAME_KINDS);
+
+	if ((symbol = hashmap_get(game_symbols, name)) == NULL)
+	{
+		return 0;
+	}
+
+	return symbol->ids[kind];
+}
+
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                          State Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+boolean
+game_state_clear(game_id id, uint8_t state)
+{
+	bitset *set;
+
+	assert(id);
+	assert(state < GAME_STATES);
+
+	set = game_state[GAME_ID_KIND(id)][state];
+
+	if (!bitset_get(set, GAME_ID_INDEX(id)))
+	{
+		return FALSE;
+	}
+
+	bitset_unset(set, GAME_ID_INDEX(id));
+	save_journal_clear(id, state);
+
+	return TRUE;
+}
+
+uint32_t
+game_state_count(uint8_t kind, uint8_t state)
+{
+	assert(kind < GAME_KINDS);
+	assert(state < GAME_STATES);
+
+	return bitset_count(game_state[kind][state]);
+}
+
+boolean
+game_state_get(game_id id, uint8_t state)
+{
+	assert(id);
+	assert(state < GAME_STATES);
+
+	return bitset_get(game_state[GAME_ID_KIND(id)][state], GAME_ID_INDEX(id)) ? TRUE : FALSE;
+}
 
-		node = node->next;
-	}
+void
+game_state_reset(void)
+{
+	uint8_t i;
+	uint8_t j;
 
-	// Link still open
-	if (link)
+	for (i = 0; i < GAME_KINDS; i++)
 	{
-		log_error(i18n_link_openatend);
+		for (j = 0; j < GAME_STATES; j++)
+		{
+			bitset_clear(game_state[i][j]);
+		}
 	}
 
-	curses_text(TINT_NORM, "\n");
+	// There's nothing to go back to
+	undo.first = 0;
+	undo.count = 0;
 }
 
-
-// --------
-
-/*********************************************************************
- *                                                                   *
- *                        Glossary Functions                         *
- *                                                                   *
- *********************************************************************/
-
-/*
- * Callback to destroy an instance of 'game_glossary_s'.
- * To be passed to hashmap_destroy() or the like.
- *
- * data: Glossary to destroy
- */
-static void
-game_glossary_destroy_callback(void *data)
+boolean
+game_state_set(game_id id, uint8_t state)
 {
-	game_glossary_s *entry;
+	bitset *set;
 
-	assert(data);
+	assert(id);
+	assert(state < GAME_STATES);
 
-	entry = data;
-
-	if (entry->name)
-	{
-		free((char *)entry->name);
-	}
+	set = game_state[GAME_ID_KIND(id)][state];
 
-	if (entry->descr)
+	if (bitset_get(set, GAME_ID_INDEX(id)))
 	{
-		free((char *)entry->descr);
+		return FALSE;
 	}
 
-	if (entry->aliases)
-	{
-		list_destroy(entry->aliases, NULL);
-	}
+	bitset_set(set, GAME_ID_INDEX(id));
+	save_journal_state(id, state);
+	game_undo_push(GAME_UNDO_STATE, id, state);
 
-	if (entry->words)
+	// Visited rooms are always mentioned
+	if (GAME_ID_KIND(id) == GAME_ROOM && state == GAME_VISITED)
 	{
-		list_destroy(entry->words, NULL);
+		game_state_set(id, GAME_MENTIONED);
 	}
 
-	free(entry);
+	return TRUE;
 }
 
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                        Glossary Functions                         *
+ *                                                                   *
+ *********************************************************************/
+
 /*
  * Callback function to qsort for the glossary.
  */
@@ -419,7 +1272,11 @@ game_glossary_list(void)
 	uint16_t count;
 	uint16_t i;
 
-	data = hashmap_to_list(game_glossary);
+#ifdef NDEBUG
+	data = game_object_list(GAME_GLOSSARY, game_state[GAME_GLOSSARY][GAME_MENTIONED]);
+#else
+	data = game_object_list(GAME_GLOSSARY, NULL);
+#endif
 	list_sort(data, game_glossary_sort_callback);
 	len_entry = 0;
 
@@ -433,15 +1290,6 @@ game_glossary_list(void)
 			{
 				entry = node->data;
 
-#ifdef NDEBUG
-				if (!entry->mentioned)
-				{
-					node = node->next;
-
-					continue;
-				}
-#endif
-
 				if (strlen(entry->name) > len_entry)
 				{
 					len_entry = strlen(entry->name);
@@ -483,13 +1331,6 @@ game_glossary_list(void)
 	{
 		entry = list_shift(data);
 
-#ifdef NDEBUG
-		if (!entry->mentioned)
-		{
-			continue;
-		}
-#endif
-
 		curses_text(TINT_NORM, "%-*s %s\n", len_entry + 2, entry->name, entry->descr);
 	}
 
@@ -501,6 +1342,7 @@ void
 game_glossary_print(const char *key)
 {
 	game_glossary_s *entry;
+	game_id id;
 
 #ifndef NDEBUG
 	listnode *lnode;
@@ -509,13 +1351,15 @@ game_glossary_print(const char *key)
 
 	assert(key);
 
-	if ((entry = hashmap_get(game_glossary, key)) == NULL)
+	if ((id = game_symbol_get(key, GAME_GLOSSARY)) == 0)
 	{
 		curses_text(TINT_NORM, "%s: %s\n", i18n_glossary_notfound, key);
 
 		return;
 	}
 
+	entry = game_object_get(id);
+
 #ifndef NDEBUG
 	curses_text(TINT_HIGH, "%s", entry->name);
 
@@ -554,7 +1398,7 @@ game_glossary_print(const char *key)
 
 #else
 
-	if (!entry->mentioned)
+	if (!game_state_get(id, GAME_MENTIONED))
 	{
 		curses_text(TINT_NORM, "%s: %s\n", i18n_glossary_notfound, key);
 
@@ -562,7 +1406,7 @@ game_glossary_print(const char *key)
 	}
 #endif // NDEBUG
 
-	game_print_description(entry->words);
+	game_print_description(&entry->text);
 }
 
 // --------
@@ -573,44 +1417,6 @@ game_glossary_print(const char *key)
  *                                                                   *
  *********************************************************************/
 
-/*
- * Callback to destroy an instance of 'game_room_s'.
- * To be passed to hashmap_destroy() or the like.
- *
- * data: Room to destroy
- */
-static void
-game_room_destroy_callback(void *data)
-{
-	game_room_s *room;
-
-	assert(data);
-
-	room = data;
-
-	if (room->name)
-	{
-		free((char *)room->name);
-	}
-
-	if (room->descr)
-	{
-		free((char *)room->descr);
-	}
-
-	if (room->aliases)
-	{
-		list_destroy(room->aliases, NULL);
-	}
-
-	if (room->words)
-	{
-		list_destroy(room->words, NULL);
-	}
-
-	free(room);
-}
-
 /*
  * Callback function to qsort for the rooms.
  */
@@ -637,6 +1443,7 @@ game_room_sort_callback(const void *msg1, const void *msg2)
 void
 game_room_describe(const char *key)
 {
+	game_id id;
 	game_room_s *room;
 
 #ifndef NDEBUG
@@ -646,13 +1453,15 @@ game_room_describe(const char *key)
 
 	assert(key);
 
-	if ((room = hashmap_get(game_rooms, key)) == NULL)
+	if ((id = game_symbol_get(key, GAME_ROOM)) == 0)
 	{
 		curses_text(TINT_NORM, "%s\n", i18n_room_notfound, key);
 
 		return;
 	}
 
+	room = game_object_get(id);
+
 #ifndef NDEBUG
 	curses_text(TINT_HIGH, "%s", room->name);
 
@@ -691,14 +1500,14 @@ game_room_describe(const char *key)
 
 #else
 
-	if (room->mentioned && !room->visited)
+	if (game_state_get(id, GAME_MENTIONED) && !game_state_get(id, GAME_VISITED))
 	{
 		curses_text(TINT_NORM, "%s\n", i18n_room_mentioned);
 
 		return;
 	}
 
-	if (!room->visited)
+	if (!game_state_get(id, GAME_VISITED))
 	{
 		curses_text(TINT_NORM, "%s\n", i18n_room_notfound, key);
 
@@ -707,7 +1516,7 @@ game_room_describe(const char *key)
 #endif // NDEBUG
 
 	// Print description
-	game_print_description(room->words);
+	game_print_description(&room->text);
 }
 
 void
@@ -720,7 +1529,11 @@ game_rooms_list(void)
 	uint16_t count;
 	uint16_t i;
 
-	data = hashmap_to_list(game_rooms);
+#ifdef NDEBUG
+	data = game_object_list(GAME_ROOM, game_state[GAME_ROOM][GAME_MENTIONED]);
+#else
+	data = game_object_list(GAME_ROOM, NULL);
+#endif
 	list_sort(data, game_room_sort_callback);
 	len = 0;
 
@@ -734,15 +1547,6 @@ game_rooms_list(void)
 			{
 				room = node->data;
 
-#ifdef NDEBUG
-				if (!room->visited && !room->mentioned)
-				{
-					node = node->next;
-
-					continue;
-				}
-#endif
-
 				if (strlen(room->name) > len)
 				{
 					len = strlen(room->name);
@@ -792,20 +1596,13 @@ game_rooms_list(void)
 	{
 		room = list_shift(data);
 
-#ifdef NDEBUG
-		if (!room->visited && !room->mentioned)
-		{
-			continue;
-		}
-#endif
-
 		curses_text(TINT_NORM, "%-*s", len + 2, room->name);
 
-		if (room->visited)
+		if (game_state_get(room->id, GAME_VISITED))
 		{
 			curses_text(TINT_NORM, "%-*s", strlen(i18n_head_state) + 2, "S");
 		}
-		else if (room->mentioned)
+		else if (game_state_get(room->id, GAME_MENTIONED))
 		{
 			curses_text(TINT_NORM, "%-*s", strlen(i18n_head_state) + 2, "M");
 		}
@@ -829,59 +1626,6 @@ game_rooms_list(void)
  *                                                                   *
  *********************************************************************/
 
-/*
- * Callback to destroy an instance of 'game_scene_s'.
- * To be passed to hashmap_destroy() or the like.
- *
- * data: Scene to destroy
- */
-static void
-game_scene_destroy_callback(void *data)
-{
-	game_scene_s *scene;
-
-	assert(data);
-
-	scene = data;
-
-	if (scene->name)
-	{
-		free((char *)scene->name);
-	}
-
-	if (scene->descr)
-	{
-		free((char *)scene->descr);
-	}
-
-	if (scene->prompt)
-	{
-		free((char *)scene->prompt);
-	}
-
-	if (scene->room)
-	{
-		free((char *)scene->room);
-	}
-
-	if (scene->aliases)
-	{
-		list_destroy(scene->aliases, NULL);
-	}
-
-	if (scene->words)
-	{
-		list_destroy(scene->words, NULL);
-	}
-
-	if (scene->next)
-	{
-		darray_destroy(scene->next, NULL);
-	}
-
-	free(scene);
-}
-
 /*
  * Callback function to qsort for the scenes.
  */
@@ -919,11 +1663,11 @@ game_scene_endscreen(void)
 	curses_text(TINT_NORM, ".\n\n");
 
 	curses_text(TINT_NORM, "%s:\n", i18n_end_stats);
-	curses_text(TINT_NORM, " - %i %s %i %s\n", game_stats->glossary_mentioned,
+	curses_text(TINT_NORM, " - %i %s %i %s\n", game_state_count(GAME_GLOSSARY, GAME_MENTIONED),
 				i18n_from, game_stats->glossary_total, i18n_end_glossaryentriesseen);
-	curses_text(TINT_NORM, " - %i %s %i %s\n", game_stats->rooms_visited,
+	curses_text(TINT_NORM, " - %i %s %i %s\n", game_state_count(GAME_ROOM, GAME_VISITED),
 				i18n_from, game_stats->rooms_total, i18n_end_roomsvisited);
-	curses_text(TINT_NORM, " - %i %s %i %s\n\n", game_stats->scenes_visited,
+	curses_text(TINT_NORM, " - %i %s %i %s\n\n", game_state_count(GAME_SCENE, GAME_VISITED),
 				i18n_from, game_stats->scenes_total, i18n_end_scenesplayed);
 
 	curses_status(i18n_end_statusbar);
@@ -999,7 +1743,11 @@ game_scene_list(void)
 	uint16_t count;
 	uint16_t i;
 
-	data = hashmap_to_list(game_scenes);
+#ifdef NDEBUG
+	data = game_object_list(GAME_SCENE, game_state[GAME_SCENE][GAME_VISITED]);
+#else
+	data = game_object_list(GAME_SCENE, NULL);
+#endif
 	list_sort(data, game_scene_sort_callback);
 	len_scene = 0;
 	len_room = 0;
@@ -1014,15 +1762,6 @@ game_scene_list(void)
 			{
 				scene = node->data;
 
-#ifdef NDEBUG
-				if (!scene->visited)
-				{
-					node = node->next;
-
-					continue;
-				}
-#endif
-
 				if (strlen(scene->name) > len_scene)
 				{
 					len_scene = strlen(scene->name);
@@ -1078,13 +1817,6 @@ game_scene_list(void)
 		scene = list_shift(data);
 		log_info_f("Scene: %s", scene->name);
 
-#ifdef NDEBUG
-		if (!scene->visited)
-		{
-			continue;
-		}
-#endif
-
 		curses_text(TINT_NORM, "%-*s", len_scene + 2, scene->name);
 		curses_text(TINT_NORM, "%-*s", len_room + 2, scene->room);
 		curses_text(TINT_NORM, "%s\n", scene->descr);
@@ -1094,12 +1826,40 @@ game_scene_list(void)
 	log_info_f("%s: %i", i18n_scene_listed, i);
 }
 
+uint32_t
+game_scene_back(uint32_t steps)
+{
+	game_undo_s *entry;
+	uint32_t done;
+
+	done = 0;
+
+	while (done < steps && undo.count)
+	{
+		entry = &undo.entries[(undo.first + --undo.count) % undo.size];
+
+		if (entry->type == GAME_UNDO_STATE)
+		{
+			game_state_clear(entry->id, entry->value);
+
+			continue;
+		}
+
+		current_scene = entry->id ? game_object_get(entry->id) : NULL;
+		game_end = entry->value;
+		save_journal_scene();
+
+		done++;
+	}
+
+	log_info_f("%s: %u", i18n_scene_back, done);
+
+	return done;
+}
+
 boolean
 game_scene_next(uint8_t choice)
 {
-	char *key;
-	game_scene_s *scene;
-
 	if (choice)
 	{
 		log_info_f("%s. %s: %i", i18n_scene_next, i18n_scene_playerschoice, choice);
@@ -1111,100 +1871,74 @@ game_scene_next(uint8_t choice)
 
 	if (!current_scene)
 	{
-		if ((current_scene = hashmap_get(game_scenes, game_header->first_scene)) == NULL)
-		{
-			log_error_f("%s: %i\n", i18n_scene_firstnotfound, game_header->first_scene);
-			quit_error(PFIRSTSCENENOTFOUND);
-		}
-	}
-	else
-	{
-		if (choice)
-		{
-			if (current_scene->next->elements == 1)
-			{
-				curses_text(TINT_NORM, i18n_scene_nochoice);
-
-				return FALSE;
-			}
-			if (choice > current_scene->next->elements)
-			{
-				curses_text(TINT_NORM, i18n_scene_invalidchoice);
+		game_undo_push(GAME_UNDO_STEP, 0, game_end);
 
-				return FALSE;
-			}
-
-			key = darray_get(current_scene->next, choice - 1);
+		current_scene = first_scene;
+		save_journal_scene();
 
-			if (!strcmp(key, "END"))
-			{
-				current_scene = NULL;
-				game_end = 1;
+		return TRUE;
+	}
 
-				return TRUE;
-			}
+	if (choice)
+	{
+		if (current_scene->next_count == 1)
+		{
+			curses_text(TINT_NORM, i18n_scene_nochoice);
 
-			if ((scene = hashmap_get(game_scenes, key)) == NULL)
-			{
-				log_error_f("%s: %s\n", i18n_scene_notfound, game_header->first_scene);
-				quit_error(PSCENENOTFOUND);
-			}
-			else
-			{
-				current_scene = scene;
-			}
+			return FALSE;
 		}
-		else
+		if (choice > current_scene->next_count)
 		{
-			if (current_scene->next->elements > 1)
-			{
-				curses_text(TINT_NORM, "%s\n", i18n_scene_choice);
+			curses_text(TINT_NORM, i18n_scene_invalidchoice);
 
-				return FALSE;
-			}
+			return FALSE;
+		}
+	}
+	else
+	{
+		if (current_scene->next_count > 1)
+		{
+			curses_text(TINT_NORM, "%s\n", i18n_scene_choice);
 
-			key = darray_get(current_scene->next, 0);
+			return FALSE;
+		}
 
-			if (!strcmp(key, "END"))
-			{
-				current_scene = NULL;
-				game_end = 1;
+		choice = 1;
+	}
 
-				return TRUE;
-			}
+	game_undo_push(GAME_UNDO_STEP, current_scene->id, game_end);
 
-			if ((scene = hashmap_get(game_scenes, key)) == NULL)
-			{
-				log_error_f("%s: %s\n", i18n_scene_notfound, game_header->first_scene);
-				quit_error(PSCENENOTFOUND);
-			}
-			else
-			{
-				current_scene = scene;
-			}
-		}
+	// END
+	if ((current_scene = current_scene->targets[choice - 1]) == NULL)
+	{
+		game_end = 1;
 	}
 
+	save_journal_scene();
+
 	return TRUE;
 }
 
 void
 game_scene_play(const char *key)
 {
+	game_id id;
 	game_room_s *room;
 	game_scene_s *scene;
 
 	if (key)
 	{
-		if ((scene = hashmap_get(game_scenes, key)) == NULL)
+		if ((id = game_symbol_get(key, GAME_SCENE)) == 0)
 		{
 			curses_text(TINT_NORM, "%s: %s\n", i18n_scene_notfound, key);
 
 			return;
 		}
 
+		scene = game_object_get(id);
+
 #ifdef NDEBUG
-		if (!scene->visited)
+		if (!game_state_get(id, GAME_VISITED))
 		{
 			curses_text(TINT_NORM, "%s: %s\n", i18n_scene_notfound, key);
 
@@ -1233,29 +1967,14 @@ game_scene_play(const char *key)
 
 	log_info_f("%s %s", i18n_scene_play, current_scene->name);
 
-	// Mark scene as visited
-	if (!scene->visited)
-	{
-		scene->visited = TRUE;
-		game_stats->scenes_visited++;
-	}
-
-	// Mark room as visited
-	if ((room = hashmap_get(game_rooms, scene->room)) == NULL)
-	{
-		log_error_f("%s: %s", i18n_room_notfound, scene->room);
-		quit_error(PROOMNOTFOUND);
-	}
+	// Mark scene and room as visited
+	room = scene->location;
 
-	if (!room->visited)
-	{
-		room->mentioned = TRUE;
-		room->visited = TRUE;
-		game_stats->rooms_visited++;
-	}
+	game_state_set(scene->id, GAME_VISITED);
+	game_state_set(room->id, GAME_VISITED);
 
 	// Set statusbar
-	curses_status("%s: %i/%i || %s: %s", i18n_scene, game_stats->scenes_visited,
+	curses_status("%s: %i/%i || %s: %s", i18n_scene, game_state_count(GAME_SCENE, GAME_VISITED),
 				  game_stats->scenes_total, i18n_room, room->descr);
 
 	// Set prompt
@@ -1275,7 +1994,7 @@ game_scene_play(const char *key)
 	}
 
 	// Print description
-	game_print_description(scene->words);
+	game_print_description(&scene->text);
 }
 
 // --------
@@ -1287,18 +2006,25 @@ game_scene_play(const char *key)
  *********************************************************************/
 
 void
-game_init(const char *file)
+game_init(const char *file, const char *homedir)
 {
+	boolean lazy;
+
 	assert(file);
 
 	log_info(i18n_game_init);
 
+	// Before the parser starts its threads
+	scan_init();
+
+	if (!game_arena)
+	{
+		game_arena = arena_create(ARENABLOCK);
+	}
+
 	if (!game_header)
 	{
-		if ((game_header = calloc(1, sizeof(game_header_s))) == NULL)
-		{
-			quit_error(POUTOFMEM);
-		}
+		game_header = arena_alloc(game_arena, sizeof(game_header_s));
 	}
 
 	if (!game_stats)
@@ -1309,64 +2035,118 @@ game_init(const char *file)
 		}
 	}
 
-	if (!game_glossary)
+	// Compiled images bring everything with them
+	if (image_load(file) || (homedir && image_cache_load(file, homedir)))
+	{
+		game_first_resolve();
+		game_state_create();
+
+		return;
+	}
+
+	if (!game_words)
 	{
-		game_glossary = hashmap_create(128);
+		game_words = dict_create(game_arena);
 	}
 
-	if (!game_rooms)
+	if (!game_symbols)
 	{
-		game_rooms = hashmap_create(128);
+		game_symbols = hashmap_create(384);
 	}
 
-	if (!game_scenes)
+	if (!game_names)
 	{
-		game_scenes = hashmap_create(128);
+		game_names = strpool_create(game_arena);
 	}
 
-	parser_game(file);
+	lazy = parser_game(file, homedir != NULL);
+	game_first_resolve();
+	game_scenes_resolve();
+	game_state_create();
+
+	// Bodies loaded on demand can't be cached
+	if (!lazy)
+	{
+		game_texts_resolve();
+
+		if (homedir)
+		{
+			image_cache_write();
+		}
+	}
 }
 
 void
 game_quit(void)
 {
+	uint8_t i;
+	uint8_t j;
+
 	log_info(i18n_game_quit);
 
-	if (game_header)
+	// The cache writer still reads the game data
+	image_cache_wait();
+
+	if (game_stats)
 	{
-		free((char *)game_header->game);
-		free((char *)game_header->author);
-		free((char *)game_header->date);
-		free((char *)game_header->uid);
-		free((char *)game_header->first_scene);
+		free(game_stats);
+		game_stats = NULL;
+	}
 
-		if (game_header->prompt)
-		{
-			free((char *)game_header->prompt);
-		}
+	if (game_symbols)
+	{
+		hashmap_destroy(game_symbols, game_destroy_callback);
+		game_symbols = NULL;
+	}
 
-		free(game_header);
-		game_header = NULL;
+	if (game_names)
+	{
+		strpool_destroy(game_names);
+		game_names = NULL;
 	}
 
-	if (game_stats)
+	for (i = 0; i < GAME_KINDS; i++)
 	{
-		free(game_stats);
-		game_stats = NULL;
+		free(game_objects[i].objects);
+		memset(&game_objects[i], 0, sizeof(game_objects_s));
+
+		for (j = 0; j < GAME_STATES; j++)
+		{
+			if (game_state[i][j])
+			{
+				bitset_destroy(game_state[i][j]);
+				game_state[i][j] = NULL;
+			}
+		}
 	}
 
-	if (game_glossary)
+	free(undo.entries);
+	memset(&undo, 0, sizeof(undo));
+
+	while (bodies.oldest)
 	{
-		hashmap_destroy(game_glossary, game_glossary_destroy_callback);
+		game_text_evict();
 	}
 
-	if (game_rooms)
+	if (game_words)
 	{
-		hashmap_destroy(game_rooms, game_room_destroy_callback);
+		dict_destroy(game_words);
+		game_words = NULL;
 	}
 
-	if (game_scenes)
+	// Releases all objects in one go
+	if (game_arena)
 	{
-		hashmap_destroy(game_scenes, game_scene_destroy_callback);
+		log_info_f("%s: %zu/%zu", i18n_game_memory, game_arena->used, game_arena->reserved);
+
+		arena_destroy(game_arena);
+		game_arena = NULL;
+		game_header = NULL;
+		current_scene = NULL;
+		first_scene = NULL;
 	}
+
+	// Must be last, everything points into it
+	image_close();
+	parser_close();
 }
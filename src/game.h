@@ -14,10 +14,15 @@
 
 // --------
 
+#include "curses.h"
 #include "main.h"
 
+#include "data/arena.h"
+#include "data/bitset.h"
+#include "data/dict.h"
 #include "data/hashmap.h"
 #include "data/list.h"
+#include "data/strpool.h"
 
 // --------
 
@@ -37,67 +42,227 @@ typedef struct
 // Parsed game header
 extern game_header_s *game_header;
 
+// Holds everything produced by the parser
+extern arena *game_arena;
+
+/*
+ * Kinds of objects, in the order links are
+ * matched against them.
+ */
+enum
+{
+	GAME_GLOSSARY,
+	GAME_ROOM,
+	GAME_SCENE,
+	GAME_KINDS
+};
+
+/*
+ * Typed ID of an object. The upper 2 bits are
+ * the kind plus 1, the lower 30 bits the index
+ * into 'game_objects'. 0 is no object.
+ */
+typedef uint32_t game_id;
+
+#define GAME_ID(kind, index) ((game_id)((kind) + 1) << 30 | (index))
+#define GAME_ID_KIND(id) (((id) >> 30) - 1)
+#define GAME_ID_INDEX(id) ((id) & 0x3fffffff)
+
+/*
+ * Entry of the symbol table. Objects of different
+ * kinds may have the same name, so there's an ID
+ * for each kind. The first object defined with a
+ * name wins.
+ */
+typedef struct
+{
+	game_id ids[GAME_KINDS];
+} game_symbol_s;
+
+// Maps all names and aliases to their symbol
+extern hashmap *game_symbols;
+
+/*
+ * Names, aliases and other strings of all
+ * objects. They're interned, so each string
+ * is stored once and its hash is kept in
+ * front of it. Strings from a compiled image
+ * are interned by the image itself, in that
+ * case there's no pool.
+ */
+extern strpool *game_names;
+
+/*
+ * All objects of one kind, in the order they
+ * were defined.
+ */
+typedef struct
+{
+	void **objects;
+	uint32_t count;
+	uint32_t size;
+} game_objects_s;
+
+// Objects of each kind
+extern game_objects_s game_objects[GAME_KINDS];
+
+/*
+ * States an object can be in.
+ */
+enum
+{
+	GAME_MENTIONED,
+	GAME_VISITED,
+	GAME_STATES
+};
+
+/*
+ * Runtime state of all objects. There's one
+ * set for each kind and state, bit i is the
+ * object with index i. Visited rooms are
+ * always mentioned, too.
+ */
+extern bitset *game_state[GAME_KINDS][GAME_STATES];
+
+/*
+ * Kinds of links.
+ */
+enum
+{
+	// Matched an object
+	GAME_LINK_GLOSSARY = GAME_GLOSSARY,
+	GAME_LINK_ROOM = GAME_ROOM,
+	GAME_LINK_SCENE = GAME_SCENE,
+
+	// Matched nothing
+	GAME_LINK_NONE,
+
+	// Broken by a paragraph end, printed as is
+	GAME_LINK_BROKEN,
+
+	// Still open at the end, not printed at all
+	GAME_LINK_OPEN
+};
+
+/*
+ * A link in a description. The words from 'first'
+ * to 'last' make up the link, they're printed as
+ * 'text' followed by 'suffix'. Links are resolved
+ * once, so printing them needs no lookups.
+ */
+typedef struct
+{
+	uint32_t first;
+	uint32_t last;
+	uint8_t kind;
+	char suffix[2];
+	const char *text;
+	void *target;
+} game_link_s;
+
+/*
+ * Long description of an object. The words are
+ * stored as IDs into 'game_words'. If all IDs
+ * fit into 16 bit, 16 bit are used. Otherwise
+ * 32 bit. A paragraph is ended by a "\n" word.
+ *
+ * When the description is printed for the first
+ * time it's compiled into a stream of colored
+ * text runs, printing it again just hands them
+ * to the renderer.
+ *
+ * Bodies of very big game files are loaded on
+ * demand. Until then 'ids' is NULL and 'body'
+ * points into the game file. Loaded bodies are
+ * kept in a LRU list.
+ */
+typedef struct game_text
+{
+	const void *ids;
+	uint32_t words;
+	boolean wide;
+
+	// Links, in order
+	const game_link_s *links;
+	uint32_t link_count;
+	boolean resolved;
+
+	// Text runs, NULL until compiled
+	const curses_op_s *ops;
+	uint32_t op_count;
+	size_t ops_size;
+
+	// Body in the game file
+	const char *body;
+	size_t length;
+
+	// Neighbours in the LRU list
+	struct game_text *newer;
+	struct game_text *older;
+} game_text_s;
+
+// All words used in descriptions
+extern dict *game_words;
+
 /*
  * Represents one glossary entry.
  */
 typedef struct
 {
-	boolean mentioned;
+	game_id id;
 	const char *descr;
 	const char *name;
 	list *aliases;
-	list *words;
+	game_text_s text;
 } game_glossary_s;
 
-// Glossary
-extern hashmap *game_glossary;
-
 /*
  * Represents one room.
  */
 typedef struct
 {
-	boolean mentioned;
-	boolean visited;
+	game_id id;
 	const char *descr;
 	const char *name;
 	list *aliases;
-	list *words;
+	game_text_s text;
 } game_room_s;
 
-// Rooms
-extern hashmap *game_rooms;
-
 /*
- * Represents one scene.
+ * Represents one scene. 'room' and 'next' are
+ * resolved when the game is loaded, 'location'
+ * and 'targets' point to the objects. A target
+ * of NULL is END.
  */
-typedef struct
+typedef struct game_scene
 {
-	boolean visited;
+	game_id id;
 	const char *descr;
 	const char *name;
 	const char *prompt;
 	const char *room;
-	darray *next;
+	const char *next[CHOICES];
+	uint8_t next_count;
 	list *aliases;
-	list *words;
+	game_text_s text;
+
+	// Resolved references
+	game_room_s *location;
+	struct game_scene *targets[CHOICES];
 } game_scene_s;
 
-// Scenes
-extern hashmap *game_scenes;
+// Scene being played
 extern game_scene_s *current_scene;
 
 /*
- * Statistics.
+ * Statistics. Only the totals are kept, the
+ * other numbers are counted from 'game_state'.
  */
 typedef struct
 {
 	uint32_t glossary_total;
-	uint32_t glossary_mentioned;
 	uint32_t rooms_total;
-	uint32_t rooms_visited;
 	uint32_t scenes_total;
-	uint32_t scenes_visited;
 } game_stats_s;
 
 // Global statistics struct
@@ -121,9 +286,63 @@ void game_glossary_list(void);
 void game_glossary_print(const char *key);
 
 /*
- * Initializes the game.
+ * Adds an object to the objects of its kind
+ * and returns its ID. The object isn't bound
+ * to any name.
+ *
+ * kind: Kind of the object
+ * object: Object to add
+ */
+game_id game_object_add(uint8_t kind, void *object);
+
+/*
+ * Returns the object with the given ID.
+ *
+ * id: ID of the object, mustn't be 0
+ */
+void *game_object_get(game_id id);
+
+/*
+ * Binds a name or alias to an object. If the
+ * name is already bound to an object of the
+ * same kind, the old binding is kept.
+ *
+ * name: Interned name to bind
+ * id: ID of the object
+ */
+void game_symbol_add(const char *name, game_id id);
+
+/*
+ * Like game_symbol_get(), but for interned
+ * names. Their hash isn't computed again.
+ *
+ * name: Interned name to look up
+ * kind: Kind of the object
  */
-void game_init(const char *file);
+game_id game_symbol_find(const char *name, uint8_t kind);
+
+/*
+ * Looks a name or alias up. Returns the ID of
+ * the object of the given kind or 0, if there's
+ * none.
+ *
+ * name: Name to look up
+ * kind: Kind of the object
+ */
+game_id game_symbol_get(const char *name, uint8_t kind);
+
+/*
+ * Initializes the game. If a home directory
+ * is given, compiled images of the game file
+ * are cached below it and bodies of very big
+ * game files are loaded on demand. Without it
+ * everything is loaded at once, like needed to
+ * write an image.
+ *
+ * file: Game file or compiled image
+ * homedir: Home directory, may be NULL
+ */
+void game_init(const char *file, const char *homedir);
 
 /*
  * Shuts the game down.
@@ -140,6 +359,17 @@ void game_room_describe(const char *key);
  */
 void game_rooms_list(void);
 
+/*
+ * Goes back the given number of choices.
+ * Scene, end flag and all states set since
+ * then are restored. Returns the number of
+ * choices undone, older ones may have been
+ * dropped to stay within UNDOSIZE.
+ *
+ * steps: Choices to undo
+ */
+uint32_t game_scene_back(uint32_t steps);
+
 /*
  * Advances to the next scene. Either by
  * users choice or to the only one. When
@@ -160,6 +390,47 @@ void game_scene_play(const char *key);
  */
 void game_scene_list(void);
 
+/*
+ * Takes an object out of a state. Returns
+ * true if it was in it.
+ *
+ * id: ID of the object
+ * state: State to leave
+ */
+boolean game_state_clear(game_id id, uint8_t state);
+
+/*
+ * Returns the number of objects of a kind
+ * in a state.
+ *
+ * kind: Kind of the objects
+ * state: State to count
+ */
+uint32_t game_state_count(uint8_t kind, uint8_t state);
+
+/*
+ * Returns if an object is in a state.
+ *
+ * id: ID of the object
+ * state: State to check
+ */
+boolean game_state_get(game_id id, uint8_t state);
+
+/*
+ * Resets all objects into their initial
+ * state, as if the game was just loaded.
+ */
+void game_state_reset(void);
+
+/*
+ * Puts an object into a state. Returns TRUE
+ * if it wasn't in that state before.
+ *
+ * id: ID of the object
+ * state: State to set
+ */
+boolean game_state_set(game_id id, uint8_t state);
+
 // --------
 
 #endif // GAME_H_
@@ -22,7 +22,9 @@ const char *i18n_scene = "Scene";
 
 // Table headers
 const char *i18n_head_attribute = "Attribute";
+const char *i18n_head_date = "Date";
 const char *i18n_head_description = "Description";
+const char *i18n_head_progress = "Progress";
 const char *i18n_head_saves = "Saves";
 const char *i18n_head_state = "State";
 const char *i18n_head_value = "Value";
@@ -63,6 +65,8 @@ const char *i18n_room_roomslisted = "Rooms listed";
 // ---------
 
 // Scene
+const char *i18n_scene_back = "Choices undone";
+const char *i18n_scene_backinvalid = "Back needs a positive number of steps";
 const char *i18n_scene_choice = "Make your choice";
 const char *i18n_scene_firstnotfound = "First scene doesn't exists";
 const char *i18n_scene_invalidchoice = "Invalid choice";
@@ -70,6 +74,7 @@ const char *i18n_scene_listed = "Scenes listed";
 const char *i18n_scene_next = "Advancing to the next scene";
 const char *i18n_scene_nochoice = "No choice possible";
 const char *i18n_scene_notfound = "No such scene";
+const char *i18n_scene_nothingtoundo = "Nothing to go back to";
 const char *i18n_scene_play = "Playing scene";
 const char *i18n_scene_playerschoice = "Player's choice";
 
@@ -115,6 +120,11 @@ const char *i18n_version_thisis = "This is";
 
 // ---------
 
+// 'back' Command
+const char *i18n_cmdback = "back";
+const char *i18n_cmdbackhelp = "Goes back one or more choices";
+const char *i18n_cmdbackshort = "b";
+
 // 'glossary' Command
 const char *i18n_cmdglossary = "glossary";
 const char *i18n_cmdglossaryhelp = "Prints a glossay entry or a list of all entries";
@@ -170,16 +180,32 @@ const char *i18n_cmdversionshort = "v";
 // Game
 const char *i18n_game_end = "Game has ended";
 const char *i18n_game_init = "Initializing game";
+const char *i18n_game_memory = "Memory used by game data (bytes used/reserved)";
 const char *i18n_game_quit = "Shutting down game";
 const char *i18n_game_start = "Game has started";
 
 // ---------
 
+// Compiled images
+const char *i18n_image_cachebroken = "Cached game image is broken, removed";
+const char *i18n_image_cachefailed = "Couldn't write cached game image";
+const char *i18n_image_cacheloading = "Loading cached game image";
+const char *i18n_image_cachewritten = "Cached game image written";
+const char *i18n_image_loading = "Loading compiled game image";
+const char *i18n_image_writing = "Writing compiled game image";
+
+// ---------
+
 // Parser
+const char *i18n_parser_changed = "Game file was changed while being played";
+const char *i18n_parser_chunks = "Chunks parsed in parallel";
+const char *i18n_parser_dictionary = "Distinct words in dictionary";
 const char *i18n_parser_error = "Parser error in line";
 const char *i18n_parser_gamespecs = "Game specifications are";
 const char *i18n_parser_glossaryentry = "Glossary entry";
 const char *i18n_parser_glossarytwice = "There's already a glossary entry with name or alias";
+const char *i18n_parser_kernel = "Scanning kernel";
+const char *i18n_parser_lazy = "Bodies are loaded on demand";
 const char *i18n_parser_linesparsed = "Lines parsed";
 const char *i18n_parser_parsingfile = "Parsing game file";
 const char *i18n_parser_roomtwice = "There's already a room with name or alias";
@@ -188,10 +214,16 @@ const char *i18n_parser_scenetwice = "There's already a scene with name or alias
 // ---------
 
 // Savegames
+const char *i18n_save_failed = "Couldn't save game";
 const char *i18n_save_filedoesnexists = "Savegame doesn't exists";
 const char *i18n_save_fromanothergame = "Savegame from another game";
+const char *i18n_save_fromanotherversion = "Savegame from another version of the game";
 const char *i18n_save_init = "Initializing savegames";
 const char *i18n_save_listedsaves = "Savegames listed";
+const char *i18n_save_namereserved = "Name is reserved for the engine";
+const char *i18n_save_nametoolong = "Name of the savegame is too long";
+const char *i18n_save_unsupported = "Savegame from another version of the engine";
+const char *i18n_save_written = "Game saved";
 
 // ---------
 
@@ -210,6 +242,8 @@ const char *i18n_info_uid = "UID";
 // ---------
 
 // Errorcodes
+const char *i18n_error_brokengame = "Game file doesn't match the parsed game";
+const char *i18n_error_brokenimage = "Compiled game image is broken";
 const char *i18n_error_brokensave = "Savegame is broken";
 const char *i18n_error_couldntclosefile = "Couldn't close file";
 const char *i18n_error_couldntcreatedir = "Couldn't create directory";
@@ -219,6 +253,7 @@ const char *i18n_error_couldntopendir = "Couldn't open directory";
 const char *i18n_error_couldntopenfile = "Couldn't open file";
 const char *i18n_error_couldntrotatelogs = "Couldn't rotate logs";
 const char *i18n_error_couldntsavehistory = "Couldn't save history";
+const char *i18n_error_couldntwriteimage = "Couldn't write compiled game image";
 const char *i18n_error_couldntwritelogmsg = "Couldn't write log message";
 const char *i18n_error_filenotexist = "File doesn't exist";
 const char *i18n_error_firstscenenotfound = "First scene not found";
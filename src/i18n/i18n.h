@@ -24,7 +24,9 @@ extern const char *i18n_scene;
 
 // Table headers
 extern const char *i18n_head_attribute;
+extern const char *i18n_head_date;
 extern const char *i18n_head_description;
+extern const char *i18n_head_progress;
 extern const char *i18n_head_saves;
 extern const char *i18n_head_state;
 extern const char *i18n_head_value;
@@ -65,6 +67,8 @@ extern const char *i18n_room_roomslisted;
 // ---------
 
 // Scene
+extern const char *i18n_scene_back;
+extern const char *i18n_scene_backinvalid;
 extern const char *i18n_scene_choice;
 extern const char *i18n_scene_firstnotfound;
 extern const char *i18n_scene_invalidchoice;
@@ -72,6 +76,7 @@ extern const char *i18n_scene_listed;
 extern const char *i18n_scene_next;
 extern const char *i18n_scene_nochoice;
 extern const char *i18n_scene_notfound;
+extern const char *i18n_scene_nothingtoundo;
 extern const char *i18n_scene_play;
 extern const char *i18n_scene_playerschoice;
 
@@ -117,6 +122,11 @@ extern const char *i18n_version_thisis;
 
 // ---------
 
+// 'back' Command
+extern const char *i18n_cmdback;
+extern const char *i18n_cmdbackhelp;
+extern const char *i18n_cmdbackshort;
+
 // 'glossary' Command
 extern const char *i18n_cmdglossary;
 extern const char *i18n_cmdglossaryhelp;
@@ -172,16 +182,32 @@ extern const char *i18n_cmdversionshort;
 // Game
 extern const char *i18n_game_end;
 extern const char *i18n_game_init;
+extern const char *i18n_game_memory;
 extern const char *i18n_game_quit;
 extern const char *i18n_game_start;
 
 // ---------
 
+// Compiled images
+extern const char *i18n_image_cachebroken;
+extern const char *i18n_image_cachefailed;
+extern const char *i18n_image_cacheloading;
+extern const char *i18n_image_cachewritten;
+extern const char *i18n_image_loading;
+extern const char *i18n_image_writing;
+
+// ---------
+
 // Parser
+extern const char *i18n_parser_changed;
+extern const char *i18n_parser_chunks;
+extern const char *i18n_parser_dictionary;
 extern const char *i18n_parser_error;
 extern const char *i18n_parser_gamespecs;
 extern const char *i18n_parser_glossaryentry;
 extern const char *i18n_parser_glossarytwice;
+extern const char *i18n_parser_kernel;
+extern const char *i18n_parser_lazy;
 extern const char *i18n_parser_linesparsed;
 extern const char *i18n_parser_parsingfile;
 extern const char *i18n_parser_roomtwice;
@@ -190,10 +216,16 @@ extern const char *i18n_parser_scenetwice;
 // ---------
 
 // Savegames
+extern const char *i18n_save_failed;
 extern const char *i18n_save_filedoesnexists;
 extern const char *i18n_save_fromanothergame;
+extern const char *i18n_save_fromanotherversion;
 extern const char *i18n_save_init;
 extern const char *i18n_save_listedsaves;
+extern const char *i18n_save_namereserved;
+extern const char *i18n_save_nametoolong;
+extern const char *i18n_save_unsupported;
+extern const char *i18n_save_written;
 
 // ---------
 
@@ -212,6 +244,8 @@ extern const char *i18n_info_uid;
 // --------
 
 // Errorcodes
+extern const char *i18n_error_brokengame;
+extern const char *i18n_error_brokenimage;
 extern const char *i18n_error_brokensave;
 extern const char *i18n_error_couldntclosefile;
 extern const char *i18n_error_couldntcreatedir;
@@ -221,6 +255,7 @@ extern const char *i18n_error_couldntopendir;
 extern const char *i18n_error_couldntopenfile;
 extern const char *i18n_error_couldntrotatelogs;
 extern const char *i18n_error_couldntsavehistory;
+extern const char *i18n_error_couldntwriteimage;
 extern const char *i18n_error_couldntwritelogmsg;
 extern const char *i18n_error_filenotexist;
 extern const char *i18n_error_firstscenenotfound;
@@ -0,0 +1,1743 @@
+/*
+ * image.c
+ * -------
+ *
+ * Reading and writing of compiled game images.
+ *
+ * An image starts with a fixed header, followed by
+ * the sections and the string table. Sections are
+ * referenced by their offset from the start of the
+ * image, strings by their offset into the string
+ * table. String offset 0 is NULL. Each string is
+ * preceded by its hashmap_hash(), like the strings
+ * of a 'strpool', so the names can be used as
+ * interned strings. Everything is aligned to 4
+ * bytes. For each of the glossary,
+ * rooms and scenes there's a table of objects.
+ * All names and aliases are in one symbol table,
+ * which control bytes, slots and symbols are used
+ * directly from the mapped file.
+ *
+ * References between the objects are stored
+ * resolved, the rooms and choices of the scenes
+ * and the links of the descriptions as object
+ * IDs. So they're not looked up again at load.
+ */
+
+#define LOG_MODULE LOG_GAME
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "game.h"
+#include "image.h"
+#include "log.h"
+#include "misc.h"
+#include "quit.h"
+
+#include "i18n/i18n.h"
+
+// --------
+
+// Magic bytes at the start of an image
+#define IMAGE_MAGIC "TOUKATKB"
+
+// Must be bumped when the format or hashmap_hash() changes
+#define IMAGE_VERSION 5
+
+// Detects images with another byte order
+#define IMAGE_ENDIAN 0x01020304
+
+// Suffix of cached images
+#define IMAGE_SUFFIX ".tkb"
+
+/*
+ * One node of the symbol table.
+ */
+typedef struct
+{
+	uint32_t key;
+	uint32_t hash;
+} image_node;
+
+/*
+ * A resolved link of a description.
+ */
+typedef struct
+{
+	uint32_t first;
+	uint32_t last;
+	uint32_t text;
+	game_id target;
+	uint8_t kind;
+	char suffix[2];
+} image_link;
+
+/*
+ * A glossary entry, room or scene. Unused
+ * fields are 0.
+ */
+typedef struct
+{
+	uint32_t name;
+	uint32_t descr;
+	uint32_t prompt;
+	uint32_t room;
+
+	// Index into the alias table
+	uint32_t aliases;
+	uint32_t alias_count;
+
+	// Offset of the word IDs
+	uint32_t text;
+	uint32_t words;
+	uint32_t wide;
+
+	uint32_t next[CHOICES];
+	uint32_t next_count;
+
+	// Resolved references, 0 is END
+	game_id location;
+	game_id targets[CHOICES];
+
+	// Offset of the resolved links
+	uint32_t links;
+	uint32_t link_count;
+} image_object;
+
+/*
+ * The objects of one kind.
+ */
+typedef struct
+{
+	uint32_t objects;
+	uint32_t objtab;
+} image_table;
+
+/*
+ * The symbol table. There's one symbol
+ * for each node, in the same order.
+ */
+typedef struct
+{
+	uint32_t capacity;
+	uint32_t elements;
+	uint32_t ctrl;
+	uint32_t slots;
+	uint32_t nodes;
+	uint32_t symtab;
+} image_symbols;
+
+/*
+ * Header of an image.
+ */
+typedef struct
+{
+	char magic[8];
+
+	// Game file the image was created from, 0 if unknown
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint64_t source_hash;
+
+	uint32_t version;
+	uint32_t endian;
+	uint32_t size;
+
+	// Game header
+	uint32_t author;
+	uint32_t date;
+	uint32_t first_scene;
+	uint32_t game;
+	uint32_t prompt;
+	uint32_t uid;
+
+	// Dictionary, one string offset per word
+	uint32_t words;
+	uint32_t wordtab;
+
+	// String offsets of all aliases
+	uint32_t aliases;
+	uint32_t aliastab;
+
+	image_table tables[GAME_KINDS];
+	image_symbols symbols;
+
+	uint32_t strings;
+	uint32_t strings_size;
+} image_header;
+
+/*
+ * A growing output buffer.
+ */
+typedef struct
+{
+	char *buf;
+	size_t len;
+	size_t size;
+} image_buffer;
+
+// --------
+
+// The mapped image
+static const char *image;
+static size_t image_size;
+
+// String table of the mapped image
+static const char *strtab;
+static uint32_t strtab_size;
+
+// Game file of the current game
+static struct
+{
+	uint64_t size;
+	int64_t mtime;
+	uint64_t hash;
+} source;
+
+// Cache entry of the current game
+static struct
+{
+	char dir[PATH_MAX];
+	char path[PATH_MAX];
+	pthread_t writer;
+	boolean writing;
+} cache;
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                       Callback Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Callback for hashmap_destroy(). The data are
+ * offsets, so there's nothing to free.
+ */
+static void
+image_destroy_callback(void *data)
+{
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                        Support Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Appends data to an output buffer. If data is
+ * NULL, the space is filled with zeros. Returns
+ * the offset of the data.
+ *
+ * out: Buffer to append to
+ * data: Data to append
+ * len: Length of the data
+ * align: Alignment, must be a power of two
+ */
+static uint32_t
+image_append(image_buffer *out, const void *data, size_t len, size_t align)
+{
+	size_t offset;
+
+	assert(out);
+	assert(!(align & (align - 1)));
+
+	offset = (out->len + align - 1) & ~(align - 1);
+
+	// Everything is adressed by 32 bit offsets
+	if (offset + len > UINT32_MAX)
+	{
+		quit_error(PCOULDNTWRITEIMAGE);
+	}
+
+	if (offset + len > out->size)
+	{
+		while (offset + len > out->size)
+		{
+			out->size = out->size ? out->size * 2 : 65536;
+		}
+
+		if ((out->buf = realloc(out->buf, out->size)) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
+	}
+
+	memset(out->buf + out->len, 0, offset - out->len);
+
+	if (data)
+	{
+		memcpy(out->buf + offset, data, len);
+	}
+	else
+	{
+		memset(out->buf + offset, 0, len);
+	}
+
+	out->len = offset + len;
+
+	return offset;
+}
+
+/*
+ * Adds a string to the string table and returns
+ * its offset. Each distinct string is stored once,
+ * behind its hash. The offset points to the string.
+ *
+ * strings: The string table
+ * known: Maps strings to their offset
+ * str: String to add, may be NULL
+ */
+static uint32_t
+image_string_add(image_buffer *strings, hashmap *known, const char *str)
+{
+	size_t len;
+	uint32_t hash;
+	uintptr_t offset;
+
+	if (!str)
+	{
+		return 0;
+	}
+
+	// Offset 0 is NULL, so there's no need to add 1
+	if ((offset = (uintptr_t)hashmap_get(known, str)) != 0)
+	{
+		return offset;
+	}
+
+	// The hash must be aligned, the string follows it
+	len = strlen(str);
+	hash = hashmap_hash(str, len);
+	offset = image_append(strings, &hash, sizeof(hash), 4) + sizeof(hash);
+	image_append(strings, str, len + 1, 1);
+
+	hashmap_add(known, str, (void *)offset);
+
+	return offset;
+}
+
+/*
+ * Writes the resolved links of a description
+ * into the image and returns their offset.
+ *
+ * out: Image to write into
+ * strings: The string table
+ * known: Strings already in the string table
+ * text: Description with the links
+ */
+static uint32_t
+image_write_links(image_buffer *out, image_buffer *strings, hashmap *known,
+		const game_text_s *text)
+{
+	image_link *link;
+	uint32_t i;
+	uint32_t offset;
+	const game_link_s *src;
+
+	assert(out);
+	assert(text->resolved);
+
+	offset = image_append(out, NULL, text->link_count * sizeof(image_link), 4);
+
+	for (i = 0; i < text->link_count; i++)
+	{
+		src = &text->links[i];
+		link = (image_link *)(out->buf + offset) + i;
+		link->first = src->first;
+		link->last = src->last;
+		link->text = image_string_add(strings, known, src->text);
+		link->kind = src->kind;
+		memcpy(link->suffix, src->suffix, sizeof(link->suffix));
+
+		switch (src->kind)
+		{
+			case GAME_LINK_GLOSSARY:
+				link->target = ((game_glossary_s *)src->target)->id;
+				break;
+
+			case GAME_LINK_ROOM:
+				link->target = ((game_room_s *)src->target)->id;
+				break;
+
+			case GAME_LINK_SCENE:
+				link->target = ((game_scene_s *)src->target)->id;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return offset;
+}
+
+/*
+ * Writes the objects of one kind into the image.
+ *
+ * out: Image to write into
+ * strings: The string table
+ * known: Strings already in the string table
+ * aliases: Alias table
+ * dst: Description of the table for the header
+ * kind: Which kind of objects to write
+ */
+static void
+image_write_table(image_buffer *out, image_buffer *strings, hashmap *known,
+		image_buffer *aliases, image_table *dst, uint8_t kind)
+{
+	game_glossary_s *glossary;
+	game_room_s *room;
+	game_scene_s *scene;
+	image_object *obj;
+	list *alist;
+	listnode *lnode;
+	uint32_t alias;
+	uint32_t i;
+	uint32_t j;
+	const game_text_s *text;
+
+	assert(out);
+	assert(dst);
+
+	dst->objects = game_objects[kind].count;
+	dst->objtab = image_append(out, NULL, dst->objects * sizeof(image_object), 4);
+
+	for (i = 0; i < dst->objects; i++)
+	{
+		obj = (image_object *)(out->buf + dst->objtab) + i;
+		alist = NULL;
+		text = NULL;
+
+		switch (kind)
+		{
+			case GAME_GLOSSARY:
+				glossary = game_objects[kind].objects[i];
+				obj->name = image_string_add(strings, known, glossary->name);
+				obj->descr = image_string_add(strings, known, glossary->descr);
+				alist = glossary->aliases;
+				text = &glossary->text;
+				break;
+
+			case GAME_ROOM:
+				room = game_objects[kind].objects[i];
+				obj->name = image_string_add(strings, known, room->name);
+				obj->descr = image_string_add(strings, known, room->descr);
+				alist = room->aliases;
+				text = &room->text;
+				break;
+
+			default:
+				scene = game_objects[kind].objects[i];
+				obj->name = image_string_add(strings, known, scene->name);
+				obj->descr = image_string_add(strings, known, scene->descr);
+				obj->prompt = image_string_add(strings, known, scene->prompt);
+				obj->room = image_string_add(strings, known, scene->room);
+
+				for (j = 0; j < scene->next_count; j++)
+				{
+					obj->next[j] = image_string_add(strings, known, scene->next[j]);
+					obj->targets[j] = scene->targets[j] ? scene->targets[j]->id : 0;
+				}
+
+				obj->next_count = scene->next_count;
+				obj->location = scene->location->id;
+				alist = scene->aliases;
+				text = &scene->text;
+				break;
+		}
+
+		if (alist)
+		{
+			obj->aliases = aliases->len / sizeof(uint32_t);
+			obj->alias_count = alist->count;
+
+			for (lnode = alist->first; lnode; lnode = lnode->next)
+			{
+				alias = image_string_add(strings, known, lnode->data);
+				image_append(aliases, &alias, sizeof(alias), 4);
+			}
+		}
+
+		obj->words = text->words;
+		obj->wide = text->wide;
+
+		// Appending may move the buffer
+		j = image_append(out, text->ids, text->words
+				* (text->wide ? sizeof(uint32_t) : sizeof(uint16_t)), 4);
+
+		obj = (image_object *)(out->buf + dst->objtab) + i;
+		obj->text = j;
+
+		j = image_write_links(out, strings, known, text);
+
+		obj = (image_object *)(out->buf + dst->objtab) + i;
+		obj->links = j;
+		obj->link_count = text->link_count;
+	}
+}
+
+/*
+ * Writes the symbol table into the image.
+ *
+ * out: Image to write into
+ * strings: The string table
+ * known: Strings already in the string table
+ * dst: Description of the table for the header
+ */
+static void
+image_write_symbols(image_buffer *out, image_buffer *strings, hashmap *known,
+		image_symbols *dst)
+{
+	image_node *node;
+	hashmap *map;
+	uint32_t i;
+
+	assert(out);
+	assert(dst);
+
+	map = game_symbols;
+
+	// The slots are taken as they are
+	dst->capacity = map->capacity;
+	dst->elements = map->elements;
+	dst->ctrl = image_append(out, map->ctrl, map->capacity, 4);
+	dst->slots = image_append(out, map->slots, map->capacity * sizeof(uint32_t), 4);
+	dst->nodes = image_append(out, NULL, map->elements * sizeof(image_node), 4);
+	dst->symtab = image_append(out, NULL, map->elements * sizeof(game_symbol_s), 4);
+
+	for (i = 0; i < map->elements; i++)
+	{
+		node = (image_node *)(out->buf + dst->nodes) + i;
+		node->key = image_string_add(strings, known, map->nodes[i].key);
+		node->hash = map->nodes[i].hash;
+
+		memcpy(out->buf + dst->symtab + i * sizeof(game_symbol_s),
+				map->nodes[i].data, sizeof(game_symbol_s));
+	}
+}
+
+/*
+ * Checks if a section is aligned and completely
+ * inside the mapped image.
+ *
+ * offset: Offset of the section
+ * count: Number of elements
+ * size: Size of one element
+ */
+static boolean
+image_section_valid(uint32_t offset, uint32_t count, size_t size)
+{
+	return !(offset & 3) && (uint64_t)offset + (uint64_t)count * size <= image_size;
+}
+
+/*
+ * Returns a pointer to a section of the mapped
+ * image. The image must be verified before.
+ *
+ * offset: Offset of the section
+ * count: Number of elements
+ * size: Size of one element
+ */
+static const void
+*image_section(uint32_t offset, uint32_t count, size_t size)
+{
+	assert(image_section_valid(offset, count, size));
+
+	return image + offset;
+}
+
+/*
+ * Checks if a string offset points to a string
+ * of the string table. 0 is NULL and valid.
+ *
+ * offset: Offset into the string table
+ */
+static boolean
+image_string_valid(uint32_t offset)
+{
+	if (!offset)
+	{
+		return TRUE;
+	}
+
+	// Each string is behind its aligned hash
+	return offset < strtab_size && offset >= sizeof(uint32_t) && !(offset % sizeof(uint32_t));
+}
+
+/*
+ * Returns a string of the mapped image. The
+ * image must be verified before.
+ *
+ * offset: Offset into the string table
+ */
+static const char
+*image_string(uint32_t offset)
+{
+	assert(image_string_valid(offset));
+
+	return offset ? strtab + offset : NULL;
+}
+
+/*
+ * Checks if an ID is one of the objects of a
+ * kind in the image.
+ *
+ * header: Header of the image
+ * id: ID to check
+ * kind: Kind the object must have
+ */
+static boolean
+image_id_valid(const image_header *header, game_id id, uint8_t kind)
+{
+	return GAME_ID_KIND(id) == kind && GAME_ID_INDEX(id) < header->tables[kind].objects;
+}
+
+/*
+ * Checks the description of an object, its word
+ * IDs and its links.
+ *
+ * header: Header of the image
+ * obj: Object with the description
+ */
+static boolean
+image_verify_text(const image_header *header, const image_object *obj)
+{
+	uint32_t i;
+	uint32_t id;
+	const image_link *links;
+
+	if (!image_section_valid(obj->text, obj->words,
+				obj->wide ? sizeof(uint32_t) : sizeof(uint16_t)))
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < obj->words; i++)
+	{
+		if (obj->wide)
+		{
+			id = ((const uint32_t *)(image + obj->text))[i];
+		}
+		else
+		{
+			id = ((const uint16_t *)(image + obj->text))[i];
+		}
+
+		if (id >= header->words)
+		{
+			return FALSE;
+		}
+	}
+
+	if (!image_section_valid(obj->links, obj->link_count, sizeof(image_link)))
+	{
+		return FALSE;
+	}
+
+	links = (const image_link *)(image + obj->links);
+
+	for (i = 0; i < obj->link_count; i++)
+	{
+		// Only a link still open at the end has no text
+		if (links[i].kind > GAME_LINK_OPEN || links[i].suffix[1] != '\0'
+				|| links[i].first > links[i].last || links[i].last > obj->words
+				|| !image_string_valid(links[i].text)
+				|| (!links[i].text && links[i].kind != GAME_LINK_OPEN))
+		{
+			return FALSE;
+		}
+
+		if (links[i].kind < GAME_KINDS && !image_id_valid(header, links[i].target, links[i].kind))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Checks the objects of one kind.
+ *
+ * header: Header of the image
+ * src: Description of the table in the header
+ * kind: Which kind of objects are in the table
+ */
+static boolean
+image_verify_table(const image_header *header, const image_table *src, uint8_t kind)
+{
+	uint32_t i;
+	uint32_t j;
+	const image_object *obj;
+
+	if (src->objects > GAME_ID_INDEX(UINT32_MAX)
+			|| !image_section_valid(src->objtab, src->objects, sizeof(image_object)))
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < src->objects; i++)
+	{
+		obj = (const image_object *)(image + src->objtab) + i;
+
+		if (!image_string_valid(obj->name) || !image_string_valid(obj->descr)
+				|| !image_string_valid(obj->prompt) || !image_string_valid(obj->room)
+				|| obj->next_count > CHOICES
+				|| (uint64_t)obj->aliases + obj->alias_count > header->aliases)
+		{
+			return FALSE;
+		}
+
+		for (j = 0; j < obj->next_count; j++)
+		{
+			if (!image_string_valid(obj->next[j]))
+			{
+				return FALSE;
+			}
+		}
+
+		// A target of 0 is END
+		if (kind == GAME_SCENE)
+		{
+			if (!image_id_valid(header, obj->location, GAME_ROOM))
+			{
+				return FALSE;
+			}
+
+			for (j = 0; j < obj->next_count; j++)
+			{
+				if (obj->targets[j] && !image_id_valid(header, obj->targets[j], GAME_SCENE))
+				{
+					return FALSE;
+				}
+			}
+		}
+
+		if (!image_verify_text(header, obj))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Checks the symbol table.
+ *
+ * header: Header of the image
+ * src: Description of the table in the header
+ */
+static boolean
+image_verify_symbols(const image_header *header, const image_symbols *src)
+{
+	uint32_t i;
+	uint32_t j;
+	const image_node *nodes;
+	const game_symbol_s *symtab;
+	const uint8_t *ctrl;
+	const uint32_t *slots;
+
+	if (!image_section_valid(src->nodes, src->elements, sizeof(image_node))
+			|| !image_section_valid(src->symtab, src->elements, sizeof(game_symbol_s))
+			|| !image_section_valid(src->ctrl, src->capacity, sizeof(uint8_t))
+			|| !image_section_valid(src->slots, src->capacity, sizeof(uint32_t)))
+	{
+		return FALSE;
+	}
+
+	if (src->capacity < 16 || src->capacity & (src->capacity - 1)
+			|| src->elements > src->capacity - src->capacity / 8)
+	{
+		return FALSE;
+	}
+
+	nodes = (const image_node *)(image + src->nodes);
+	symtab = (const game_symbol_s *)(image + src->symtab);
+	ctrl = (const uint8_t *)(image + src->ctrl);
+	slots = (const uint32_t *)(image + src->slots);
+
+	// Empty slots have the highest bit set
+	for (i = 0; i < src->capacity; i++)
+	{
+		if (!(ctrl[i] & 0x80) && slots[i] >= src->elements)
+		{
+			return FALSE;
+		}
+	}
+
+	for (i = 0; i < src->elements; i++)
+	{
+		for (j = 0; j < GAME_KINDS; j++)
+		{
+			if (symtab[i].ids[j] && !image_id_valid(header, symtab[i].ids[j], j))
+			{
+				return FALSE;
+			}
+		}
+
+		if (!image_string_valid(nodes[i].key))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Checks a mapped image completely, before
+ * anything is taken from it. That's every
+ * section, string offset, word ID and object
+ * ID. Sets the string table of the image.
+ *
+ * header: Header of the image
+ */
+static boolean
+image_verify(const image_header *header)
+{
+	uint32_t i;
+	const uint32_t *aliastab;
+	const uint32_t *wordtab;
+
+	// The string table must end with a string
+	if (!image_section_valid(header->strings, header->strings_size, sizeof(char))
+			|| !header->strings_size
+			|| image[header->strings + header->strings_size - 1] != '\0')
+	{
+		return FALSE;
+	}
+
+	strtab = image + header->strings;
+	strtab_size = header->strings_size;
+
+	if (!image_string_valid(header->author) || !image_string_valid(header->date)
+			|| !image_string_valid(header->first_scene) || !image_string_valid(header->game)
+			|| !image_string_valid(header->prompt) || !image_string_valid(header->uid))
+	{
+		return FALSE;
+	}
+
+	if (!image_section_valid(header->wordtab, header->words, sizeof(uint32_t))
+			|| !image_section_valid(header->aliastab, header->aliases, sizeof(uint32_t)))
+	{
+		return FALSE;
+	}
+
+	wordtab = (const uint32_t *)(image + header->wordtab);
+	aliastab = (const uint32_t *)(image + header->aliastab);
+
+	// Words are printed, they can't be NULL
+	for (i = 0; i < header->words; i++)
+	{
+		if (!wordtab[i] || !image_string_valid(wordtab[i]))
+		{
+			return FALSE;
+		}
+	}
+
+	for (i = 0; i < header->aliases; i++)
+	{
+		if (!image_string_valid(aliastab[i]))
+		{
+			return FALSE;
+		}
+	}
+
+	for (i = 0; i < GAME_KINDS; i++)
+	{
+		if (!image_verify_table(header, &header->tables[i], i))
+		{
+			return FALSE;
+		}
+	}
+
+	return image_verify_symbols(header, &header->symbols);
+}
+
+/*
+ * Creates the objects of one kind.
+ *
+ * header: Header of the image
+ * src: Description of the table in the header
+ * kind: Which kind of objects are in the table
+ */
+static void
+image_load_table(const image_header *header, const image_table *src, uint8_t kind)
+{
+	char *objects;
+	game_glossary_s *glossary;
+	game_room_s *room;
+	game_scene_s *scene;
+	game_text_s *text;
+	list **alist;
+	size_t size;
+	uint32_t i;
+	uint32_t j;
+	const image_object *objtab;
+	const image_object *obj;
+	const uint32_t *aliastab;
+
+	objtab = image_section(src->objtab, src->objects, sizeof(image_object));
+	aliastab = image_section(header->aliastab, header->aliases, sizeof(uint32_t));
+
+	switch (kind)
+	{
+		case GAME_GLOSSARY:
+			size = sizeof(game_glossary_s);
+			break;
+
+		case GAME_ROOM:
+			size = sizeof(game_room_s);
+			break;
+
+		default:
+			size = sizeof(game_scene_s);
+			break;
+	}
+
+	// All objects of a kind in one go
+	objects = arena_alloc(game_arena, src->objects * size);
+
+	if ((game_objects[kind].objects = malloc((src->objects + 1) * sizeof(void *))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	game_objects[kind].count = src->objects;
+	game_objects[kind].size = src->objects + 1;
+
+	for (i = 0; i < src->objects; i++)
+	{
+		obj = &objtab[i];
+		game_objects[kind].objects[i] = objects + i * size;
+
+		switch (kind)
+		{
+			case GAME_GLOSSARY:
+				glossary = (game_glossary_s *)(objects + i * size);
+				glossary->id = GAME_ID(kind, i);
+				glossary->name = image_string(obj->name);
+				glossary->descr = image_string(obj->descr);
+				alist = &glossary->aliases;
+				text = &glossary->text;
+				break;
+
+			case GAME_ROOM:
+				room = (game_room_s *)(objects + i * size);
+				room->id = GAME_ID(kind, i);
+				room->name = image_string(obj->name);
+				room->descr = image_string(obj->descr);
+				alist = &room->aliases;
+				text = &room->text;
+				break;
+
+			default:
+				scene = (game_scene_s *)(objects + i * size);
+				scene->id = GAME_ID(kind, i);
+				scene->name = image_string(obj->name);
+				scene->descr = image_string(obj->descr);
+				scene->prompt = image_string(obj->prompt);
+				scene->room = image_string(obj->room);
+
+				for (j = 0; j < obj->next_count; j++)
+				{
+					scene->next[j] = image_string(obj->next[j]);
+				}
+
+				scene->next_count = obj->next_count;
+				alist = &scene->aliases;
+				text = &scene->text;
+				break;
+		}
+
+		if (obj->alias_count)
+		{
+			*alist = list_create_arena(game_arena);
+
+			for (j = 0; j < obj->alias_count; j++)
+			{
+				list_push(*alist, (char *)image_string(aliastab[obj->aliases + j]));
+			}
+		}
+
+		text->ids = image_section(obj->text, obj->words,
+				obj->wide ? sizeof(uint32_t) : sizeof(uint16_t));
+		text->words = obj->words;
+		text->wide = obj->wide ? TRUE : FALSE;
+	}
+}
+
+/*
+ * Restores the resolved links of a description.
+ *
+ * text: Description to restore the links of
+ * obj: Object of the description in the image
+ */
+static void
+image_load_links(game_text_s *text, const image_object *obj)
+{
+	game_link_s *links;
+	uint32_t i;
+	const image_link *src;
+
+	src = image_section(obj->links, obj->link_count, sizeof(image_link));
+	links = obj->link_count ? arena_alloc(game_arena, obj->link_count * sizeof(game_link_s)) : NULL;
+
+	for (i = 0; i < obj->link_count; i++)
+	{
+		links[i].first = src[i].first;
+		links[i].last = src[i].last;
+		links[i].kind = src[i].kind;
+		memcpy(links[i].suffix, src[i].suffix, sizeof(links[i].suffix));
+		links[i].text = image_string(src[i].text);
+		links[i].target = src[i].kind < GAME_KINDS ? game_object_get(src[i].target) : NULL;
+	}
+
+	text->links = links;
+	text->link_count = obj->link_count;
+	text->resolved = TRUE;
+}
+
+/*
+ * Restores the references between the objects,
+ * the rooms and choices of the scenes and the
+ * links of all descriptions. The objects of all
+ * kinds must be loaded before.
+ *
+ * header: Header of the image
+ */
+static void
+image_load_refs(const image_header *header)
+{
+	game_scene_s *scene;
+	game_text_s *text;
+	uint32_t i;
+	uint32_t j;
+	uint8_t kind;
+	const image_object *objtab;
+
+	for (kind = 0; kind < GAME_KINDS; kind++)
+	{
+		objtab = image_section(header->tables[kind].objtab,
+				header->tables[kind].objects, sizeof(image_object));
+
+		for (i = 0; i < header->tables[kind].objects; i++)
+		{
+			switch (kind)
+			{
+				case GAME_GLOSSARY:
+					text = &((game_glossary_s *)game_objects[kind].objects[i])->text;
+					break;
+
+				case GAME_ROOM:
+					text = &((game_room_s *)game_objects[kind].objects[i])->text;
+					break;
+
+				default:
+					scene = game_objects[kind].objects[i];
+					scene->location = game_object_get(objtab[i].location);
+
+					for (j = 0; j < scene->next_count; j++)
+					{
+						scene->targets[j] = objtab[i].targets[j]
+								? game_object_get(objtab[i].targets[j]) : NULL;
+					}
+
+					text = &scene->text;
+					break;
+			}
+
+			image_load_links(text, &objtab[i]);
+		}
+	}
+}
+
+/*
+ * Attaches the symbol table to the prebuilt
+ * slots.
+ *
+ * src: Description of the table in the header
+ */
+static void
+image_load_symbols(const image_symbols *src)
+{
+	uint32_t i;
+	const image_node *nodes;
+	const game_symbol_s *symtab;
+	const uint8_t *ctrl;
+	const uint32_t *slots;
+
+	nodes = image_section(src->nodes, src->elements, sizeof(image_node));
+	symtab = image_section(src->symtab, src->elements, sizeof(game_symbol_s));
+	ctrl = image_section(src->ctrl, src->capacity, sizeof(uint8_t));
+	slots = image_section(src->slots, src->capacity, sizeof(uint32_t));
+
+	game_symbols = hashmap_attach(src->capacity, src->elements, ctrl, slots);
+
+	for (i = 0; i < src->elements; i++)
+	{
+		// Symbols are never written
+		game_symbols->nodes[i].key = image_string(nodes[i].key);
+		game_symbols->nodes[i].hash = nodes[i].hash;
+		game_symbols->nodes[i].data = (game_symbol_s *)&symtab[i];
+	}
+}
+
+/*
+ * Builds an image of the games data structures
+ * in memory. The data structures are only read,
+ * so this can run alongside the game.
+ *
+ * out: Buffer to build the image in
+ */
+static void
+image_build(image_buffer *out)
+{
+	hashmap *known;
+	image_buffer aliases;
+	image_buffer strings;
+	image_header *header;
+	image_symbols symbols;
+	image_table tables[GAME_KINDS];
+	uint32_t i;
+	uint32_t offset;
+	uint32_t wordtab;
+
+	assert(out);
+	assert(game_header);
+
+	memset(&aliases, 0, sizeof(aliases));
+	memset(out, 0, sizeof(image_buffer));
+	memset(&strings, 0, sizeof(strings));
+
+	known = hashmap_create(game_words->elements + 1024);
+
+	// String offset 0 is NULL
+	image_append(&strings, NULL, 1, 1);
+
+	// Header is filled at the end
+	image_append(out, NULL, sizeof(image_header), 4);
+
+	wordtab = image_append(out, NULL, game_words->elements * sizeof(uint32_t), 4);
+
+	for (i = 0; i < game_words->elements; i++)
+	{
+		offset = image_string_add(&strings, known, dict_get(game_words, i));
+		memcpy(out->buf + wordtab + i * sizeof(uint32_t), &offset, sizeof(offset));
+	}
+
+	for (i = 0; i < GAME_KINDS; i++)
+	{
+		image_write_table(out, &strings, known, &aliases, &tables[i], i);
+	}
+
+	image_write_symbols(out, &strings, known, &symbols);
+
+	// Everything else may move the buffer
+	offset = image_append(out, aliases.buf, aliases.len, 4);
+
+	header = (image_header *)out->buf;
+	header->aliases = aliases.len / sizeof(uint32_t);
+	header->aliastab = offset;
+	header->author = image_string_add(&strings, known, game_header->author);
+	header->date = image_string_add(&strings, known, game_header->date);
+	header->first_scene = image_string_add(&strings, known, game_header->first_scene);
+	header->game = image_string_add(&strings, known, game_header->game);
+	header->prompt = image_string_add(&strings, known, game_header->prompt);
+	header->uid = image_string_add(&strings, known, game_header->uid);
+
+	offset = image_append(out, strings.buf, strings.len, 4);
+
+	header = (image_header *)out->buf;
+	memcpy(header->magic, IMAGE_MAGIC, sizeof(header->magic));
+	header->version = IMAGE_VERSION;
+	header->endian = IMAGE_ENDIAN;
+	header->size = out->len;
+	header->words = game_words->elements;
+	header->wordtab = wordtab;
+	header->strings = offset;
+	header->strings_size = strings.len;
+	header->source_size = source.size;
+	header->source_mtime = source.mtime;
+	header->source_hash = source.hash;
+	memcpy(header->tables, tables, sizeof(tables));
+	header->symbols = symbols;
+
+	// Strings are owned by the game
+	hashmap_destroy(known, image_destroy_callback);
+
+	free(aliases.buf);
+	free(strings.buf);
+}
+
+/*
+ * Maps an image into memory. Returns NULL if
+ * the file doesn't exist or isn't an image.
+ *
+ * file: Image to map
+ * size: Size of the mapped image
+ */
+static const image_header
+*image_open(const char *file, size_t *size)
+{
+	char magic[sizeof(IMAGE_MAGIC) - 1];
+	int fd;
+	void *mapped;
+	struct stat sb;
+
+	assert(file);
+	assert(size);
+
+	if ((fd = open(file, O_RDONLY)) == -1)
+	{
+		return NULL;
+	}
+
+	if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size < (off_t)sizeof(image_header))
+	{
+		close(fd);
+
+		return NULL;
+	}
+
+	if (read(fd, magic, sizeof(magic)) != sizeof(magic)
+			|| memcmp(magic, IMAGE_MAGIC, sizeof(magic)))
+	{
+		close(fd);
+
+		return NULL;
+	}
+
+	if ((mapped = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	{
+		quit_error(PCOULDNTOPENFILE);
+	}
+
+	close(fd);
+
+	*size = sb.st_size;
+
+	return mapped;
+}
+
+/*
+ * Checks if a mapped image was written by this
+ * version of the engine on this platform.
+ *
+ * header: Header of the image
+ * size: Size of the image
+ */
+static boolean
+image_check(const image_header *header, size_t size)
+{
+	assert(header);
+
+	if (header->version != IMAGE_VERSION || header->endian != IMAGE_ENDIAN
+			|| header->size != size)
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Fills the games data structures from a
+ * mapped image, which becomes the current
+ * image. If the image is broken, FALSE is
+ * returned and nothing is touched.
+ *
+ * header: Header of the image
+ * size: Size of the image
+ */
+static boolean
+image_attach(const image_header *header, size_t size)
+{
+	const uint32_t *wordtab;
+	uint32_t i;
+
+	assert(header);
+	assert(!image);
+
+	image = (const char *)header;
+	image_size = size;
+
+	if (!image_verify(header))
+	{
+		image = NULL;
+		image_size = 0;
+		strtab = NULL;
+		strtab_size = 0;
+
+		return FALSE;
+	}
+
+	game_header->author = image_string(header->author);
+	game_header->date = image_string(header->date);
+	game_header->first_scene = image_string(header->first_scene);
+	game_header->game = image_string(header->game);
+	game_header->prompt = image_string(header->prompt);
+	game_header->uid = image_string(header->uid);
+
+	wordtab = image_section(header->wordtab, header->words, sizeof(uint32_t));
+	game_words = dict_attach(header->words);
+
+	for (i = 0; i < header->words; i++)
+	{
+		game_words->words[i] = image_string(wordtab[i]);
+	}
+
+	for (i = 0; i < GAME_KINDS; i++)
+	{
+		image_load_table(header, &header->tables[i], i);
+	}
+
+	image_load_refs(header);
+
+	image_load_symbols(&header->symbols);
+
+	game_stats->glossary_total = header->tables[GAME_GLOSSARY].objects;
+	game_stats->rooms_total = header->tables[GAME_ROOM].objects;
+	game_stats->scenes_total = header->tables[GAME_SCENE].objects;
+
+	log_info_f("%s: %zu/%zu", i18n_game_memory, game_arena->used, game_arena->reserved);
+
+	return TRUE;
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                           Image Cache                             *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Hashes the contents of a file. This isn't a
+ * cryptographic hash, but it's fast and good
+ * enough to detect changes. 8 bytes are mixed
+ * in at a time.
+ *
+ * data: Data to hash
+ * len: Length of the data
+ */
+static uint64_t
+image_cache_hash(const char *data, size_t len)
+{
+	size_t i;
+	uint64_t hash;
+	uint64_t word;
+
+	hash = len ^ 0x9e3779b97f4a7c15ULL;
+
+	for (i = 0; i < len; i += sizeof(word))
+	{
+		word = 0;
+		memcpy(&word, data + i, len - i < sizeof(word) ? len - i : sizeof(word));
+
+		hash ^= word;
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 32;
+	}
+
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+/*
+ * Searches the game header for the UID. The header
+ * is always the first section, it ends with "----".
+ * The UID is copied into uid. Returns FALSE if
+ * there's no usable UID.
+ *
+ * data: Contents of the game file
+ * len: Length of the contents
+ * uid: Buffer for the UID
+ * size: Size of the buffer
+ */
+static boolean
+image_cache_uid(const char *data, size_t len, char *uid, size_t size)
+{
+	const char *end;
+	const char *line;
+	const char *next;
+	const char *token;
+	size_t toklen;
+
+	for (line = data; line < data + len; line = next)
+	{
+		if ((end = memchr(line, '\n', data + len - line)) == NULL)
+		{
+			end = data + len;
+		}
+
+		next = end + 1;
+
+		// Same separators as the parser
+		while (line < end && *line == ' ')
+		{
+			line++;
+		}
+
+		if (end - line >= 4 && !strncmp(line, "----", 4))
+		{
+			return FALSE;
+		}
+
+		if (end - line < 5 || strncmp(line, "%UID:", 5))
+		{
+			continue;
+		}
+
+		for (token = line + 5; token < end && *token == ' '; token++)
+		{
+			continue;
+		}
+
+		for (toklen = 0; token + toklen < end && token[toklen] != ' '; toklen++)
+		{
+			continue;
+		}
+
+		// The UID becomes a directory name
+		if (!toklen || toklen >= size || memchr(token, '/', toklen) || token[0] == '.')
+		{
+			return FALSE;
+		}
+
+		memcpy(uid, token, toklen);
+		uid[toklen] = '\0';
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Checks if a file in the cache directory may be
+ * removed. That are images of other versions of
+ * the game file and temporary files of writers
+ * that are no longer running. Temporary files of
+ * running instances are still in use.
+ *
+ * file: Name of the file
+ * keep: Name of the current image
+ */
+static boolean
+image_cache_stale(const char *file, const char *keep)
+{
+	char *end;
+	long pid;
+	size_t len;
+
+	len = strlen(file);
+
+	if (len > strlen(IMAGE_SUFFIX) && !strcmp(file + len - strlen(IMAGE_SUFFIX), IMAGE_SUFFIX))
+	{
+		return strcmp(file, keep) != 0;
+	}
+
+	if (strncmp(file, "tmp.", 4))
+	{
+		return FALSE;
+	}
+
+	pid = strtol(file + 4, &end, 10);
+
+	if (end == file + 4 || *end != '\0' || pid <= 0 || pid == getpid())
+	{
+		return FALSE;
+	}
+
+	return kill((pid_t)pid, 0) == -1 && errno == ESRCH;
+}
+
+/*
+ * Writes the image into the cache. Runs in its
+ * own thread, failing isn't fatal. The image is
+ * written to a temporary file and renamed, so
+ * other instances never see a partial image.
+ * Stale files are removed afterwards, e.g.
+ * images of older versions of the game file.
+ */
+static void
+*image_cache_thread(void *unused)
+{
+	DIR *dir;
+	char *name;
+	char tmpfile[PATH_MAX + 16];
+	image_buffer out;
+	int fd;
+	size_t written;
+	ssize_t ret;
+	struct dirent *ent;
+
+	image_build(&out);
+
+	snprintf(tmpfile, sizeof(tmpfile), "%s/tmp.%i", cache.dir, (int)getpid());
+
+	if ((fd = open(tmpfile, O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1)
+	{
+		log_warn_f("%s: %s", i18n_image_cachefailed, tmpfile);
+		free(out.buf);
+
+		return NULL;
+	}
+
+	for (written = 0; written < out.len; written += ret)
+	{
+		if ((ret = write(fd, out.buf + written, out.len - written)) <= 0)
+		{
+			break;
+		}
+	}
+
+	free(out.buf);
+
+	if (written != out.len || fsync(fd) != 0 || close(fd) != 0
+			|| rename(tmpfile, cache.path) != 0)
+	{
+		log_warn_f("%s: %s", i18n_image_cachefailed, tmpfile);
+		unlink(tmpfile);
+
+		return NULL;
+	}
+
+	name = strrchr(cache.path, '/') + 1;
+
+	if ((dir = opendir(cache.dir)) != NULL)
+	{
+		while ((ent = readdir(dir)) != NULL)
+		{
+			if (image_cache_stale(ent->d_name, name))
+			{
+				snprintf(tmpfile, sizeof(tmpfile), "%s/%s", cache.dir, ent->d_name);
+				unlink(tmpfile);
+			}
+		}
+
+		closedir(dir);
+	}
+
+	log_info_f("%s: %s", i18n_image_cachewritten, cache.path);
+
+	return NULL;
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                         Public Interface                          *
+ *                                                                   *
+ *********************************************************************/
+
+boolean
+image_cache_load(const char *file, const char *homedir)
+{
+	char uid[NAME_MAX];
+	const image_header *header;
+	int fd;
+	size_t size;
+	struct stat sb;
+	void *mapped;
+
+	assert(file);
+	assert(homedir);
+
+	cache.path[0] = '\0';
+
+	if ((fd = open(file, O_RDONLY)) == -1)
+	{
+		return FALSE;
+	}
+
+	if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || !sb.st_size)
+	{
+		close(fd);
+
+		return FALSE;
+	}
+
+	if ((mapped = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	{
+		close(fd);
+
+		return FALSE;
+	}
+
+	close(fd);
+
+	source.size = sb.st_size;
+	source.mtime = sb.st_mtime;
+	source.hash = image_cache_hash(mapped, sb.st_size);
+
+	if (!image_cache_uid(mapped, sb.st_size, uid, sizeof(uid)))
+	{
+		munmap(mapped, sb.st_size);
+
+		return FALSE;
+	}
+
+	munmap(mapped, sb.st_size);
+
+	// Everything the image depends on is in its name
+	snprintf(cache.dir, sizeof(cache.dir), "%s/%s/%s", homedir, CACHEDIR, uid);
+	snprintf(cache.path, sizeof(cache.path), "%s/%llx-%llx-%016llx%s", cache.dir,
+			(unsigned long long)source.size, (unsigned long long)source.mtime,
+			(unsigned long long)source.hash, IMAGE_SUFFIX);
+
+	if ((header = image_open(cache.path, &size)) == NULL)
+	{
+		return FALSE;
+	}
+
+	if (!image_check(header, size) || header->source_size != source.size
+			|| header->source_mtime != source.mtime || header->source_hash != source.hash)
+	{
+		munmap((void *)header, size);
+
+		return FALSE;
+	}
+
+	log_info_f("%s: %s", i18n_image_cacheloading, cache.path);
+
+	// Rewritten after the game file was parsed
+	if (!image_attach(header, size))
+	{
+		log_warn_f("%s: %s", i18n_image_cachebroken, cache.path);
+		munmap((void *)header, size);
+		unlink(cache.path);
+
+		return FALSE;
+	}
+
+	// Nothing to write
+	cache.path[0] = '\0';
+
+	return TRUE;
+}
+
+void
+image_cache_wait(void)
+{
+	if (cache.writing)
+	{
+		pthread_join(cache.writer, NULL);
+		cache.writing = FALSE;
+	}
+}
+
+void
+image_cache_write(void)
+{
+	assert(!cache.writing);
+
+	if (!cache.path[0])
+	{
+		return;
+	}
+
+	misc_rmkdir(cache.dir);
+
+	if (pthread_create(&cache.writer, NULL, image_cache_thread, NULL) != 0)
+	{
+		log_warn_f("%s: %s", i18n_image_cachefailed, cache.path);
+
+		return;
+	}
+
+	cache.writing = TRUE;
+}
+
+void
+image_close(void)
+{
+	if (image)
+	{
+		munmap((void *)image, image_size);
+
+		image = NULL;
+		image_size = 0;
+		strtab = NULL;
+		strtab_size = 0;
+	}
+}
+
+boolean
+image_load(const char *file)
+{
+	const image_header *header;
+	size_t size;
+
+	assert(file);
+
+	// Not our business, the parser complains
+	if ((header = image_open(file, &size)) == NULL)
+	{
+		return FALSE;
+	}
+
+	log_info_f("%s: %s", i18n_image_loading, file);
+
+	if (!image_check(header, size) || !image_attach(header, size))
+	{
+		quit_error(PBROKENIMAGE);
+	}
+
+	return TRUE;
+}
+
+void
+image_write(const char *file)
+{
+	FILE *fd;
+	image_buffer out;
+
+	assert(file);
+
+	log_info_f("%s: %s", i18n_image_writing, file);
+
+	image_build(&out);
+
+	if ((fd = fopen(file, "w")) == NULL)
+	{
+		quit_error(PCOULDNTOPENFILE);
+	}
+
+	if (fwrite(out.buf, out.len, 1, fd) != 1)
+	{
+		quit_error(PCOULDNTWRITEIMAGE);
+	}
+
+	if (fclose(fd) != 0)
+	{
+		quit_error(PCOULDNTCLOSEFILE);
+	}
+
+	free(out.buf);
+}
@@ -0,0 +1,83 @@
+/*
+ * image.h
+ * -------
+ *
+ * Compiled game images. An image is a binary dump
+ * of everything the parser produces: The strings,
+ * the dictionary, the objects and the prebuilt
+ * hashmap slots. Images are created by the
+ * touka-compile tool and can be given to the
+ * engine instead of a game file. They're mapped
+ * into memory and used in place, so loading is
+ * nearly free.
+ *
+ * Images aren't portable, they're bound to the
+ * engine version and the byte order.
+ *
+ * Additionally images are cached automatically.
+ * The cache is keyed by the size, the mtime and
+ * a hash of the game file.
+ */
+
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+// --------
+
+#include "main.h"
+
+// --------
+
+/*
+ * Loads the cached image of a game file. If
+ * there's no valid image FALSE is returned and
+ * a later call to image_cache_write() creates
+ * it. A broken image is removed, it's never
+ * a fatal error.
+ *
+ * file: Game file
+ * homedir: Home directory, the cache is below it
+ */
+boolean image_cache_load(const char *file, const char *homedir);
+
+/*
+ * Waits until the cache is written. Must be
+ * called before the game data is released.
+ */
+void image_cache_wait(void);
+
+/*
+ * Writes the image of the game file passed to
+ * image_cache_load() into the cache. This is done
+ * in the background, image_cache_wait() waits for
+ * it to finish.
+ */
+void image_cache_write(void);
+
+/*
+ * Unmaps the currently loaded image. Must be
+ * called after the game data was released.
+ */
+void image_close(void);
+
+/*
+ * Loads a compiled image into the games data
+ * structures. If the file isn't an image FALSE
+ * is returned and nothing happens. A broken
+ * image is a fatal error.
+ *
+ * file: File to load
+ */
+boolean image_load(const char *file);
+
+/*
+ * Writes the games data structures into an
+ * image. Must be called after game_init().
+ *
+ * file: Image to write
+ */
+void image_write(const char *file);
+
+// --------
+
+#endif // IMAGE_H_
@@ -11,12 +11,14 @@
  */
 
 #define _WITH_GETLINE
+#define LOG_MODULE LOG_INPUT
 
 #include <assert.h>
 #include <ctype.h>
 #include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
@@ -69,6 +71,39 @@ static char histfile[PATH_MAX];
  *                                                                   *
  *********************************************************************/
 
+/*
+ * Goes back one or the given number of choices
+ * and replays the scene the player was then in.
+ */
+static void
+cmd_back(char *msg)
+{
+	unsigned long steps;
+
+	steps = 1;
+
+	if (msg)
+	{
+		// strtoul() would take signs and blanks
+		if (strspn(msg, "0123456789") != strlen(msg)
+				|| (steps = strtoul(msg, NULL, 10)) == 0 || steps > UINT32_MAX)
+		{
+			curses_text(TINT_NORM, "%s\n", i18n_scene_backinvalid);
+
+			return;
+		}
+	}
+
+	if (!game_scene_back(steps))
+	{
+		curses_text(TINT_NORM, "%s\n", i18n_scene_nothingtoundo);
+
+		return;
+	}
+
+	game_scene_play(NULL);
+}
+
 /*
  * Prints a list of all glossary entries or descripes
  * the specified entry. Error handling is done in the
@@ -648,6 +683,9 @@ input_init(const char *homedir)
 	log_info(i18n_input_init);
 
 	// Register commands
+	input_register(i18n_cmdback, i18n_cmdbackhelp, cmd_back, FALSE);
+	input_register(i18n_cmdbackshort, i18n_cmdbackhelp, cmd_back, TRUE);
+
 	input_register(i18n_cmdglossary, i18n_cmdglossaryhelp, cmd_glossary, FALSE);
 	input_register(i18n_cmdglossaryshort, i18n_cmdglossaryhelp, cmd_glossary, TRUE);
 
@@ -738,6 +776,9 @@ input_process(char *cmd)
 		cmd = (char *)i18n_cmdnext;
 	}
 
+	// Saves finished since the last command
+	save_poll();
+
 	// Echo the input
 	curses_text(TINT_PROMPT, "> ");
 	curses_text(TINT_NORM, "%s\n", cmd);
@@ -5,11 +5,23 @@
  * A simple logger. It supports three log levels
  * (INFO, WARN, ERROR), more can be added easily.
  * Log files are rotated.
+ *
+ * Callers copy the arguments of their message
+ * into a record of a fixed size ring, claiming
+ * a slot is a single compare and swap. Only
+ * the arguments are copied, formatting them is
+ * left to a background thread. It writes the
+ * records in batches, either rendered as text
+ * or as they are into a binary log. When the
+ * ring is full, messages are dropped and counted
+ * instead of blocking.
  */
 
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,14 +31,137 @@
 #include <sys/stat.h>
 
 #include "log.h"
+#include "logrender.h"
 #include "main.h"
 #include "misc.h"
 #include "quit.h"
 
 // --------
 
+/*
+ * A message waiting to be written. 'seq' tells
+ * who owns the slot: If it's equal to the ticket
+ * of the slot, it's free for a caller. If it's
+ * one more, the record is complete and waits for
+ * the writer.
+ */
+typedef struct
+{
+	uint64_t seq;
+
+	log_message msg;
+	char args[LOGMSG];
+} log_record;
+
+/*
+ * How an argument is taken from the va_list.
+ * Both 'h' modifiers are promoted to int.
+ */
+enum
+{
+	LOG_ARG_INT,
+	LOG_ARG_LONG,
+	LOG_ARG_LLONG,
+	LOG_ARG_SSIZE,
+	LOG_ARG_INTMAX,
+	LOG_ARG_PTRDIFF,
+	LOG_ARG_UINT,
+	LOG_ARG_ULONG,
+	LOG_ARG_ULLONG,
+	LOG_ARG_SIZE,
+	LOG_ARG_UINTMAX,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_LDOUBLE,
+	LOG_ARG_POINTER,
+	LOG_ARG_STRING
+};
+
+// More arguments than fit into a message
+#define LOG_ARGS (LOGMSG / sizeof(uint64_t) + 1)
+
+/*
+ * The arguments of a format string, '*' of
+ * widths and precisions included. 'fmt' is
+ * claimed first, 'ready' is set once the
+ * arguments are filled in.
+ */
+typedef struct
+{
+	const char *fmt;
+	boolean ready;
+
+	uint32_t count;
+	uint8_t args[LOG_ARGS];
+} log_format;
+
+// Function and line are only logged in debug builds
+#ifdef NDEBUG
+#define CALLSITE FALSE
+#else
+#define CALLSITE TRUE
+#endif
+
+// Names of the modules, in the order of logmodule
+static const char *modules[LOG_MODULES] = {
+	"main", "curses", "game", "input", "parser", "save"
+};
+
+// Names of the levels, in the order of logtype
+static const char *levels[] = {
+	"info", "warn", "error", "none"
+};
+
+// --------
+
+// Lowest type of message logged by each module
+uint8_t log_levels[LOG_MODULES];
+
 static FILE *logfile;
 
+/*
+ * IDs of strings already in the binary log by
+ * their address, format strings and function
+ * names stay where they are. Only used by the
+ * writer.
+ */
+static struct
+{
+	const char **keys;
+	uint32_t *ids;
+	uint32_t count;
+	uint32_t size;
+} strings;
+
+// Parsed format strings by their address
+static log_format formats[LOGFORMATS];
+
+// Messages waiting to be written
+static log_record records[LOGRING];
+
+/*
+ * State of the ring. 'head' is the next ticket
+ * handed out to callers, 'tail' the next one
+ * the writer waits for. The mutex only guards
+ * the writers sleep.
+ */
+static struct
+{
+	uint64_t head;
+	uint64_t tail;
+	uint32_t dropped;
+
+	boolean open;
+	boolean sleeping;
+	boolean stop;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} ring = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
 // --------
 
 /*********************************************************************
@@ -36,41 +171,664 @@ static FILE *logfile;
  *********************************************************************/
 
 /*
- * Converts a logtype to a human readable
- * string.
+ * Hashes the address of a string.
  *
- * type: Logtype to convert
- * str: String to which the return value is copied
- * len: Length of the return string
+ * str: String to hash
  */
-static boolean
-log_typetostr(logtype type, char *str, size_t len)
+static uint32_t
+log_address_hash(const char *str)
 {
-	boolean ret;
+	return (uint32_t)(((uint64_t)(uintptr_t)str * 0x9E3779B97F4A7C15ull) >> 32);
+}
 
-	ret = TRUE;
+/*
+ * Parses the conversions of a format string
+ * into the arguments they take. Arguments that
+ * wouldn't fit into a message are left out.
+ *
+ * fmt: Format string to parse
+ * format: Filled with its arguments
+ */
+static void
+log_format_parse(const char *fmt, log_format *format)
+{
+	boolean longdouble;
+	char conv;
+	char length;
+	const char *spec;
+	uint32_t stars;
+	uint8_t arg;
+
+	format->count = 0;
 
-	switch (type)
+	while ((fmt = strchr(fmt, '%')) != NULL)
 	{
-		case LOG_INFO:
-			misc_strlcpy(str, "INFO", len);
-			break;
+		spec = fmt;
+
+		if ((conv = log_conversion(&fmt, &stars)) == 0 || conv == '%')
+		{
+			continue;
+		}
+
+		for ( ; stars && format->count < LOG_ARGS; stars--)
+		{
+			format->args[format->count++] = LOG_ARG_INT;
+		}
+
+		// 'l', 'j', 'z' or 't', "ll" as 'q'
+		length = 0;
+		longdouble = FALSE;
+
+		for ( ; spec < fmt - 1; spec++)
+		{
+			if (*spec == 'L')
+			{
+				longdouble = TRUE;
+			}
+			else if (*spec == 'l' && length == 'l')
+			{
+				length = 'q';
+			}
+			else if (strchr("ljzt", *spec))
+			{
+				length = *spec;
+			}
+		}
+
+		switch (conv)
+		{
+			case 's':
+				arg = LOG_ARG_STRING;
+
+				break;
+
+			case 'a': case 'A': case 'e': case 'E':
+			case 'f': case 'F': case 'g': case 'G':
+				arg = longdouble ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+
+				break;
+
+			case 'p':
+				arg = LOG_ARG_POINTER;
+
+				break;
+
+			case 'd': case 'i':
+				arg = length == 'q' ? LOG_ARG_LLONG : length == 'z' ? LOG_ARG_SSIZE
+					: length == 'j' ? LOG_ARG_INTMAX : length == 't' ? LOG_ARG_PTRDIFF
+					: length == 'l' ? LOG_ARG_LONG : LOG_ARG_INT;
+
+				break;
+
+			default:
+				arg = length == 'q' ? LOG_ARG_ULLONG : length == 'z' ? LOG_ARG_SIZE
+					: length == 'j' ? LOG_ARG_UINTMAX : length == 't' ? LOG_ARG_PTRDIFF
+					: length == 'l' ? LOG_ARG_ULONG : LOG_ARG_UINT;
+
+				break;
+		}
+
+		if (format->count < LOG_ARGS)
+		{
+			format->args[format->count++] = arg;
+		}
+	}
+}
+
+/*
+ * Returns the parsed arguments of a format
+ * string. Each format string is parsed once,
+ * callers on all threads share the result.
+ * While another thread parses it, or if the
+ * table is full, it's parsed into 'tmp'.
+ *
+ * fmt: Format string to look up
+ * tmp: Used if it's not in the table
+ */
+static const log_format
+*log_format_get(const char *fmt, log_format *tmp)
+{
+	const char *key;
+	log_format *format;
+	uint32_t i;
+	uint32_t probe;
+
+	i = log_address_hash(fmt) & (LOGFORMATS - 1);
+
+	for (probe = 0; probe < LOGFORMATS; probe++, i = (i + 1) & (LOGFORMATS - 1))
+	{
+		format = &formats[i];
+		key = __atomic_load_n(&format->fmt, __ATOMIC_ACQUIRE);
+
+		if (!key)
+		{
+			if (!__atomic_compare_exchange_n(&format->fmt, &key, fmt, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			{
+				// Taken meanwhile, 'key' is the new owner
+				if (key != fmt)
+				{
+					continue;
+				}
+
+				break;
+			}
+
+			log_format_parse(fmt, format);
+			__atomic_store_n(&format->ready, TRUE, __ATOMIC_RELEASE);
+
+			return format;
+		}
+
+		if (key == fmt)
+		{
+			if (__atomic_load_n(&format->ready, __ATOMIC_ACQUIRE))
+			{
+				return format;
+			}
 
-		case LOG_WARN:
-			misc_strlcpy(str, "WARN", len);
 			break;
+		}
+	}
+
+	log_format_parse(fmt, tmp);
+
+	return tmp;
+}
+
+/*
+ * Sets the levels of the modules from a list
+ * like "parser=warn,save=info". A level without
+ * a module is set for all modules. Unknown
+ * entries are logged and ignored.
+ *
+ * spec: List of levels
+ */
+static void
+log_level_parse(const char *spec)
+{
+	const char *level;
+	size_t len;
+	size_t modlen;
+	uint8_t i;
+	uint8_t j;
+
+	for ( ; *spec; spec += len + (spec[len] == ','))
+	{
+		len = strcspn(spec, ",");
+
+		if ((level = memchr(spec, '=', len)) != NULL)
+		{
+			modlen = level - spec;
+			level++;
+		}
+		else
+		{
+			modlen = 0;
+			level = spec;
+		}
+
+		for (j = 0; j < sizeof(levels) / sizeof(levels[0]); j++)
+		{
+			if (strlen(levels[j]) == len - (level - spec) && !strncmp(levels[j], level, len - (level - spec)))
+			{
+				break;
+			}
+		}
+
+		if (j == sizeof(levels) / sizeof(levels[0]))
+		{
+			log_warn_f("Unknown log level: %.*s", (int)len, spec);
+
+			continue;
+		}
+
+		for (i = 0; i < LOG_MODULES; i++)
+		{
+			if (!modlen || (strlen(modules[i]) == modlen && !strncmp(modules[i], spec, modlen)))
+			{
+				log_level(i, j);
+
+				if (modlen)
+				{
+					break;
+				}
+			}
+		}
+
+		if (modlen && i == LOG_MODULES)
+		{
+			log_warn_f("Unknown log module: %.*s", (int)len, spec);
+		}
+	}
+}
+
+/*
+ * Copies a number into the packed arguments.
+ * Returns false if there's no room left.
+ *
+ * buf: Packed arguments
+ * size: Size of 'buf'
+ * pos: Position in 'buf', moved behind the number
+ * value: Number to copy
+ */
+static boolean
+log_pack_number(char *buf, size_t size, size_t *pos, uint64_t value)
+{
+	if (*pos + sizeof(value) > size)
+	{
+		return FALSE;
+	}
+
+	memcpy(buf + *pos, &value, sizeof(value));
+	*pos += sizeof(value);
+
+	return TRUE;
+}
+
+/*
+ * Copies the arguments of a message. When they
+ * don't fit, the last string is cut and the
+ * following arguments are missing. Returns the
+ * number of bytes used.
+ *
+ * buf: Buffer for the packed arguments
+ * size: Size of 'buf'
+ * format: Arguments of the format string
+ * args: The arguments
+ */
+static size_t
+log_pack(char *buf, size_t size, const log_format *format, va_list args)
+{
+	const char *str;
+	double real;
+	size_t len;
+	size_t pos;
+	uint32_t i;
+	uint64_t value;
+
+	pos = 0;
+
+	for (i = 0; i < format->count; i++)
+	{
+		switch (format->args[i])
+		{
+			case LOG_ARG_STRING:
+				if ((str = va_arg(args, const char *)) == NULL)
+				{
+					str = "(null)";
+				}
+
+				if (pos >= size)
+				{
+					return pos;
+				}
+
+				len = strlen(str);
+
+				if (len > size - pos - 1)
+				{
+					len = size - pos - 1;
+				}
+
+				memcpy(buf + pos, str, len);
+				buf[pos + len] = '\0';
+				pos += len + 1;
+
+				continue;
+
+			case LOG_ARG_DOUBLE:
+			case LOG_ARG_LDOUBLE:
+				if (format->args[i] == LOG_ARG_LDOUBLE)
+				{
+					real = (double)va_arg(args, long double);
+				}
+				else
+				{
+					real = va_arg(args, double);
+				}
+
+				memcpy(&value, &real, sizeof(value));
+
+				break;
+
+			case LOG_ARG_POINTER:
+				value = (uintptr_t)va_arg(args, void *);
+
+				break;
+
+			case LOG_ARG_INT:
+				value = (uint64_t)(int64_t)va_arg(args, int);
+
+				break;
+
+			case LOG_ARG_LONG:
+				value = (uint64_t)va_arg(args, long);
+
+				break;
+
+			case LOG_ARG_LLONG:
+				value = (uint64_t)va_arg(args, long long);
+
+				break;
+
+			case LOG_ARG_SSIZE:
+				value = (uint64_t)va_arg(args, ssize_t);
+
+				break;
+
+			case LOG_ARG_INTMAX:
+				value = (uint64_t)va_arg(args, intmax_t);
+
+				break;
+
+			case LOG_ARG_PTRDIFF:
+				value = (uint64_t)va_arg(args, ptrdiff_t);
+
+				break;
+
+			case LOG_ARG_ULONG:
+				value = va_arg(args, unsigned long);
+
+				break;
+
+			case LOG_ARG_ULLONG:
+				value = va_arg(args, unsigned long long);
+
+				break;
+
+			case LOG_ARG_SIZE:
+				value = va_arg(args, size_t);
+
+				break;
+
+			case LOG_ARG_UINTMAX:
+				value = va_arg(args, uintmax_t);
+
+				break;
+
+			default:
+				value = va_arg(args, unsigned int);
+
+				break;
+		}
+
+		if (!log_pack_number(buf, size, &pos, value))
+		{
+			return pos;
+		}
+	}
+
+	return pos;
+}
+
+/*
+ * Doubles the size of the table of string IDs.
+ */
+static void
+log_string_grow(void)
+{
+	const char **keys;
+	uint32_t *ids;
+	uint32_t i;
+	uint32_t j;
+	uint32_t size;
+
+	keys = strings.keys;
+	ids = strings.ids;
+	size = strings.size;
 
-		case LOG_ERROR:
-			misc_strlcpy(str, "ERROR", len);
+	strings.size = size ? size * 2 : 256;
+
+	if ((strings.keys = calloc(strings.size, sizeof(const char *))) == NULL
+			|| (strings.ids = calloc(strings.size, sizeof(uint32_t))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	for (i = 0; i < size; i++)
+	{
+		if (!keys[i])
+		{
+			continue;
+		}
+
+		j = log_address_hash(keys[i]) & (strings.size - 1);
+
+		while (strings.keys[j])
+		{
+			j = (j + 1) & (strings.size - 1);
+		}
+
+		strings.keys[j] = keys[i];
+		strings.ids[j] = ids[i];
+	}
+
+	free(keys);
+	free(ids);
+}
+
+/*
+ * Returns the ID of a string in the binary log.
+ * It's written, if it's not already known. The
+ * string is looked up by its address only.
+ *
+ * str: String to look up
+ */
+static uint32_t
+log_string(const char *str)
+{
+	log_entry_string entry;
+	uint32_t i;
+	uint32_t id;
+
+	// At most three quarters are used, so there's always a free slot
+	if ((strings.count + 1) * 4 > strings.size * 3)
+	{
+		log_string_grow();
+	}
+
+	for (i = log_address_hash(str) & (strings.size - 1); strings.keys[i]; i = (i + 1) & (strings.size - 1))
+	{
+		if (strings.keys[i] == str)
+		{
+			return strings.ids[i];
+		}
+	}
+
+	id = ++strings.count;
+	strings.keys[i] = str;
+	strings.ids[i] = id;
+
+	entry.tag = LOG_ENTRY_STRING;
+	entry.id = id;
+	entry.len = strlen(str);
+
+	if (fwrite(&entry, sizeof(entry), 1, logfile) != 1
+			|| (entry.len && fwrite(str, entry.len, 1, logfile) != 1))
+	{
+		quit_error(PCOULDNTWRITELOGMSG);
+	}
+
+	return id;
+}
+
+/*
+ * Writes a message to the log, either rendered
+ * or as it is.
+ *
+ * msg: Message to write
+ * msgtime: Its time, only used for text logs
+ */
+static void
+log_write(const log_message *msg, const char *msgtime)
+{
+	char logmsg[LOGMSG + 256];
+	log_entry_message entry;
+
+	if (!LOGBINARY)
+	{
+		log_render(logmsg, sizeof(logmsg), msgtime, msg, CALLSITE);
+
+		if (fputs(logmsg, logfile) == EOF)
+		{
+			quit_error(PCOULDNTWRITELOGMSG);
+		}
+
+		return;
+	}
+
+	entry.tag = LOG_ENTRY_MESSAGE;
+	entry.type = msg->type;
+	entry.time = msg->time;
+	entry.fmt = log_string(msg->fmt);
+	entry.func = log_string(msg->func);
+	entry.line = msg->line;
+	entry.len = msg->len;
+
+	if (fwrite(&entry, sizeof(entry), 1, logfile) != 1
+			|| (entry.len && fwrite(msg->args, entry.len, 1, logfile) != 1))
+	{
+		quit_error(PCOULDNTWRITELOGMSG);
+	}
+}
+
+#ifndef NDEBUG
+/*
+ * Echos a message to stderr. Done by the caller,
+ * so errors show up before the program quits.
+ *
+ * msg: Message to echo
+ */
+static void
+log_echo(const log_message *msg)
+{
+	char logmsg[LOGMSG + 256];
+	char msgtime[32];
+
+	if (!log_time(msgtime, sizeof(msgtime), msg->time))
+	{
+		quit_error(PLOCALTIME);
+	}
+
+	log_render(logmsg, sizeof(logmsg), msgtime, msg, TRUE);
+
+	fprintf(stderr, "%s", logmsg);
+}
+#endif
+
+/*
+ * Writes all complete records. Only one thread
+ * at a time may call this. Returns the number of
+ * records written.
+ */
+static uint32_t
+log_drain(void)
+{
+	char args[sizeof(uint64_t)];
+	log_message notice;
+	log_record *record;
+	size_t len;
+	uint32_t count;
+	uint32_t dropped;
+
+	// The time changes once a second at most
+	static char msgtime[32];
+	static int64_t cached;
+
+	count = 0;
+
+	while (TRUE)
+	{
+		record = &records[ring.tail % LOGRING];
+
+		if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != ring.tail + 1)
+		{
 			break;
+		}
+
+		if (record->msg.time != cached || !msgtime[0])
+		{
+			cached = record->msg.time;
+
+			if (!log_time(msgtime, sizeof(msgtime), cached))
+			{
+				quit_error(PLOCALTIME);
+			}
+		}
+
+		log_write(&record->msg, msgtime);
+
+		// Hand the slot back for the next round
+		__atomic_store_n(&record->seq, ring.tail + LOGRING, __ATOMIC_RELEASE);
+		ring.tail++;
+
+		count++;
+	}
+
+	if ((dropped = __atomic_exchange_n(&ring.dropped, 0, __ATOMIC_ACQ_REL)) != 0)
+	{
+		len = 0;
+		log_pack_number(args, sizeof(args), &len, dropped);
+
+		notice.time = cached;
+		notice.type = LOG_WARN;
+		notice.func = __func__;
+		notice.line = __LINE__;
+		notice.fmt = "Log full, %u messages dropped";
+		notice.args = args;
+		notice.len = len;
+
+		log_write(&notice, msgtime);
+		count++;
+	}
+
+	if (count)
+	{
+		fflush(logfile);
+	}
+
+	return count;
+}
+
+/*
+ * Writes the records in the background. Sleeps
+ * while there's nothing to write.
+ */
+static void
+*log_thread(void *unused)
+{
+	struct timespec timeout;
+
+	while (TRUE)
+	{
+		log_drain();
+
+		pthread_mutex_lock(&ring.lock);
+
+		if (ring.stop)
+		{
+			pthread_mutex_unlock(&ring.lock);
 
-		default:
-			misc_strlcpy(str, "UNKNOWN", len);
-			ret = FALSE;
 			break;
+		}
+
+		// Callers check 'sleeping' after publishing their record
+		__atomic_store_n(&ring.sleeping, TRUE, __ATOMIC_SEQ_CST);
+
+		if (__atomic_load_n(&records[ring.tail % LOGRING].seq, __ATOMIC_SEQ_CST) != ring.tail + 1)
+		{
+			clock_gettime(CLOCK_REALTIME, &timeout);
+			timeout.tv_sec++;
+
+			pthread_cond_timedwait(&ring.cond, &ring.lock, &timeout);
+		}
+
+		__atomic_store_n(&ring.sleeping, FALSE, __ATOMIC_SEQ_CST);
+
+		pthread_mutex_unlock(&ring.lock);
 	}
 
-	return ret;
+	return NULL;
 }
 
 // --------
@@ -84,75 +842,78 @@ log_typetostr(logtype type, char *str, size_t len)
 void
 log_insert(logtype type, const char *func, int32_t line, const char *fmt, ...)
 {
-	char *inpmsg;
-	char *logmsg;
-	char msgtime[32];
-	char status[32];
-	int msglen;
-	struct tm *t;
-	time_t tmp;
+	log_format tmp;
+	log_record *record;
+	uint64_t pos;
+	uint64_t seq;
 	va_list args;
 
-	// 256 is enough room for the prepended stuff
-	va_start(args, fmt);
-	msglen = vsnprintf(NULL, 0, fmt, args) + 256;
-	va_end(args);
-
-	if ((inpmsg = malloc(msglen)) == NULL)
+	if (type > LOG_ERROR)
 	{
-		perror("Couldn't allocate memory");
+		quit_error(PUNKNOWNLOGTYPE);
 	}
 
-	if ((logmsg = malloc(msglen)) == NULL)
+	if (!__atomic_load_n(&ring.open, __ATOMIC_ACQUIRE))
 	{
-		quit_error(POUTOFMEM);
+		return;
 	}
 
-	// Format the message
-	va_start(args, fmt);
-	vsnprintf(inpmsg, msglen, fmt, args);
-	va_end(args);
-
-	// Time
-	tmp = time(NULL);
+	// Claim a slot
+	pos = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
 
-	if ((t = localtime(&tmp)) == NULL)
+	while (TRUE)
 	{
-		quit_error(PLOCALTIME);
-	}
+		record = &records[pos % LOGRING];
+		seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
 
-	strftime(msgtime, sizeof(msgtime), "%m-%d-%Y %H:%M:%S", t);
+		if (seq == pos)
+		{
+			if (__atomic_compare_exchange_n(&ring.head, &pos, pos + 1, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if (seq < pos)
+		{
+			// Full, the writer is a whole round behind
+			__atomic_fetch_add(&ring.dropped, 1, __ATOMIC_RELAXED);
 
-	// Status
-	if (!log_typetostr(type, status, sizeof(status)) != 0)
-	{
-		quit_error(PUNKNOWNLOGTYPE);
+			return;
+		}
+		else
+		{
+			pos = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+		}
 	}
 
-	// Prepend informational stuff
-#ifdef NDEBUG
-	snprintf(logmsg, msglen, "%s [%s]: %s\n", msgtime, status, inpmsg);
-#else
-	snprintf(logmsg, msglen, "%s [%s] (%s:%i): %s\n", msgtime, status, func, line, inpmsg);
-#endif
+	record->msg.time = time(NULL);
+	record->msg.type = type;
+	record->msg.func = func;
+	record->msg.line = line;
+	record->msg.fmt = fmt;
+	record->msg.args = record->args;
 
-	// Write it
-	if ((fwrite(logmsg, strlen(logmsg), 1, logfile)) != 1)
-	{
-		quit_error(PCOULDNTWRITELOGMSG);
-	}
-
-	fflush(logfile);
+	// Formatting is left to the writer
+	va_start(args, fmt);
+	record->msg.len = log_pack(record->args, sizeof(record->args), log_format_get(fmt, &tmp), args);
+	va_end(args);
 
 #ifndef NDEBUG
 	if (type == LOG_ERROR)
 	{
-		fprintf(stderr, "%s", logmsg);
+		log_echo(&record->msg);
 	}
 #endif
 
-	free(inpmsg);
-	free(logmsg);
+	// Publish it
+	__atomic_store_n(&record->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&ring.sleeping, __ATOMIC_SEQ_CST))
+	{
+		pthread_mutex_lock(&ring.lock);
+		pthread_cond_signal(&ring.cond);
+		pthread_mutex_unlock(&ring.lock);
+	}
 }
 
 void
@@ -161,7 +922,9 @@ log_init(const char *path, const char *name, int16_t seg)
 	char newfile[PATH_MAX];
 	char oldfile[PATH_MAX];
 	int16_t i;
+	log_header header;
 	struct stat sb;
+	uint32_t j;
 
 	assert(!logfile);
 	assert(seg < 99);
@@ -220,20 +983,86 @@ log_init(const char *path, const char *name, int16_t seg)
 	{
 		quit_error(PCOULDNTOPENFILE);
 	}
+
+	if (LOGBINARY)
+	{
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, LOG_MAGIC, sizeof(header.magic));
+
+		header.version = LOG_VERSION;
+		header.endian = LOG_ENDIAN;
+		header.flags = CALLSITE ? LOG_CALLSITE : 0;
+
+		if (fwrite(&header, sizeof(header), 1, logfile) != 1)
+		{
+			quit_error(PCOULDNTWRITELOGMSG);
+		}
+
+	}
+
+	// All slots are free for the first round
+	for (j = 0; j < LOGRING; j++)
+	{
+		records[j].seq = j;
+	}
+
+	ring.head = 0;
+	ring.tail = 0;
+	ring.stop = FALSE;
+
+	if (pthread_create(&ring.thread, NULL, log_thread, NULL) != 0)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	__atomic_store_n(&ring.open, TRUE, __ATOMIC_RELEASE);
+
+	if (getenv(LOGENV))
+	{
+		log_level_parse(getenv(LOGENV));
+	}
 }
 
 void
 log_close(void)
 {
-	if (logfile)
+	if (!__atomic_exchange_n(&ring.open, FALSE, __ATOMIC_ACQ_REL))
 	{
-		fflush(logfile);
+		return;
+	}
 
-		if ((fclose(logfile)) != 0)
-		{
-			quit_error(PCOULDNTCLOSEFILE);
-		}
+	// The writer can't wait for itself
+	if (pthread_equal(pthread_self(), ring.thread))
+	{
+		return;
+	}
 
-		logfile = NULL;
+	pthread_mutex_lock(&ring.lock);
+	ring.stop = TRUE;
+	pthread_cond_signal(&ring.cond);
+	pthread_mutex_unlock(&ring.lock);
+
+	pthread_join(ring.thread, NULL);
+
+	// Records added while the writer stopped
+	log_drain();
+
+	if ((fclose(logfile)) != 0)
+	{
+		quit_error(PCOULDNTCLOSEFILE);
 	}
+
+	logfile = NULL;
+
+	free(strings.keys);
+	free(strings.ids);
+	memset(&strings, 0, sizeof(strings));
+}
+
+void
+log_level(logmodule module, uint8_t level)
+{
+	assert(module < LOG_MODULES);
+
+	__atomic_store_n(&log_levels[module], level, __ATOMIC_RELAXED);
 }
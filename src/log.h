@@ -16,6 +16,27 @@
  *  initialized by calling initlog(). Initializing the handler
  *  rotates the existing log files. When the program is terminated
  *  the log handler must be closed with closelog().
+ *
+ *  Messages are written by a background thread. Logging
+ *  never blocks, when too many messages are waiting new
+ *  ones are dropped. Closing the handler writes all
+ *  messages still waiting.
+ *
+ *  Callers don't format their messages, only the arguments
+ *  are copied. They're formatted by the background thread
+ *  or, if LOGBINARY is set, written as they are. Binary logs
+ *  are rendered by touka-logdump, see logrender.h. Format
+ *  strings must stay valid forever, e.g. literals or i18n
+ *  strings. They're known by their address, the conversions
+ *  of each one are parsed only once.
+ *
+ *  Messages below LOGLEVEL are removed at compile time.
+ *  Each module has its own level at runtime, set by the
+ *  LOGENV environment variable, e.g. "parser=warn,save=info"
+ *  or just "error" for all modules. The level is checked
+ *  before the arguments are evaluated. A file selects its
+ *  module by defining LOG_MODULE before including this
+ *  header.
  */
 
 #ifndef LOG_H_
@@ -25,6 +46,8 @@
 
 #include <stdint.h>
 
+#include "main.h"
+
 // --------
 
 /*
@@ -37,13 +60,121 @@ typedef enum
 	LOG_ERROR
 } logtype;
 
+/*
+ * Modules with their own log level.
+ */
+typedef enum
+{
+	LOG_MAIN,
+	LOG_CURSES,
+	LOG_GAME,
+	LOG_INPUT,
+	LOG_PARSER,
+	LOG_SAVE,
+	LOG_MODULES
+} logmodule;
+
+// Files not belonging to any other module
+#ifndef LOG_MODULE
+#define LOG_MODULE LOG_MAIN
+#endif
+
+// Lowest type of message logged by each module
+extern uint8_t log_levels[LOG_MODULES];
+
+/*
+ * A message with its arguments packed by
+ * log_insert(). Numbers take 8 bytes each,
+ * strings are copied including their 0.
+ */
+typedef struct
+{
+	int64_t time;
+	logtype type;
+
+	const char *func;
+	int32_t line;
+
+	const char *fmt;
+	const char *args;
+	uint32_t len;
+} log_message;
+
+// Magic bytes at the start of a binary log
+#define LOG_MAGIC "TOUKALOG"
+
+// Version of the binary log format
+#define LOG_VERSION 1
+
+// Written as is to detect the byte order
+#define LOG_ENDIAN 0x01020304
+
+// Set in the header if the call site is printed
+#define LOG_CALLSITE 1
+
+/*
+ * Header of a binary log. It's followed by
+ * entries, each starting with its tag.
+ */
+typedef struct
+{
+	char magic[8];
+
+	uint32_t version;
+	uint32_t endian;
+	uint32_t flags;
+	uint32_t unused;
+} log_header;
+
+/*
+ * Tags of the entries of a binary log.
+ */
+enum
+{
+	// Defines a format string or function name
+	LOG_ENTRY_STRING = 1,
+
+	// A message
+	LOG_ENTRY_MESSAGE
+};
+
+/*
+ * Defines a string. Strings are written once,
+ * messages refer to them by their ID. It's
+ * followed by 'len' bytes of the string, not
+ * terminated by 0.
+ */
+typedef struct
+{
+	uint32_t tag;
+	uint32_t id;
+	uint32_t len;
+} log_entry_string;
+
+/*
+ * A message. It's followed by 'len' bytes of
+ * packed arguments.
+ */
+typedef struct
+{
+	uint32_t tag;
+	uint32_t type;
+	int64_t time;
+
+	uint32_t fmt;
+	uint32_t func;
+	int32_t line;
+	uint32_t len;
+} log_entry_message;
+
 // --------
 
 /*
  * Logs an message. If NDEBUG is not set and type is
  * LOG_ERROR, the error message is echoed to stderr.
  * All messages will have the calling function and
- * line added.
+ * line added. May be called from any thread, before
+ * log_init() and after log_close() it does nothing.
  *
  * type: Type if message
  * func: Calling function
@@ -62,29 +193,46 @@ void log_insert(logtype type, const char *func, int32_t line, const char *fmt, .
 void log_init(const char *path, const char *name, int16_t seg);
 
 /*
- * Closes the log file. May be called several times.
+ * Writes all waiting messages and closes the log
+ * file. May be called several times.
  */
 void log_close(void);
 
+/*
+ * Sets the lowest type of message logged by a
+ * module. Messages from other threads may still
+ * be filtered by the old level for a moment.
+ *
+ * module: Module to set the level for
+ * level: Lowest type logged, LOG_ERROR + 1 for none
+ */
+void log_level(logmodule module, uint8_t level);
+
 // --------
 
+/*
+ * 	True if the module of the caller logs messages of
+ * 	that type. Constant false below LOGLEVEL.
+ */
+#define log_enabled(T) ((T) >= LOGLEVEL && (T) >= log_levels[LOG_MODULE])
+
 /*
  * 	Convenience macros for infos
  */
-#define log_info(F) log_insert(LOG_INFO, __func__, __LINE__, F)
-#define log_info_f(F, ...) log_insert(LOG_INFO, __func__, __LINE__, F, __VA_ARGS__)
+#define log_info(F) do { if (log_enabled(LOG_INFO)) log_insert(LOG_INFO, __func__, __LINE__, F); } while (0)
+#define log_info_f(F, ...) do { if (log_enabled(LOG_INFO)) log_insert(LOG_INFO, __func__, __LINE__, F, __VA_ARGS__); } while (0)
 
 /*
  * 	Convenience macro for warnings
  */
-#define log_warn(F) log_insert(LOG_WARN, __func__, __LINE__, F)
-#define log_warn_f(F, ...) log_insert(LOG_WARN, __func__, __LINE__, F, __VA_ARGS__)
+#define log_warn(F) do { if (log_enabled(LOG_WARN)) log_insert(LOG_WARN, __func__, __LINE__, F); } while (0)
+#define log_warn_f(F, ...) do { if (log_enabled(LOG_WARN)) log_insert(LOG_WARN, __func__, __LINE__, F, __VA_ARGS__); } while (0)
 
 /*
  * 	Convenience macro for errors
  */
-#define log_error(F) log_insert(LOG_ERROR, __func__, __LINE__, F)
-#define log_error_f(F, ...) log_insert(LOG_ERROR, __func__, __LINE__, F, __VA_ARGS__)
+#define log_error(F) do { if (log_enabled(LOG_ERROR)) log_insert(LOG_ERROR, __func__, __LINE__, F); } while (0)
+#define log_error_f(F, ...) do { if (log_enabled(LOG_ERROR)) log_insert(LOG_ERROR, __func__, __LINE__, F, __VA_ARGS__); } while (0)
 
 // --------
 
@@ -0,0 +1,232 @@
+/*
+ * logdump.c
+ * ---------
+ *
+ * touka-logdump, renders a binary log into the
+ * text format. The binary log is written by the
+ * engine if LOGBINARY is set in main.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "logrender.h"
+#include "main.h"
+
+// --------
+
+// Sanity limit for strings and arguments
+#define MAXENTRY (1024 * 1024)
+
+// --------
+
+// Strings defined so far, indexed by their ID
+static char **strings;
+static uint32_t count;
+static uint32_t size;
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                        Support Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Prints an error and exits.
+ *
+ * file: The log
+ * reason: What's wrong with it
+ */
+static void
+logdump_fail(const char *file, const char *reason)
+{
+	fprintf(stderr, "%s: %s\n", file, reason);
+	exit(1);
+}
+
+/*
+ * Reads the rest of an entry after its tag.
+ * Returns false if the log ends in between,
+ * the last entry may be torn after a crash.
+ *
+ * log: Log to read from
+ * entry: Entry with the tag already read
+ * len: Size of the entry
+ */
+static int
+logdump_read(FILE *log, void *entry, size_t len)
+{
+	return fread((char *)entry + sizeof(uint32_t), len - sizeof(uint32_t), 1, log) == 1;
+}
+
+/*
+ * Returns the string with the given ID.
+ *
+ * file: The log
+ * id: ID of the string
+ */
+static const char
+*logdump_string(const char *file, uint32_t id)
+{
+	if (id == 0 || id > count)
+	{
+		logdump_fail(file, "Undefined string");
+	}
+
+	return strings[id];
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                               Main                                *
+ *                                                                   *
+ *********************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+	FILE *log;
+	char *args;
+	char line[LOGMSG + 512];
+	char msgtime[32];
+	int64_t cached;
+	log_entry_message message;
+	log_entry_string string;
+	log_header header;
+	log_message msg;
+	uint32_t tag;
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "USAGE: %s /path/to/log\n", argv[0]);
+		exit(1);
+	}
+
+	if ((log = fopen(argv[1], "r")) == NULL)
+	{
+		logdump_fail(argv[1], "Couldn't open file");
+	}
+
+	if (fread(&header, sizeof(header), 1, log) != 1
+			|| memcmp(header.magic, LOG_MAGIC, sizeof(header.magic)))
+	{
+		logdump_fail(argv[1], "Not a binary log");
+	}
+
+	if (header.version != LOG_VERSION || header.endian != LOG_ENDIAN)
+	{
+		logdump_fail(argv[1], "Log from another version or platform");
+	}
+
+	if ((args = malloc(MAXENTRY)) == NULL)
+	{
+		logdump_fail(argv[1], "Out of memory");
+	}
+
+	cached = 0;
+	msgtime[0] = '\0';
+
+	while (fread(&tag, sizeof(tag), 1, log) == 1)
+	{
+		if (tag == LOG_ENTRY_STRING)
+		{
+			string.tag = tag;
+
+			if (!logdump_read(log, &string, sizeof(string)))
+			{
+				break;
+			}
+
+			// IDs are handed out in order
+			if (string.id != count + 1 || string.len >= MAXENTRY)
+			{
+				logdump_fail(argv[1], "Broken string");
+			}
+
+			if (count + 1 >= size)
+			{
+				size = size ? size * 2 : 256;
+
+				if ((strings = realloc(strings, size * sizeof(char *))) == NULL)
+				{
+					logdump_fail(argv[1], "Out of memory");
+				}
+			}
+
+			if ((strings[count + 1] = calloc(1, string.len + 1)) == NULL)
+			{
+				logdump_fail(argv[1], "Out of memory");
+			}
+
+			if (string.len && fread(strings[count + 1], string.len, 1, log) != 1)
+			{
+				break;
+			}
+
+			count++;
+		}
+		else if (tag == LOG_ENTRY_MESSAGE)
+		{
+			message.tag = tag;
+
+			if (!logdump_read(log, &message, sizeof(message)))
+			{
+				break;
+			}
+
+			if (message.len > MAXENTRY)
+			{
+				logdump_fail(argv[1], "Broken message");
+			}
+
+			if (message.len && fread(args, message.len, 1, log) != 1)
+			{
+				break;
+			}
+
+			msg.time = message.time;
+			msg.type = message.type;
+			msg.func = logdump_string(argv[1], message.func);
+			msg.line = message.line;
+			msg.fmt = logdump_string(argv[1], message.fmt);
+			msg.args = args;
+			msg.len = message.len;
+
+			if (msg.time != cached || !msgtime[0])
+			{
+				cached = msg.time;
+
+				if (!log_time(msgtime, sizeof(msgtime), cached))
+				{
+					logdump_fail(argv[1], "Broken time");
+				}
+			}
+
+			log_render(line, sizeof(line), msgtime, &msg, header.flags & LOG_CALLSITE);
+			fputs(line, stdout);
+		}
+		else
+		{
+			logdump_fail(argv[1], "Unknown entry");
+		}
+	}
+
+	fclose(log);
+
+	for ( ; count; count--)
+	{
+		free(strings[count]);
+	}
+
+	free(strings);
+	free(args);
+
+	return 0;
+}
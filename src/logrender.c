@@ -0,0 +1,310 @@
+/*
+ * logrender.c
+ * -----------
+ *
+ * Renders log messages from their packed
+ * arguments into lines of the text log. Used
+ * by the log writer and by touka-logdump, so
+ * it mustn't depend on the rest of the engine.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "logrender.h"
+#include "main.h"
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                            Support Functions                      *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Converts a logtype to a human readable
+ * string.
+ *
+ * type: Logtype to convert
+ * str: String to which the return value is copied
+ * len: Length of the return string
+ */
+static boolean
+log_typetostr(logtype type, char *str, size_t len)
+{
+	boolean ret;
+
+	ret = TRUE;
+
+	switch (type)
+	{
+		case LOG_INFO:
+			snprintf(str, len, "INFO");
+			break;
+
+		case LOG_WARN:
+			snprintf(str, len, "WARN");
+			break;
+
+		case LOG_ERROR:
+			snprintf(str, len, "ERROR");
+			break;
+
+		default:
+			snprintf(str, len, "UNKNOWN");
+			ret = FALSE;
+			break;
+	}
+
+	return ret;
+}
+
+/*
+ * Takes a number from the packed arguments.
+ * Returns false if there's none left.
+ *
+ * msg: Message with the arguments
+ * pos: Position in the arguments, moved behind the number
+ * value: Set to the number
+ */
+static boolean
+log_unpack_number(const log_message *msg, size_t *pos, uint64_t *value)
+{
+	if (*pos + sizeof(*value) > msg->len)
+	{
+		return FALSE;
+	}
+
+	memcpy(value, msg->args + *pos, sizeof(*value));
+	*pos += sizeof(*value);
+
+	return TRUE;
+}
+
+/*
+ * Formats a message from its packed arguments.
+ * Each conversion is passed to snprintf() on
+ * its own, with the length modifier adjusted
+ * to the unpacked type. The message ends at
+ * the first missing argument or string without
+ * its 0.
+ *
+ * buf: Buffer to format into
+ * size: Size of the buffer
+ * msg: Message to format
+ */
+static void
+log_unpack(char *buf, size_t size, const log_message *msg)
+{
+	char conv;
+	char spec[64];
+	const char *cur;
+	const char *fmt;
+	const char *str;
+	double real;
+	int len;
+	size_t end;
+	size_t pos;
+	size_t used;
+	uint32_t stars;
+	uint64_t value;
+
+	assert(size);
+
+	fmt = msg->fmt;
+	pos = 0;
+	used = 0;
+	buf[0] = '\0';
+
+	while (*fmt && used < size - 1)
+	{
+		// Text up to the next conversion
+		if (*fmt != '%')
+		{
+			buf[used++] = *fmt++;
+			buf[used] = '\0';
+
+			continue;
+		}
+
+		cur = fmt;
+
+		if ((conv = log_conversion(&fmt, &stars)) == 0)
+		{
+			break;
+		}
+
+		if (conv == '%')
+		{
+			buf[used++] = '%';
+			buf[used] = '\0';
+
+			continue;
+		}
+
+		// Format strings of binary logs may be broken, too
+		if (!strchr("aAcdeEfFgGiopsuxX", conv))
+		{
+			return;
+		}
+
+		// Rebuild the conversion, '*' are replaced by their value
+		end = 0;
+
+		for ( ; cur < fmt - 1 && end < sizeof(spec) - 24; cur++)
+		{
+			if (*cur == '*')
+			{
+				if (!log_unpack_number(msg, &pos, &value))
+				{
+					return;
+				}
+
+				end += snprintf(spec + end, sizeof(spec) - end, "%i", (int)(int64_t)value);
+			}
+			else if (!strchr("hljztL", *cur))
+			{
+				spec[end++] = *cur;
+			}
+		}
+
+		if (conv == 's')
+		{
+			// Binary logs may be broken, the 0 must be there
+			if (pos >= msg->len || (str = memchr(msg->args + pos, '\0', msg->len - pos)) == NULL)
+			{
+				return;
+			}
+
+			spec[end++] = 's';
+			spec[end] = '\0';
+
+			len = snprintf(buf + used, size - used, spec, msg->args + pos);
+			pos = str - msg->args + 1;
+		}
+		else
+		{
+			if (!log_unpack_number(msg, &pos, &value))
+			{
+				return;
+			}
+
+			if (strchr("aAeEfFgG", conv))
+			{
+				spec[end++] = conv;
+				spec[end] = '\0';
+
+				memcpy(&real, &value, sizeof(real));
+				len = snprintf(buf + used, size - used, spec, real);
+			}
+			else if (conv == 'p')
+			{
+				spec[end++] = 'p';
+				spec[end] = '\0';
+
+				len = snprintf(buf + used, size - used, spec, (void *)(uintptr_t)value);
+			}
+			else if (conv == 'c')
+			{
+				spec[end++] = 'c';
+				spec[end] = '\0';
+
+				len = snprintf(buf + used, size - used, spec, (int)value);
+			}
+			else
+			{
+				spec[end++] = 'l';
+				spec[end++] = 'l';
+				spec[end++] = conv;
+				spec[end] = '\0';
+
+				len = snprintf(buf + used, size - used, spec, (long long)value);
+			}
+		}
+
+		if (len < 0)
+		{
+			return;
+		}
+
+		used = (size_t)len < size - used ? used + len : size - 1;
+	}
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                          Public Interface                         *
+ *                                                                   *
+ *********************************************************************/
+
+char
+log_conversion(const char **fmt, uint32_t *stars)
+{
+	const char *cur;
+
+	cur = *fmt + 1;
+	*stars = 0;
+
+	while (*cur && strchr("-+ #0123456789.*hljztL", *cur))
+	{
+		if (*cur == '*')
+		{
+			(*stars)++;
+		}
+
+		cur++;
+	}
+
+	*fmt = *cur ? cur + 1 : cur;
+
+	return *cur;
+}
+
+
+void
+log_render(char *buf, size_t len, const char *msgtime, const log_message *msg, boolean callsite)
+{
+	char status[32];
+	char text[LOGMSG + 256];
+
+	assert(buf);
+	assert(msgtime);
+	assert(msg);
+
+	log_typetostr(msg->type, status, sizeof(status));
+	log_unpack(text, sizeof(text), msg);
+
+	// Prepend informational stuff
+	if (callsite)
+	{
+		snprintf(buf, len, "%s [%s] (%s:%i): %s\n", msgtime, status, msg->func, msg->line, text);
+	}
+	else
+	{
+		snprintf(buf, len, "%s [%s]: %s\n", msgtime, status, text);
+	}
+}
+
+boolean
+log_time(char *buf, size_t len, int64_t time)
+{
+	struct tm t;
+	time_t tmp;
+
+	tmp = time;
+
+	if (localtime_r(&tmp, &t) == NULL)
+	{
+		return FALSE;
+	}
+
+	strftime(buf, len, "%m-%d-%Y %H:%M:%S", &t);
+
+	return TRUE;
+}
@@ -0,0 +1,60 @@
+/*
+ * logrender.h
+ * -----------
+ *
+ * Turns packed log messages into lines of the
+ * text log. Shared by the log writer and by
+ * touka-logdump.
+ */
+
+#ifndef LOGRENDER_H_
+#define LOGRENDER_H_
+
+// --------
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "main.h"
+
+// --------
+
+/*
+ * Parses a conversion of a format string. 'fmt'
+ * points to the '%'. Returns the character of
+ * the conversion, 0 at the end of the string.
+ *
+ * fmt: Conversion to parse, moved behind it
+ * stars: Number of '*' in it
+ */
+char log_conversion(const char **fmt, uint32_t *stars);
+
+/*
+ * Renders a message into a line of the text
+ * log, including the line break. The message
+ * is formatted like vsnprintf() would have
+ * done with the original arguments.
+ *
+ * buf: Buffer to render into
+ * len: Length of the buffer
+ * msgtime: Time of the message, see log_time()
+ * msg: Message to render
+ * callsite: Print function and line
+ */
+void log_render(char *buf, size_t len, const char *msgtime, const log_message *msg, boolean callsite);
+
+/*
+ * Formats the time of a message for the
+ * text log. Returns false if the time can't
+ * be converted.
+ *
+ * buf: Buffer to format into
+ * len: Length of the buffer
+ * time: Time to format
+ */
+boolean log_time(char *buf, size_t len, int64_t time);
+
+// --------
+
+#endif // LOGRENDER_H_
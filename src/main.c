@@ -108,7 +108,7 @@ main(int argc, char *argv[])
 	}
 
 	// Load the game
-	game_init(gamefile);
+	game_init(gamefile, homedir);
 
 	// Initialize savegames
 	save_init(homedir);
@@ -18,9 +18,21 @@
 // Applicaction name
 #define APPNAME "Touka"
 
+// Size of the memory blocks holding the game data
+#define ARENABLOCK (1024 * 1024)
+
 // Program Author
 #define AUTHOR "Yamagi Burmeister"
 
+// Max. memory used by bodies loaded on demand
+#define BODYCACHE (16 * 1024 * 1024)
+
+// Directory with cached game images
+#define CACHEDIR "cache"
+
+// Max. number of choices per scene. Must be a single digit
+#define CHOICES 9
+
 // Game file
 #define GAMEFILE ""
 
@@ -36,23 +48,72 @@
 // Size of input buffer
 #define INPUTBUF 512
 
+// Journal records appended before the journal
+// is replaced by a fresh savegame
+#define JOURNALSIZE 1024
+
+// Bodies of bigger game files are loaded on
+// demand, 0 means never
+#define LAZYSIZE (256 * 1024 * 1024)
+
 // Log directory
 #define LOGDIR "log"
 
+// Environment variable with the log levels
+// of the modules, see log.h
+#define LOGENV "TOUKA_LOG"
+
+// Format strings of log messages whose
+// conversions are parsed only once, must
+// be a power of 2
+#define LOGFORMATS 512
+
+// Log messages below this type are removed
+// at compile time
+#define LOGLEVEL LOG_INFO
+
+// Write the log in binary, it's rendered
+// by touka-logdump. Cheaper than text, the
+// messages aren't formatted at all
+#define LOGBINARY 0
+
+// Room for the arguments of a log message,
+// longer strings are cut
+#define LOGMSG 256
+
 // Log name
 #define LOGNAME "log"
 
 // Number of log segments to keep
 #define LOGNUM 15
 
+// Log messages waiting to be written, more
+// are dropped
+#define LOGRING 1024
+
+// Minimal size of the parts of the game file
+// parsed in parallel
+#define PARSERCHUNK (1024 * 1024)
+
+// Threads parsing the game file, 0 means one
+// per CPU
+#define PARSERTHREADS 0
+
 // Version number
 #define VERSION "1.0"
 
 // Number of lines in the scrollback buffer
 #define SCROLLBACK 512
 
+// Size of the stack signal handlers run on
+#define SIGNALSTACK (64 * 1024)
+
 // Length of the status line
 #define STATUSBAR 128
+
+// Memory for changes that can be undone
+// with 'back', 0 disables it
+#define UNDOSIZE (64 * 1024)
 // Number of lines the text window scrolls
 #define VSCROLLOFF 5
 
@@ -6,15 +6,25 @@
  * written implementation is not that robust if you
  * might expect. if an * error is detected, it just
  * bails out.
+ *
+ * Big files are split behind section separators and
+ * the parts are parsed in parallel. The results are
+ * merged in file order, so the outcome is the same
+ * as when parsing line by line.
  */
 
-#define _WITH_GETLINE
+#define LOG_MODULE LOG_PARSER
 
 #include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include "curses.h"
@@ -22,19 +32,178 @@
 #include "log.h"
 #include "misc.h"
 #include "quit.h"
+#include "scan.h"
 
 #include "i18n/i18n.h"
 
 // --------
 
-// What we are parsing?
-static boolean is_glossary;
-static boolean is_header;
-static boolean is_room;
-static boolean is_scene;
+/*
+ * A token. Points into the mapped game
+ * file, so it's not terminated.
+ */
+typedef struct
+{
+	const char *start;
+	size_t len;
+} parser_token;
+
+/*
+ * The tokens of a line. The tokens are
+ * consumed from the front.
+ */
+typedef struct
+{
+	parser_token *spans;
+	uint32_t first;
+	uint32_t count;
+	uint32_t size;
+} parser_line;
+
+/*
+ * Walks over the lines of a part of the game
+ * file. Each block of SCAN_BLOCK bytes is
+ * classified once, the lines and their tokens
+ * are taken from the masks.
+ */
+typedef struct
+{
+	// Current block, its length and the
+	// first byte not walked yet
+	const char *block;
+	uint32_t len;
+	uint32_t pos;
+
+	// End of the lines
+	const char *end;
+
+	// End of the mapping, blocks may be
+	// read up to here
+	const char *limit;
 
-// Lines parsed so far
-static int32_t count;
+	// Masks of the current block
+	uint64_t masks[SCAN_CLASSES];
+
+	// The last line was a comment
+	boolean comment;
+} parser_scanner;
+
+// --------
+
+// Kinds of objects
+enum
+{
+	PARSER_GLOSSARY,
+	PARSER_ROOM,
+	PARSER_SCENE
+};
+
+/*
+ * An object parsed by a chunk. The word IDs
+ * of the description are kept by the chunk
+ * until they're merged.
+ */
+typedef struct
+{
+	uint8_t kind;
+	void *data;
+	size_t text;
+} parser_object;
+
+/*
+ * A part of the game file. Each chunk has its
+ * own state and puts everything into its own
+ * arena and dictionary, so chunks can be parsed
+ * in parallel. Afterwards they're merged into
+ * the game in order.
+ */
+typedef struct
+{
+	// Lines to parse
+	const char *start;
+	const char *end;
+
+	// End of the mapped game file
+	const char *limit;
+
+	// Lines parsed so far
+	int32_t count;
+
+	// Line of the first error, 0 if none
+	int32_t error;
+
+	// Runs in its own thread
+	boolean threaded;
+	pthread_t thread;
+
+	// Stop when the header is parsed
+	boolean header_only;
+
+	// Only remember where the bodies are
+	boolean lazy;
+
+	// What we are parsing?
+	boolean is_glossary;
+	boolean is_header;
+	boolean is_room;
+	boolean is_scene;
+
+	// Objects currently parsed
+	game_glossary_s *glossary;
+	game_room_s *room;
+	game_scene_s *scene;
+
+	// Word IDs of all descriptions, back to back
+	struct
+	{
+		uint32_t *ids;
+		size_t start;
+		size_t size;
+		uint32_t words;
+		boolean paragraph;
+
+		// First and behind the last word, if lazy
+		const char *body;
+		const char *last;
+	} text;
+
+	// Holds everything parsed
+	arena *pool;
+	dict *words;
+
+	// Interned strings, moved into 'game_names'
+	// when merged. Tokens are joined in 'scratch'
+	// before they're interned
+	arena *strings;
+	strpool *names;
+	char *scratch;
+	size_t scratch_size;
+
+	// ID of the paragraph end
+	uint32_t paragraph;
+
+	// Objects parsed, in order
+	parser_object *objects;
+	uint32_t elements;
+	uint32_t size;
+
+	// Tokens of the current line
+	parser_line tokens;
+} parser_chunk;
+
+/*
+ * Game file, kept mapped if bodies are loaded
+ * on demand. Size and time of the last change
+ * tell if it was changed since it was parsed.
+ */
+static struct
+{
+	char *game;
+	size_t size;
+
+	int fd;
+	time_t mtime;
+} source = {NULL, 0, -1};
 
 // --------
 
@@ -45,134 +214,673 @@ static int32_t count;
  *********************************************************************/
 
 /*
- * Concanates elements of a linked list
- * filled with strings into one string.
- * The string is allocated with malloc(),
- * so the caller need to free() it.
+ * Returns the length of the remaining tokens
+ * of the current line, joined by spaces.
  *
- * tokens: List to concanate
+ * tokens: Line to measure
  */
-static char
-*parser_concat(list *tokens)
+static size_t
+parser_length(const parser_line *tokens)
 {
-	char *cur;
-	char *string;
-	size_t len, oldlen;
+	size_t len;
+	uint32_t i;
 
 	assert(tokens);
 
 	len = 0;
-	string = NULL;
+
+	for (i = 0; i < tokens->count; i++)
+	{
+		len += tokens->spans[tokens->first + i].len + (i ? 1 : 0);
+	}
+
+	return len;
+}
+
+/*
+ * Joins the remaining tokens of the current
+ * line by spaces and consumes them. There must
+ * be space for parser_length() bytes and the
+ * terminating '\0'.
+ *
+ * tokens: Line to join
+ * string: Buffer for the string
+ */
+static void
+parser_join(parser_line *tokens, char *string)
+{
+	const parser_token *cur;
+	size_t pos;
+
+	assert(tokens);
+	assert(string);
+
+	pos = 0;
 
 	while (tokens->count > 0)
 	{
-		cur = list_shift(tokens);
+		cur = &tokens->spans[tokens->first];
+		tokens->first++;
+		tokens->count--;
+
+		memcpy(string + pos, cur->start, cur->len);
+		pos += cur->len;
 
-		if (!string)
+		if (tokens->count > 0)
 		{
-			oldlen = 0;
-			len = strlen(cur) + 2;
+			string[pos] = ' ';
+			pos++;
 		}
-		else
+	}
+
+	string[pos] = '\0';
+}
+
+/*
+ * Concanates the remaining tokens of the
+ * current line into one string. The string
+ * is allocated in the chunks arena and is
+ * always terminated, even without tokens.
+ *
+ * chunk: Chunk to concanate the tokens of
+ */
+static char
+*parser_concat(parser_chunk *chunk)
+{
+	char *string;
+	size_t len;
+
+	assert(chunk);
+
+	len = parser_length(&chunk->tokens);
+
+	// parser_join() writes the '\0' behind len
+	string = arena_alloc(chunk->pool, len + 1);
+	parser_join(&chunk->tokens, string);
+
+	return string;
+}
+
+/*
+ * Like parser_concat(), but the string is
+ * interned in the chunks string pool.
+ *
+ * chunk: Chunk to concanate the tokens of
+ */
+static const char
+*parser_intern(parser_chunk *chunk)
+{
+	size_t len;
+
+	assert(chunk);
+
+	len = parser_length(&chunk->tokens);
+
+	if (len + 1 > chunk->scratch_size)
+	{
+		chunk->scratch_size = len + 1 > 256 ? len + 1 : 256;
+
+		if ((chunk->scratch = realloc(chunk->scratch, chunk->scratch_size)) == NULL)
 		{
-			oldlen = len;
-			len += strlen(string) + strlen(cur) + 2;
+			quit_error(POUTOFMEM);
 		}
+	}
+
+	parser_join(&chunk->tokens, chunk->scratch);
+
+	return strpool_add(chunk->names, chunk->scratch, len);
+}
 
-		if ((string = realloc(string, len)) == NULL)
+/*
+ * This function prints a more or less
+ * helpfull error message and bails out.
+ * Threads just remember the error and
+ * end, the error is printed when all
+ * threads are done.
+ *
+ * chunk: Chunk with the error
+ */
+static void
+parser_error(parser_chunk *chunk)
+{
+	assert(chunk);
+
+	if (chunk->threaded)
+	{
+		chunk->error = chunk->count;
+		pthread_exit(NULL);
+	}
+
+	log_error_f("%s %i\n", i18n_parser_error, chunk->count);
+
+	quit_error(PPARSERERR);
+}
+
+/*
+ * Checks if a token is the given keyword.
+ *
+ * token: Token to check
+ * keyword: Keyword to compare against
+ */
+static boolean
+parser_is(const parser_token *token, const char *keyword)
+{
+	assert(token);
+	assert(keyword);
+
+	return token->len == strlen(keyword) && !memcmp(token->start, keyword, token->len);
+}
+
+/*
+ * Returns the first remaining token of a
+ * line and removes it.
+ *
+ * tokens: Line to take the token from
+ */
+static const parser_token
+*parser_shift(parser_line *tokens)
+{
+	assert(tokens);
+	assert(tokens->count);
+
+	tokens->count--;
+
+	return &tokens->spans[tokens->first++];
+}
+
+/*
+ * Puts the token removed by the last call
+ * to parser_shift() back.
+ *
+ * tokens: Line to put the token back
+ */
+static void
+parser_unshift(parser_line *tokens)
+{
+	assert(tokens);
+	assert(tokens->first);
+
+	tokens->first--;
+	tokens->count++;
+}
+
+/*
+ * Copies a token into the chunks arena.
+ *
+ * chunk: Chunk the token belongs to
+ * token: Token to copy
+ */
+static char
+*parser_strdup(parser_chunk *chunk, const parser_token *token)
+{
+	assert(chunk);
+	assert(token);
+
+	return arena_strndup(chunk->pool, token->start, token->len);
+}
+
+/*
+ * Appends a token to a line.
+ *
+ * tokens: Line to append to
+ * start: Start of the token
+ * end: End of the token
+ */
+static void
+parser_push_token(parser_line *tokens, const char *start, const char *end)
+{
+	assert(tokens);
+
+	if (tokens->count == tokens->size)
+	{
+		tokens->size = tokens->size ? tokens->size * 2 : 64;
+
+		if ((tokens->spans = realloc(tokens->spans, tokens->size * sizeof(parser_token))) == NULL)
 		{
 			quit_error(POUTOFMEM);
 		}
+	}
 
-		memset(string + oldlen, 0, len - oldlen);
-		misc_strlcat(string, cur, len);
+	tokens->spans[tokens->count].start = start;
+	tokens->spans[tokens->count].len = end - start;
+	tokens->count++;
+}
 
-		if (tokens->count > 0)
+/*
+ * Classifies the block the scanner is at. Whole
+ * blocks are classified as long as they're in
+ * the mapping, the bits behind the end of the
+ * lines are cleared. Only at the end of the
+ * mapping the block is padded.
+ *
+ * scan: Scanner to classify the block of
+ */
+static void
+parser_scan_block(parser_scanner *scan)
+{
+	uint32_t i;
+
+	assert(scan);
+
+	scan->pos = 0;
+	scan->len = scan->end - scan->block < SCAN_BLOCK ? scan->end - scan->block : SCAN_BLOCK;
+
+	if (!scan->len)
+	{
+		return;
+	}
+
+	if (scan->limit - scan->block < SCAN_BLOCK)
+	{
+		scan_block(scan->block, scan->len, scan->masks);
+
+		return;
+	}
+
+	scan_block(scan->block, SCAN_BLOCK, scan->masks);
+
+	if (scan->len < SCAN_BLOCK)
+	{
+		for (i = 0; i < SCAN_CLASSES; i++)
 		{
-			misc_strlcat(string, " ", len);
+			scan->masks[i] &= ((uint64_t)1 << scan->len) - 1;
 		}
 	}
-
-	return string;
 }
 
 /*
- * This function prints a more or less
- * helpfull error message and bails out.
+ * Prepares a scanner for the lines between
+ * start and end.
+ *
+ * scan: Scanner to prepare
+ * start: Start of the first line
+ * end: End of the last line
+ * limit: End of the mapping, at least end
  */
 static void
-parser_error(void)
+parser_scan_start(parser_scanner *scan, const char *start, const char *end, const char *limit)
 {
-	log_error_f("%s %i\n", i18n_parser_error, count);
+	assert(scan);
+	assert(start <= end && end <= limit);
 
-	quit_error(PPARSERERR);
+	scan->block = start;
+	scan->end = end;
+	scan->limit = limit;
+	scan->comment = FALSE;
+
+	parser_scan_block(scan);
 }
 
 /*
- * Tokenize a line into a linked list with
- * the single words. If the first character
- * is the comment symbol (for us the line
- * doesn't exists and should be skipped)
- * NULL is returned. Otherwise the list.
+ * Tokenizes the next line into single words and
+ * returns its start, or NULL if there are no more
+ * lines. If the first character is the comment
+ * symbol, the line has no tokens and the comment
+ * flag of the scanner is set. The tokens point
+ * into the line, no memory is allocated unless
+ * the line has more words than any line before.
+ *
+ * Tokens are found by walking the space bitmask,
+ * the line ends at the next bit in the newline
+ * bitmask.
  *
- * line: Line to tokenize
+ * scan: Scanner to take the line from
+ * tokens: Filled with the tokens
  */
-static list
-*parser_tokenize(char *line)
+static const char
+*parser_scan_line(parser_scanner *scan, parser_line *tokens)
 {
-	char *token;
-	char *work;
-	list *tokens;
-	size_t len;
-	uint16_t i;
+	boolean stopped;
+	const char *end;
+	const char *line;
+	const char *token;
+	uint32_t eol;
+	uint32_t i;
+	uint32_t limit;
+	uint64_t newline;
+	uint64_t rest;
+	uint64_t stop;
+
+	assert(scan);
+	assert(tokens);
 
-	assert(line);
+	line = scan->block + scan->pos;
 
-	// Line is comment
-	if (line[0] == '#')
+	if (line >= scan->end)
 	{
 		return NULL;
 	}
 
-	work = line;
-	tokens = list_create();
+	tokens->first = 0;
+	tokens->count = 0;
+
+	// Line is comment
+	scan->comment = (line[0] == '#');
+	stopped = scan->comment;
+	token = NULL;
 
-	// Strip whitespaces
-	while (work[0] == ' ')
+	while (TRUE)
 	{
-		work++;
+		newline = scan->masks[SCAN_NEWLINE] & (~(uint64_t)0 << scan->pos);
+		eol = newline ? scan_first(newline) : scan->len;
+
+		if (!stopped)
+		{
+			// Comments end the line. So does a
+			// NUL, like when lines were C strings
+			stop = scan->masks[SCAN_STOP] & (~(uint64_t)0 << scan->pos);
+			limit = eol;
+
+			if (stop && scan_first(stop) < eol)
+			{
+				limit = scan_first(stop);
+				stopped = TRUE;
+			}
+
+			for (i = scan->pos; i < limit;)
+			{
+				if (!token)
+				{
+					// Skip spaces
+					if ((rest = ~scan->masks[SCAN_SPACE] & (~(uint64_t)0 << i)) == 0)
+					{
+						break;
+					}
+
+					if ((i = scan_first(rest)) >= limit)
+					{
+						break;
+					}
+
+					token = scan->block + i;
+				}
+				else
+				{
+					// Find the end of the token
+					if ((rest = scan->masks[SCAN_SPACE] & (~(uint64_t)0 << i)) == 0)
+					{
+						break;
+					}
+
+					if ((i = scan_first(rest)) >= limit)
+					{
+						break;
+					}
+
+					parser_push_token(tokens, token, scan->block + i);
+					token = NULL;
+				}
+			}
+
+			if (stopped && token)
+			{
+				parser_push_token(tokens, token, scan->block + limit);
+				token = NULL;
+			}
+		}
+
+		if (newline)
+		{
+			end = scan->block + eol;
+			scan->pos = eol + 1;
+
+			if (scan->pos == scan->len)
+			{
+				scan->block += scan->len;
+				parser_scan_block(scan);
+			}
+
+			break;
+		}
+
+		scan->block += scan->len;
+		parser_scan_block(scan);
+
+		if (!scan->len)
+		{
+			end = scan->end;
+
+			break;
+		}
 	}
 
-	len = strlen(work);
+	if (token)
+	{
+		parser_push_token(tokens, token, end);
+	}
 
-	while (work[len] == ' ')
+	return line;
+}
+
+/*
+ * Appends a word to the description of the
+ * object currently parsed. The word is added
+ * to the chunks dictionary. If the bodies are
+ * loaded on demand, the word is just counted.
+ *
+ * chunk: Chunk the object belongs to
+ * word: Word to append, needn't be terminated
+ * len: Length of the word
+ */
+static void
+parser_text_add(parser_chunk *chunk, const char *word, size_t len)
+{
+	uint32_t id;
+
+	assert(chunk);
+	assert(word);
+
+	if (chunk->lazy)
 	{
-		work[len] = '\0';
-		work--;
+		if (!chunk->text.words)
+		{
+			chunk->text.body = word;
+		}
+
+		chunk->text.last = word + len;
+		chunk->text.words++;
+		chunk->text.paragraph = FALSE;
+
+		return;
 	}
 
-	// Strip comments
-	for (i = 0; i < strlen(work); i++)
+	if (chunk->text.start + chunk->text.words == chunk->text.size)
 	{
-		if (work[i] == '#')
+		chunk->text.size = chunk->text.size ? chunk->text.size * 2 : 1024;
+
+		if ((chunk->text.ids = realloc(chunk->text.ids, chunk->text.size * sizeof(uint32_t))) == NULL)
 		{
-			work[i] = '\0';
+			quit_error(POUTOFMEM);
+		}
+	}
 
-			break;
+	id = dict_add(chunk->words, word, len);
+
+	chunk->text.ids[chunk->text.start + chunk->text.words] = id;
+	chunk->text.words++;
+	chunk->text.paragraph = (id == chunk->paragraph);
+}
+
+/*
+ * Ends the description of the object currently
+ * parsed. A paragraph end at the end of the
+ * description is dropped. The words stay in the
+ * chunk until it's merged, the offset of the
+ * first word is returned.
+ *
+ * chunk: Chunk the object belongs to
+ * dst: Text to fill
+ */
+static size_t
+parser_text_finish(parser_chunk *chunk, game_text_s *dst)
+{
+	size_t offset;
+
+	assert(chunk);
+	assert(dst);
+
+	if (chunk->text.paragraph)
+	{
+		chunk->text.words--;
+	}
+
+	offset = chunk->text.start;
+	dst->words = chunk->text.words;
+
+	if (chunk->lazy && chunk->text.words)
+	{
+		dst->body = chunk->text.body;
+		dst->length = chunk->text.last - chunk->text.body;
+	}
+
+	chunk->text.start += chunk->text.words;
+	chunk->text.words = 0;
+	chunk->text.paragraph = FALSE;
+
+	return offset;
+}
+
+/*
+ * Allocates the IDs of a description. Either
+ * from an arena or, if none is given, with
+ * malloc().
+ *
+ * pool: Arena to allocate from, may be NULL
+ * size: Size of the IDs
+ */
+static void
+*parser_text_alloc(arena *pool, size_t size)
+{
+	void *ids;
+
+	if (pool)
+	{
+		return arena_alloc(pool, size);
+	}
+
+	if ((ids = malloc(size)) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	return ids;
+}
+
+/*
+ * Copies the description of an object into the
+ * game. The words are translated from the chunks
+ * dictionary to the games dictionary. 16 bit IDs
+ * are used, if possible.
+ *
+ * dst: Text to fill
+ * ids: Words in the chunks dictionary
+ * map: Maps the chunks IDs to the games IDs, NULL
+ *      if they're already IDs of the game
+ * pool: Arena for the IDs, NULL for malloc()
+ */
+static void
+parser_text_merge(game_text_s *dst, const uint32_t *ids, const uint32_t *map, arena *pool)
+{
+	uint16_t *narrow;
+	uint32_t *wide;
+	uint32_t i;
+	uint32_t id;
+	uint32_t max;
+
+	assert(dst);
+
+	max = 0;
+
+	for (i = 0; i < dst->words; i++)
+	{
+		id = map ? map[ids[i]] : ids[i];
+
+		if (id > max)
+		{
+			max = id;
 		}
 	}
 
-	while ((token = strsep(&work, " \n")) != NULL)
+	if (max > UINT16_MAX)
 	{
-		if (!strlen(token))
+		wide = parser_text_alloc(pool, dst->words * sizeof(uint32_t));
+
+		for (i = 0; i < dst->words; i++)
 		{
-			continue;
+			wide[i] = map ? map[ids[i]] : ids[i];
 		}
 
-		list_push(tokens, token);
+		dst->ids = wide;
+		dst->wide = TRUE;
+	}
+	else
+	{
+		narrow = parser_text_alloc(pool, dst->words * sizeof(uint16_t));
+
+		for (i = 0; i < dst->words; i++)
+		{
+			narrow[i] = map ? map[ids[i]] : ids[i];
+		}
+
+		dst->ids = narrow;
+		dst->wide = FALSE;
+	}
+}
+
+/*
+ * Ends the current paragraph of the description,
+ * if there's a paragraph to end.
+ *
+ * chunk: Chunk the object belongs to
+ */
+static void
+parser_text_paragraph(parser_chunk *chunk)
+{
+	assert(chunk);
+
+	if (chunk->text.words && !chunk->text.paragraph)
+	{
+		if (chunk->lazy)
+		{
+			chunk->text.words++;
+			chunk->text.paragraph = TRUE;
+		}
+		else
+		{
+			parser_text_add(chunk, "\n", 1);
+		}
+	}
+}
+
+/*
+ * Remembers a completly parsed object. It's
+ * added to the game when the chunk is merged.
+ *
+ * chunk: Chunk the object belongs to
+ * kind: Kind of the object
+ * data: The object
+ * text: Offset of the descriptions words
+ */
+static void
+parser_push(parser_chunk *chunk, uint8_t kind, void *data, size_t text)
+{
+	assert(chunk);
+	assert(data);
+
+	if (chunk->elements == chunk->size)
+	{
+		chunk->size = chunk->size ? chunk->size * 2 : 256;
+
+		if ((chunk->objects = realloc(chunk->objects, chunk->size * sizeof(parser_object))) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
 	}
 
-	return tokens;
+	chunk->objects[chunk->elements].kind = kind;
+	chunk->objects[chunk->elements].data = data;
+	chunk->objects[chunk->elements].text = text;
+	chunk->elements++;
 }
 
 // --------
@@ -227,65 +935,68 @@ parser_check_header(void)
  * 'game_header'. Called for every line of the
  * header.
  *
- * tokens: Tokenized line to parse
+ * chunk: Chunk with the tokenized line to parse
  */
 static void
-parser_header(list *tokens)
+parser_header(parser_chunk *chunk)
 {
-	char *cur;
+	const parser_token *cur;
+	parser_line *tokens;
 
-	assert(tokens);
+	assert(chunk);
+
+	tokens = &chunk->tokens;
 
 	while (tokens->count > 0)
 	{
-		cur = list_shift(tokens);
+		cur = parser_shift(tokens);
 
-		if (!strcmp(cur, "%GAME:"))
+		if (parser_is(cur, "%GAME:"))
 		{
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			game_header->game = parser_concat(tokens);
+			game_header->game = parser_concat(chunk);
 		}
-		else if (!strcmp(cur, "%AUTHOR:"))
+		else if (parser_is(cur, "%AUTHOR:"))
 		{
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			game_header->author = parser_concat(tokens);
+			game_header->author = parser_concat(chunk);
 		}
-		else if (!strcmp(cur, "%DATE:"))
+		else if (parser_is(cur, "%DATE:"))
 		{
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			game_header->date = parser_concat(tokens);
+			game_header->date = parser_concat(chunk);
 		}
-		else if (!strcmp(cur, "%UID:"))
+		else if (parser_is(cur, "%UID:"))
 		{
 			if (tokens->count != 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			game_header->uid = strdup(list_shift(tokens));
+			game_header->uid = parser_strdup(chunk, parser_shift(tokens));
 		}
-		else if (!strcmp(cur, "%START:"))
+		else if (parser_is(cur, "%START:"))
 		{
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			game_header->first_scene = parser_concat(tokens);
+			game_header->first_scene = parser_concat(chunk);
 		}
-		else if (!strcmp(cur, "%PROMPT:"))
+		else if (parser_is(cur, "%PROMPT:"))
 		{
 			if (curses_prompt)
 			{
@@ -294,25 +1005,25 @@ parser_header(list *tokens)
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			game_header->prompt = parser_concat(tokens);
+			game_header->prompt = parser_concat(chunk);
 
 		}
-		else if (!strcmp(cur, "----"))
+		else if (parser_is(cur, "----"))
 		{
 			if (tokens->count != 0)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			parser_check_header();
-			is_header = FALSE;
+			chunk->is_header = FALSE;
 		}
 		else
 		{
-			parser_error();
+			parser_error(chunk);
 		}
 	}
 }
@@ -329,68 +1040,64 @@ parser_header(list *tokens)
  * Checks if a glossary entry was parsed successfull.
  * If not, the parser bails out with an error.
  *
+ * chunk: Chunk the entry belongs to
  * entry: Entry to be checked
  */
 static void
-parser_check_glossary(game_glossary_s *entry)
+parser_check_glossary(parser_chunk *chunk, game_glossary_s *entry)
 {
+	assert(chunk);
 	assert(entry);
 
 	if (!entry->name)
 	{
-		parser_error();
+		parser_error(chunk);
 	}
 
 	if (!entry->descr)
 	{
-		parser_error();
+		parser_error(chunk);
 	}
 
-	if (!entry->words)
+	if (!entry->text.words)
 	{
-		parser_error();
-	}
-	else
-	{
-		if (!entry->words->count)
-		{
-			parser_error();
-		}
-	}
-
-	if (!entry->aliases)
-	{
-		log_info_f("%s: %s (0 %s, %i %s)", i18n_parser_glossaryentry,
-				   entry->name, i18n_aliases, entry->words->count, i18n_words);
-	}
-	else
-	{
-		log_info_f("%s: %s (%i %s, %i %s)", i18n_parser_glossaryentry,
-				   entry->name, entry->aliases->count, i18n_aliases, entry->words->count, i18n_words);
+		parser_error(chunk);
 	}
 }
 
 /*
  * Adds an entry to the global glossary. If an
  * entry with the same name or alias is already
- * present, a warning is logged.
+ * present, a warning is logged. Called when the
+ * chunk is merged, so only from the main thread.
  *
  * entry: Entry to add
  */
 static void
 parser_add_glossary(game_glossary_s *entry)
 {
+	game_id id;
 	listnode *lnode;
 	uint16_t i;
 
-	parser_check_glossary(entry);
+	if (!entry->aliases)
+	{
+		log_info_f("%s: %s (0 %s, %i %s)", i18n_parser_glossaryentry,
+				   entry->name, i18n_aliases, entry->text.words, i18n_words);
+	}
+	else
+	{
+		log_info_f("%s: %s (%i %s, %i %s)", i18n_parser_glossaryentry,
+				   entry->name, entry->aliases->count, i18n_aliases, entry->text.words, i18n_words);
+	}
 
-	if (hashmap_get(game_glossary, entry->name) != NULL)
+	if (game_symbol_find(entry->name, GAME_GLOSSARY))
 	{
 		log_warn_f("%s %s", i18n_parser_glossarytwice, entry->name);
 	}
 
-	hashmap_add(game_glossary, entry->name, entry, FALSE);
+	entry->id = id = game_object_add(GAME_GLOSSARY, entry);
+	game_symbol_add(entry->name, id);
 	game_stats->glossary_total++;
 
 	// Aliases
@@ -402,13 +1109,13 @@ parser_add_glossary(game_glossary_s *entry)
 
 			for (i = 0; i < entry->aliases->count; i++)
 			{
-				if (hashmap_get(game_glossary, lnode->data) != NULL)
+				if (game_symbol_find(lnode->data, GAME_GLOSSARY))
 				{
 					log_warn_f("%s %s", i18n_parser_glossarytwice, entry->name);
 				}
 			}
 
-			hashmap_add(game_glossary, lnode->data, entry, TRUE);
+			game_symbol_add(lnode->data, id);
 		}
 	}
 }
@@ -417,124 +1124,104 @@ parser_add_glossary(game_glossary_s *entry)
  * Parses a glossary entry into a 'game_glossary_s' struct.
  * If necessary the struct is created. This function is
  * called for every line of the entry and if it's complete
- * it's automatically added to the global 'game_glossar'
- * hashmap.
+ * it's remembered until the chunk is merged into the
+ * global symbol table.
  *
- * tokens: Tokenized line to parse
+ * chunk: Chunk with the tokenized line to parse
  */
 static void
-parser_glossary(list *tokens)
+parser_glossary(parser_chunk *chunk)
 {
-	char *cur;
-	static game_glossary_s *entry;
-	uint16_t i;
+	const parser_token *cur;
+	parser_line *tokens;
+	size_t offset;
+	game_glossary_s *entry;
 
-	assert(tokens);
+	assert(chunk);
 
-	if (!entry)
+	if (!chunk->glossary)
 	{
-		if ((entry = calloc(1, sizeof(game_glossary_s))) == NULL)
-		{
-			quit_error(POUTOFMEM);
-		}
+		chunk->glossary = arena_alloc(chunk->pool, sizeof(game_glossary_s));
 	}
 
+	tokens = &chunk->tokens;
+	entry = chunk->glossary;
+
 	// Empty input line
 	if (!tokens->count)
 	{
-		if (entry->words)
-		{
-			if (entry->words->last)
-			{
-				if (strcmp(entry->words->last->data, "\n"))
-				{
-					list_push(entry->words, strdup("\n"));
-				}
-			}
-		}
+		parser_text_paragraph(chunk);
 	}
 
 	while (tokens->count > 0)
 	{
-		cur = list_shift(tokens);
+		cur = parser_shift(tokens);
 
-		if (!strcmp(cur, "%GLOSSARY:"))
+		if (parser_is(cur, "%GLOSSARY:"))
 		{
-			if (entry->name || entry->words)
+			if (entry->name || chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			entry->name = parser_concat(tokens);
+			entry->name = parser_intern(chunk);
 		}
-		else if (!strcmp(cur, "%DESCR:"))
+		else if (parser_is(cur, "%DESCR:"))
 		{
-			if (entry->words)
+			if (chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			entry->descr = parser_concat(tokens);
+			entry->descr = parser_intern(chunk);
 		}
-		else if (!strcmp(cur, "%ALIAS:"))
+		else if (parser_is(cur, "%ALIAS:"))
 		{
-			if (entry->words)
+			if (chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (!entry->aliases)
 			{
-				entry->aliases = list_create();
+				entry->aliases = list_create_arena(chunk->pool);
 			}
 
-			list_push(entry->aliases, parser_concat(tokens));
+			list_push(entry->aliases, (char *)parser_intern(chunk));
 		}
-		else if (!strcmp(cur, "----"))
+		else if (parser_is(cur, "----"))
 		{
-			if (entry->words)
-			{
-				if (entry->words->last)
-				{
-					while (!strcmp(entry->words->last->data, "\n"))
-					{
-						free(list_pop(entry->words));
-					}
-				}
-			}
+			offset = parser_text_finish(chunk, &entry->text);
 
-			parser_add_glossary(entry);
+			parser_check_glossary(chunk, entry);
+			parser_push(chunk, PARSER_GLOSSARY, entry, offset);
 
-			is_glossary = FALSE;
-			entry = NULL;
+			chunk->is_glossary = FALSE;
+			chunk->glossary = NULL;
 		}
 		else
 		{
-			if (!entry->words)
-			{
-				entry->words = list_create();
-			}
-
-			list_push(entry->words, strdup(cur));
+			parser_text_add(chunk, cur->start, cur->len);
 
-			for (i = 0; tokens->count; i++)
+			while (tokens->count > 0)
 			{
-				list_push(entry->words, strdup(list_shift(tokens)));
+				cur = parser_shift(tokens);
+				parser_text_add(chunk, cur->start, cur->len);
 			}
 		}
 	}
@@ -552,50 +1239,33 @@ parser_glossary(list *tokens)
  * Checks if a room was parsed successfull.
  * If not the parser bails out with an error.
  *
+ * chunk: Chunk the room belongs to
  * room: Room to be checked
  */
 static void
-parser_check_room(game_room_s *room)
+parser_check_room(parser_chunk *chunk, game_room_s *room)
 {
+	assert(chunk);
 	assert(room);
 
 	if (!room->name)
 	{
-		parser_error();
+		parser_error(chunk);
 	}
 
 	if (!room->descr)
 	{
-		parser_error();
-	}
-
-	if (!room->words)
-	{
-		parser_error();
-	}
-	else
-	{
-		if (!room->words->count)
-		{
-			parser_error();
-		}
+		parser_error(chunk);
 	}
 
-	if (!room->aliases)
+	if (!room->text.words)
 	{
-		log_info_f("%s: %s (0 %s, %i %s)", i18n_room, room->name,
-				   i18n_aliases, room->words->count, i18n_words);
-	}
-	else
-	{
-		log_info_f("%s: %s (%i %s, %i %s)", i18n_room, room->name,
-				   room->aliases->count, i18n_aliases, room->words->count,
-				   i18n_words);
+		parser_error(chunk);
 	}
 }
 
 /*
- * Add the room to the global 'game_rooms' hashmap.
+ * Adds the room to the global symbol table.
  * If there's already an entry with the same name or
  * alias a warning is logged.
  *
@@ -604,17 +1274,29 @@ parser_check_room(game_room_s *room)
 static void
 parser_add_room(game_room_s *room)
 {
+	game_id id;
 	listnode *lnode;
 	uint16_t i;
 
-	parser_check_room(room);
+	if (!room->aliases)
+	{
+		log_info_f("%s: %s (0 %s, %i %s)", i18n_room, room->name,
+				   i18n_aliases, room->text.words, i18n_words);
+	}
+	else
+	{
+		log_info_f("%s: %s (%i %s, %i %s)", i18n_room, room->name,
+				   room->aliases->count, i18n_aliases, room->text.words,
+				   i18n_words);
+	}
 
-	if (hashmap_get(game_rooms, room->name) != NULL)
+	if (game_symbol_find(room->name, GAME_ROOM))
 	{
 		log_warn_f("%s %s", i18n_parser_roomtwice, room->name);
 	}
 
-	hashmap_add(game_rooms, room->name, room, FALSE);
+	room->id = id = game_object_add(GAME_ROOM, room);
+	game_symbol_add(room->name, id);
 	game_stats->rooms_total++;
 
 	// Aliases
@@ -626,12 +1308,12 @@ parser_add_room(game_room_s *room)
 
 			for (i = 0; i < room->aliases->count; i++)
 			{
-				if (hashmap_get(game_rooms, lnode->data) != NULL)
+				if (game_symbol_find(lnode->data, GAME_ROOM))
 				{
 					log_warn_f("%s %s", i18n_parser_roomtwice, room->name);
 				}
 
-				hashmap_add(game_rooms, lnode->data, room, TRUE);
+				game_symbol_add(lnode->data, id);
 				lnode = lnode->next;
 			}
 		}
@@ -642,124 +1324,104 @@ parser_add_room(game_room_s *room)
  * Parses a room into a 'game_room_s' struct. The
  * struct is created if necessary. This function
  * is called for every line of the room. When the
- * room is completly parsed, it's automatically
- * added to the global 'game_rooms' hashmap.
+ * room is completly parsed, it's remembered until
+ * the chunk is merged.
  *
- * tokens: Tokenized line to parse
+ * chunk: Chunk with the tokenized line to parse
  */
 static void
-parser_room(list *tokens)
+parser_room(parser_chunk *chunk)
 {
-	char *cur;
-	static game_room_s *room;
-	uint16_t i;
+	const parser_token *cur;
+	parser_line *tokens;
+	size_t offset;
+	game_room_s *room;
 
-	assert(tokens);
+	assert(chunk);
 
-	if (!room)
+	if (!chunk->room)
 	{
-		if ((room = calloc(1, sizeof(game_room_s))) == NULL)
-		{
-			quit_error(POUTOFMEM);
-		}
+		chunk->room = arena_alloc(chunk->pool, sizeof(game_room_s));
 	}
 
+	tokens = &chunk->tokens;
+	room = chunk->room;
+
 	// Empty input line
 	if (!tokens->count)
 	{
-		if (room->words)
-		{
-			if (room->words->last)
-			{
-				if (strcmp(room->words->last->data, "\n"))
-				{
-					list_push(room->words, strdup("\n"));
-				}
-			}
-		}
+		parser_text_paragraph(chunk);
 	}
 
 	while (tokens->count > 0)
 	{
-		cur = list_shift(tokens);
+		cur = parser_shift(tokens);
 
-		if (!strcmp(cur, "%ROOM:"))
+		if (parser_is(cur, "%ROOM:"))
 		{
-			if (room->name || room->words)
+			if (room->name || chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			room->name = parser_concat(tokens);
+			room->name = parser_intern(chunk);
 		}
-		else if (!strcmp(cur, "%DESCR:"))
+		else if (parser_is(cur, "%DESCR:"))
 		{
-			if (room->words)
+			if (chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			room->descr = parser_concat(tokens);
+			room->descr = parser_intern(chunk);
 		}
-		else if (!strcmp(cur, "%ALIAS:"))
+		else if (parser_is(cur, "%ALIAS:"))
 		{
-			if (room->words)
+			if (chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (!room->aliases)
 			{
-				room->aliases = list_create();
+				room->aliases = list_create_arena(chunk->pool);
 			}
 
-			list_push(room->aliases, parser_concat(tokens));
+			list_push(room->aliases, (char *)parser_intern(chunk));
 		}
-		else if (!strcmp(cur, "----"))
+		else if (parser_is(cur, "----"))
 		{
-			if (room->words)
-			{
-				if (room->words->last)
-				{
-					while (!strcmp(room->words->last->data, "\n"))
-					{
-						free(list_pop(room->words));
-					}
-				}
-			}
+			offset = parser_text_finish(chunk, &room->text);
 
-			parser_add_room(room);
+			parser_check_room(chunk, room);
+			parser_push(chunk, PARSER_ROOM, room, offset);
 
-			is_room = FALSE;
-			room = NULL;
+			chunk->is_room = FALSE;
+			chunk->room = NULL;
 		}
 		else
 		{
-			if (!room->words)
-			{
-				room->words = list_create();
-			}
-
-			list_push(room->words, strdup(cur));
+			parser_text_add(chunk, cur->start, cur->len);
 
-			for (i = 0; tokens->count > 0; i++)
+			while (tokens->count > 0)
 			{
-				list_push(room->words, strdup(list_shift(tokens)));
+				cur = parser_shift(tokens);
+				parser_text_add(chunk, cur->start, cur->len);
 			}
 		}
 	}
@@ -777,67 +1439,38 @@ parser_room(list *tokens)
  * Checks if a scene was parsed successfull.
  * If not, the parser bails out.
  *
+ * chunk: Chunk the scene belongs to
  * scene: Scene to be checked
  */
 static void
-parser_check_scene(game_scene_s *scene)
+parser_check_scene(parser_chunk *chunk, game_scene_s *scene)
 {
+	assert(chunk);
 	assert(scene);
 
 	if (!scene->name)
 	{
-		parser_error();
+		parser_error(chunk);
 	}
 
 	if (!scene->descr)
 	{
-		parser_error();
+		parser_error(chunk);
 	}
 
-	if (!scene->words)
+	if (!scene->text.words)
 	{
-		parser_error();
-	}
-	else
-	{
-		if (!scene->words->count)
-		{
-			parser_error();
-		}
-	}
-
-	if (!scene->next)
-	{
-		parser_error();
-	}
-	else
-	{
-		if (!scene->next->elements)
-		{
-			parser_error();
-		}
-		else if (scene->next->elements > 9)
-		{
-			parser_error();
-		}
+		parser_error(chunk);
 	}
 
-	if (!scene->aliases)
-	{
-		log_info_f("%s: %s (0 %s, %i %s, %i %s)", i18n_scene, scene->name,
-				   i18n_aliases, scene->next->elements, i18n_choices, scene->words->count,
-				   i18n_words);
-	}
-	else
+	if (!scene->next_count)
 	{
-		log_info_f("%s: %s (%i %s, %i %s, %i %s)", i18n_scene, scene->name,
-				   scene->aliases->count, i18n_aliases, scene->next->elements,
-				   i18n_choices, scene->words->count, i18n_words);
+		parser_error(chunk);
 	}
 }
 
 /*
- * Adds a new scene to the global 'game_scenes' hashmap.
+ * Adds a new scene to the global symbol table.
  * If an entry with the same name or alias is already
  * present, a warnig is logged.
  *
@@ -846,17 +1479,30 @@ parser_check_scene(game_scene_s *scene)
 static void
 parser_add_scene(game_scene_s *scene)
 {
+	game_id id;
 	listnode *lnode;
 	uint16_t i;
 
-	parser_check_scene(scene);
+	if (!scene->aliases)
+	{
+		log_info_f("%s: %s (0 %s, %i %s, %i %s)", i18n_scene, scene->name,
+				   i18n_aliases, scene->next_count, i18n_choices, scene->text.words,
+				   i18n_words);
+	}
+	else
+	{
+		log_info_f("%s: %s (%i %s, %i %s, %i %s)", i18n_scene, scene->name,
+				   scene->aliases->count, i18n_aliases, scene->next_count,
+				   i18n_choices, scene->text.words, i18n_words);
+	}
 
-	if (hashmap_get(game_scenes, scene->name) != NULL)
+	if (game_symbol_find(scene->name, GAME_SCENE))
 	{
 		log_warn_f("%s %s", i18n_parser_scenetwice, scene->name);
 	}
 
-	hashmap_add(game_scenes, scene->name, scene, FALSE);
+	scene->id = id = game_object_add(GAME_SCENE, scene);
+	game_symbol_add(scene->name, id);
 	game_stats->scenes_total++;
 
 	// Aliases
@@ -868,12 +1514,12 @@ parser_add_scene(game_scene_s *scene)
 
 			for (i = 0; i < scene->aliases->count; i++)
 			{
-				if (hashmap_get(game_scenes, lnode->data) != NULL)
+				if (game_symbol_find(lnode->data, GAME_SCENE))
 				{
 					log_warn_f("%s %s", i18n_parser_scenetwice, scene->name);
 				}
 
-				hashmap_add(game_scenes, lnode->data, scene, TRUE);
+				game_symbol_add(lnode->data, id);
 				lnode = lnode->next;
 			}
 		}
@@ -884,171 +1530,152 @@ parser_add_scene(game_scene_s *scene)
  * Parses a scene into a 'game_scene_s' struct. If
  * necessary the struct is created. This function is
  * called for every line of the scene. After it was
- * parsed it's added the global 'game_scenes' hashmap
- * automatically.
+ * parsed it's remembered until the chunk is merged
+ * into the global symbol table.
  *
- * tokens: Tokenized line to parse
+ * chunk: Chunk with the tokenized line to parse
  */
 static void
-parser_scene(list *tokens)
+parser_scene(parser_chunk *chunk)
 {
-	char *cur;
-	static game_scene_s *scene;
-	uint16_t i;
+	const parser_token *cur;
+	parser_line *tokens;
+	size_t offset;
+	game_scene_s *scene;
 
-	assert(tokens);
+	assert(chunk);
 
-	if (!scene)
+	if (!chunk->scene)
 	{
-		if ((scene = calloc(1, sizeof(game_scene_s))) == NULL)
-		{
-			quit_error(POUTOFMEM);
-		}
+		chunk->scene = arena_alloc(chunk->pool, sizeof(game_scene_s));
 	}
 
+	tokens = &chunk->tokens;
+	scene = chunk->scene;
+
 	// Empty input line
 	if (!tokens->count)
 	{
-		if (scene->words)
-		{
-			if (scene->words->last)
-			{
-				if (strcmp(scene->words->last->data, "\n"))
-				{
-					list_push(scene->words, strdup("\n"));
-				}
-			}
-		}
+		parser_text_paragraph(chunk);
 	}
 
 	while (tokens->count > 0)
 	{
-		cur = list_shift(tokens);
+		cur = parser_shift(tokens);
 
-		if (!strcmp(cur, "%SCENE:"))
+		if (parser_is(cur, "%SCENE:"))
 		{
-			if (scene->name || scene->words)
+			if (scene->name || chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			scene->name = parser_concat(tokens);
+			scene->name = parser_intern(chunk);
 		}
-		else if (!strcmp(cur, "%DESCR:"))
+		else if (parser_is(cur, "%DESCR:"))
 		{
-			if (scene->words)
+			if (chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			scene->descr = parser_concat(tokens);
+			scene->descr = parser_intern(chunk);
 		}
-		else if (!strcmp(cur, "%PROMPT:"))
+		else if (parser_is(cur, "%PROMPT:"))
 		{
-			if (scene->words)
+			if (chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			scene->prompt = parser_concat(tokens);
+			scene->prompt = parser_intern(chunk);
 		}
-		else if (!strcmp(cur, "%ALIAS:"))
+		else if (parser_is(cur, "%ALIAS:"))
 		{
-			if (scene->words)
+			if (chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (!scene->aliases)
 			{
-				scene->aliases = list_create();
+				scene->aliases = list_create_arena(chunk->pool);
 			}
 
-			list_push(scene->aliases, parser_concat(tokens));
+			list_push(scene->aliases, (char *)parser_intern(chunk));
 		}
-		else if (!strcmp(cur, "%ROOM:"))
+		else if (parser_is(cur, "%ROOM:"))
 		{
-			if (scene->words)
+			if (chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			scene->room = parser_concat(tokens);
+			scene->room = parser_intern(chunk);
 		}
-		else if (!strcmp(cur, "%NEXT:"))
+		else if (parser_is(cur, "%NEXT:"))
 		{
-			if (scene->words)
+			if (chunk->text.words)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
 			if (tokens->count < 1)
 			{
-				parser_error();
+				parser_error(chunk);
 			}
 
-			if (!scene->next)
+			if (scene->next_count == CHOICES)
 			{
-				scene->next = darray_create();
+				parser_error(chunk);
 			}
 
-			darray_push(scene->next, parser_concat(tokens));
+			scene->next[scene->next_count] = parser_intern(chunk);
+			scene->next_count++;
 		}
-		else if (!strcmp(cur, "----"))
+		else if (parser_is(cur, "----"))
 		{
-			if (scene->words)
-			{
-				if (scene->words->last)
-				{
-					while (!strcmp(scene->words->last->data, "\n"))
-					{
-						free(list_pop(scene->words));
-					}
-				}
-			}
+			offset = parser_text_finish(chunk, &scene->text);
 
-			parser_add_scene(scene);
+			parser_check_scene(chunk, scene);
+			parser_push(chunk, PARSER_SCENE, scene, offset);
 
-			is_scene = FALSE;
-			scene = NULL;
+			chunk->is_scene = FALSE;
+			chunk->scene = NULL;
 		}
 		else
 		{
-			if (!scene->words)
-			{
-				scene->words = list_create();
-			}
+			parser_text_add(chunk, cur->start, cur->len);
 
-			list_push(scene->words, strdup(cur));
-
-			for (i = 0; tokens->count > 0; i++)
+			while (tokens->count > 0)
 			{
-				list_push(scene->words, strdup(list_shift(tokens)));
+				cur = parser_shift(tokens);
+				parser_text_add(chunk, cur->start, cur->len);
 			}
 		}
 	}
@@ -1058,115 +1685,615 @@ parser_scene(list *tokens)
 
 /*********************************************************************
  *                                                                   *
- *                          Public Interface                         *
+ *                          Chunk Handling                           *
  *                                                                   *
  *********************************************************************/
 
-void
-parser_game(const char *file)
+/*
+ * Checks if a line is a section separator,
+ * e.g. nothing but "----". A section ends
+ * at such a line, so the file can be split
+ * behind it.
+ *
+ * start: Start of the line
+ * end: End of the line, without the newline
+ */
+static boolean
+parser_separator(const char *start, const char *end)
 {
-	FILE *game;
-	char *line;
-	char *tmp;
-	list *tokens;
-	size_t linecap;
-	struct stat sb;
+	const char *cur;
 
-	assert(file);
+	assert(start);
+	assert(end);
 
-	if ((stat(file, &sb)) != 0)
+	if (start < end && start[0] == '#')
 	{
-		quit_error(PFILENOTEXIST);
+		return FALSE;
 	}
 
-	if (!S_ISREG(sb.st_mode))
+	for (cur = start; cur < end && *cur == ' '; cur++)
 	{
-		quit_error(PNOTAFILE);
+		continue;
 	}
 
-	if ((game = fopen(file, "r")) == NULL)
+	if (end - cur < 4 || strncmp(cur, "----", 4))
 	{
-		quit_error(PCOULDNTOPENFILE);
+		return FALSE;
 	}
 
-	log_info_f("%s: %s", i18n_parser_parsingfile, file);
+	for (cur += 4; cur < end && *cur == ' '; cur++)
+	{
+		continue;
+	}
+
+	return cur == end || *cur == '#' || *cur == '\0';
+}
+
+/*
+ * Parses all lines of a chunk. Header only
+ * chunks stop after the header, their end
+ * is moved behind it.
+ *
+ * chunk: Chunk to parse
+ */
+static void
+parser_chunk_parse(parser_chunk *chunk)
+{
+	const char *line;
+	const parser_token *tmp;
+	parser_line *tokens;
+	parser_scanner scan;
 
-	line = NULL;
-	linecap = 0;
+	assert(chunk);
 
-	// Header is always the first section
-	is_header = TRUE;
+	tokens = &chunk->tokens;
+	parser_scan_start(&scan, chunk->start, chunk->end, chunk->limit);
 
-	while (getline(&line, &linecap, game) > 0)
+	while ((line = parser_scan_line(&scan, tokens)) != NULL)
 	{
-		count++;
+		if (chunk->header_only && !chunk->is_header)
+		{
+			chunk->end = line;
+
+			break;
+		}
 
-		if ((tokens = parser_tokenize(line)) == NULL)
+		chunk->count++;
+
+		if (scan.comment)
 		{
 			continue;
 		}
 
 		// What we are parsing?
-		if (!(is_glossary || is_header || is_room || is_scene))
+		if (!(chunk->is_glossary || chunk->is_header || chunk->is_room || chunk->is_scene))
 		{
 			if (tokens->count > 0)
 			{
-				tmp = list_shift(tokens);
+				tmp = parser_shift(tokens);
 
-				if (!strcmp(tmp, "%GLOSSARY:"))
+				if (parser_is(tmp, "%GLOSSARY:"))
 				{
-					is_glossary = TRUE;
-					list_unshift(tokens, tmp);
+					chunk->is_glossary = TRUE;
+					parser_unshift(tokens);
 				}
-				else if (!strcmp(tmp, "%ROOM:"))
+				else if (parser_is(tmp, "%ROOM:"))
 				{
-					is_room = TRUE;
-					list_unshift(tokens, tmp);
+					chunk->is_room = TRUE;
+					parser_unshift(tokens);
 				}
-				else if (!strcmp(tmp, "%SCENE:"))
+				else if (parser_is(tmp, "%SCENE:"))
 				{
-					is_scene = TRUE;
-					list_unshift(tokens, tmp);
+					chunk->is_scene = TRUE;
+					parser_unshift(tokens);
 				}
 				else
 				{
-					parser_error();
+					parser_error(chunk);
 				}
 			}
 			else
 			{
-				list_destroy(tokens, NULL);
 				continue;
 			}
 		}
 
 		// Glossary
-		if (is_glossary)
+		if (chunk->is_glossary)
 		{
-			parser_glossary(tokens);
+			parser_glossary(chunk);
 		}
 
 		// Header
-		if (is_header)
+		if (chunk->is_header)
 		{
-			parser_header(tokens);
+			parser_header(chunk);
 		}
 
 		// Room
-		if (is_room)
+		if (chunk->is_room)
 		{
-			parser_room(tokens);
+			parser_room(chunk);
 		}
 
 		// Scene
-		if (is_scene)
+		if (chunk->is_scene)
+		{
+			parser_scene(chunk);
+		}
+	}
+}
+
+/*
+ * Thread parsing a chunk.
+ *
+ * arg: Chunk to parse
+ */
+static void
+*parser_chunk_thread(void *arg)
+{
+	parser_chunk_parse(arg);
+
+	return NULL;
+}
+
+/*
+ * Moves a string from a chunks string pool
+ * into 'game_names'.
+ *
+ * str: String to move, may be NULL
+ */
+static const char
+*parser_import_string(const char *str)
+{
+	return str ? strpool_import(game_names, str) : NULL;
+}
+
+/*
+ * Moves the strings of an object from the
+ * chunks string pool into 'game_names'.
+ *
+ * obj: Object to move the strings of
+ */
+static void
+parser_import(parser_object *obj)
+{
+	game_glossary_s *glossary;
+	game_room_s *room;
+	game_scene_s *scene;
+	list *aliases;
+	listnode *lnode;
+	uint8_t i;
+
+	assert(obj);
+
+	switch (obj->kind)
+	{
+		case PARSER_GLOSSARY:
+			glossary = obj->data;
+			glossary->name = parser_import_string(glossary->name);
+			glossary->descr = parser_import_string(glossary->descr);
+			aliases = glossary->aliases;
+			break;
+
+		case PARSER_ROOM:
+			room = obj->data;
+			room->name = parser_import_string(room->name);
+			room->descr = parser_import_string(room->descr);
+			aliases = room->aliases;
+			break;
+
+		default:
+			scene = obj->data;
+			scene->name = parser_import_string(scene->name);
+			scene->descr = parser_import_string(scene->descr);
+			scene->prompt = parser_import_string(scene->prompt);
+			scene->room = parser_import_string(scene->room);
+
+			for (i = 0; i < scene->next_count; i++)
+			{
+				scene->next[i] = parser_import_string(scene->next[i]);
+			}
+
+			aliases = scene->aliases;
+			break;
+	}
+
+	if (aliases)
+	{
+		for (lnode = aliases->first; lnode; lnode = lnode->next)
+		{
+			lnode->data = (char *)parser_import_string(lnode->data);
+		}
+	}
+}
+
+/*
+ * Merges a parsed chunk into the game. The
+ * words are added to the games dictionary,
+ * the strings to 'game_names' and the objects
+ * to the symbol table, all in the order they
+ * appear in the file. The chunk is released
+ * afterwards.
+ *
+ * chunk: Chunk to merge
+ */
+static void
+parser_chunk_merge(parser_chunk *chunk)
+{
+	parser_object *cur;
+	game_text_s *text;
+	uint32_t *map;
+	uint32_t i;
+
+	assert(chunk);
+
+	if ((map = malloc(chunk->words->elements * sizeof(uint32_t))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	// First occurence in this chunk is first occurence
+	// in the file, so IDs are the same as when parsing
+	// the whole file at once
+	for (i = 0; i < chunk->words->elements; i++)
+	{
+		map[i] = dict_add(game_words, chunk->words->words[i], strlen(chunk->words->words[i]));
+	}
+
+	for (i = 0; i < chunk->elements; i++)
+	{
+		cur = &chunk->objects[i];
+
+		switch (cur->kind)
+		{
+			case PARSER_GLOSSARY:
+				text = &((game_glossary_s *)cur->data)->text;
+				break;
+
+			case PARSER_ROOM:
+				text = &((game_room_s *)cur->data)->text;
+				break;
+
+			default:
+				text = &((game_scene_s *)cur->data)->text;
+				break;
+		}
+
+		// Lazy bodies are loaded later on
+		if (!chunk->lazy)
+		{
+			parser_text_merge(text, chunk->text.ids + cur->text, map, game_arena);
+		}
+
+		parser_import(cur);
+
+		switch (cur->kind)
+		{
+			case PARSER_GLOSSARY:
+				parser_add_glossary(cur->data);
+				break;
+
+			case PARSER_ROOM:
+				parser_add_room(cur->data);
+				break;
+
+			default:
+				parser_add_scene(cur->data);
+				break;
+		}
+	}
+
+	arena_merge(game_arena, chunk->pool);
+	dict_destroy(chunk->words);
+
+	// Everything was moved into 'game_names'
+	strpool_destroy(chunk->names);
+	arena_destroy(chunk->strings);
+
+	free(map);
+	free(chunk->scratch);
+	free(chunk->objects);
+	free(chunk->text.ids);
+	free(chunk->tokens.spans);
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                          Public Interface                         *
+ *                                                                   *
+ *********************************************************************/
+
+void
+parser_close(void)
+{
+	if (source.game)
+	{
+		munmap(source.game, source.size);
+		source.game = NULL;
+		source.size = 0;
+	}
+
+	if (source.fd != -1)
+	{
+		close(source.fd);
+		source.fd = -1;
+	}
+}
+
+boolean
+parser_game(const char *file, boolean lazy)
+{
+	char *game;
+	const char *cur;
+	const char *end;
+	const char *eof;
+	const char *line;
+	int fd;
+	int32_t count;
+	long threads;
+	parser_chunk *chunks;
+	parser_chunk header;
+	size_t size;
+	struct stat sb;
+	uint32_t i;
+	uint32_t num;
+
+	assert(file);
+
+	if ((stat(file, &sb)) != 0)
+	{
+		quit_error(PFILENOTEXIST);
+	}
+
+	if (!S_ISREG(sb.st_mode))
+	{
+		quit_error(PNOTAFILE);
+	}
+
+	if ((fd = open(file, O_RDONLY)) == -1)
+	{
+		quit_error(PCOULDNTOPENFILE);
+	}
+
+	// Empty files can't be mapped
+	game = NULL;
+
+	if (sb.st_size)
+	{
+		if ((game = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		{
+			quit_error(PCOULDNTOPENFILE);
+		}
+	}
+
+	eof = game + sb.st_size;
+	lazy = lazy && LAZYSIZE && sb.st_size > LAZYSIZE;
+
+	// Kept to notice changes before a body is loaded
+	if (!lazy)
+	{
+		close(fd);
+	}
+
+	log_info_f("%s: %s", i18n_parser_parsingfile, file);
+
+	// The paragraph end is always the first word
+	dict_add(game_words, "\n", 1);
+
+	// Header is always the first section. It's
+	// small, so just parse it right here
+	memset(&header, 0, sizeof(header));
+
+	header.start = game;
+	header.end = eof;
+	header.limit = eof;
+	header.header_only = TRUE;
+	header.is_header = TRUE;
+	header.pool = game_arena;
+	header.words = game_words;
+	header.names = game_names;
+
+	parser_chunk_parse(&header);
+	free(header.tokens.spans);
+	free(header.scratch);
+
+	count = header.count;
+
+	// Split the rest into chunks of roughly the same
+	// size. Chunks end behind a section separator
+	size = eof - header.end;
+	threads = PARSERTHREADS ? PARSERTHREADS : sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+
+	num = size / PARSERCHUNK < (size_t)threads ? size / PARSERCHUNK : threads;
+
+	if (num < 1)
+	{
+		num = 1;
+	}
+
+	if ((chunks = calloc(num, sizeof(parser_chunk))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	line = header.end;
+
+	for (i = 0; i < num; i++)
+	{
+		chunks[i].start = line;
+		chunks[i].end = eof;
+		chunks[i].limit = eof;
+
+		if (i < num - 1)
+		{
+			cur = header.end + size / num * (i + 1);
+
+			if (cur < line)
+			{
+				cur = line;
+			}
+
+			// Start of the next line...
+			if ((cur = scan_find(cur, eof, SCAN_NEWLINE)) == NULL)
+			{
+				cur = eof;
+			}
+
+			line = cur + 1;
+
+			// ...and behind the next separator
+			while (line < eof)
+			{
+				if ((end = scan_find(line, eof, SCAN_NEWLINE)) == NULL)
+				{
+					end = eof;
+				}
+
+				cur = line;
+				line = end + 1;
+
+				if (parser_separator(cur, end))
+				{
+					break;
+				}
+			}
+
+			if (line > eof)
+			{
+				line = eof;
+			}
+
+			chunks[i].end = line;
+		}
+
+		chunks[i].lazy = lazy;
+		chunks[i].threaded = TRUE;
+		chunks[i].pool = arena_create(ARENABLOCK);
+		chunks[i].words = dict_create(chunks[i].pool);
+		chunks[i].strings = arena_create(ARENABLOCK);
+		chunks[i].names = strpool_create(chunks[i].strings);
+		chunks[i].paragraph = dict_add(chunks[i].words, "\n", 1);
+
+		if (pthread_create(&chunks[i].thread, NULL, parser_chunk_thread, &chunks[i]))
+		{
+			quit_error(POUTOFMEM);
+		}
+	}
+
+	for (i = 0; i < num; i++)
+	{
+		pthread_join(chunks[i].thread, NULL);
+	}
+
+	// Merge in order. Everything before the first
+	// error is merged, so the log is the same as
+	// if the file was parsed line by line
+	for (i = 0; i < num; i++)
+	{
+		parser_chunk_merge(&chunks[i]);
+
+		if (chunks[i].error)
 		{
-			parser_scene(tokens);
+			log_error_f("%s %i\n", i18n_parser_error, count + chunks[i].error);
+
+			quit_error(PPARSERERR);
 		}
 
-		list_destroy(tokens, NULL);
+		count += chunks[i].count;
+	}
+
+	free(chunks);
+
+	// Everything was copied into the arena, but
+	// the bodies may still be needed
+	if (lazy)
+	{
+		source.game = game;
+		source.size = sb.st_size;
+		source.fd = fd;
+		source.mtime = sb.st_mtime;
+
+		log_info(i18n_parser_lazy);
+	}
+	else if (game)
+	{
+		munmap(game, sb.st_size);
 	}
 
-	free(line);
 	log_info_f("%s: %i", i18n_parser_linesparsed, count);
+	log_info_f("%s: %u", i18n_parser_chunks, num);
+	log_info_f("%s: %u", i18n_parser_dictionary, game_words->elements);
+	log_info_f("%s: %zu/%zu", i18n_game_memory, game_arena->used, game_arena->reserved);
+
+	return lazy;
+}
+
+void
+parser_text_load(game_text_s *text)
+{
+	game_text_s loaded;
+	parser_chunk chunk;
+	parser_scanner scan;
+	struct stat sb;
+	uint32_t i;
+
+	assert(text);
+	assert(text->body);
+	assert(source.game);
+
+	// The mapping shows changes of the file
+	if (fstat(source.fd, &sb) != 0 || (size_t)sb.st_size != source.size || sb.st_mtime != source.mtime)
+	{
+		log_error(i18n_parser_changed);
+		quit_error(PBROKENGAME);
+	}
+
+	memset(&chunk, 0, sizeof(chunk));
+	memset(&loaded, 0, sizeof(loaded));
+
+	chunk.words = game_words;
+	chunk.paragraph = dict_add(game_words, "\n", 1);
+
+	// Same as in the section parsers
+	parser_scan_start(&scan, text->body, text->body + text->length, source.game + source.size);
+
+	while (parser_scan_line(&scan, &chunk.tokens))
+	{
+		if (scan.comment)
+		{
+			continue;
+		}
+
+		if (!chunk.tokens.count)
+		{
+			parser_text_paragraph(&chunk);
+		}
+
+		for (i = 0; i < chunk.tokens.count; i++)
+		{
+			parser_text_add(&chunk, chunk.tokens.spans[i].start, chunk.tokens.spans[i].len);
+		}
+	}
+
+	parser_text_finish(&chunk, &loaded);
+
+	// Same words as at the first parse, or the body is garbage
+	if (loaded.words != text->words)
+	{
+		log_error(i18n_parser_changed);
+		quit_error(PBROKENGAME);
+	}
+
+	parser_text_merge(text, chunk.text.ids, NULL, NULL);
+
+	free(chunk.text.ids);
+	free(chunk.tokens.spans);
 }
@@ -10,15 +10,36 @@
 
 // ---------
 
+#include "game.h"
+
+// ---------
+
 /*
  * Parses a game file. Must be called after game_init()
  * since it fills the games internal data structures.
  * The functions checks if the given file exists and
- * bails out if it doesn't.
+ * bails out if it doesn't. If the bodies are to be
+ * loaded on demand, TRUE is returned.
  *
  * file: File to parse
+ * lazy: Bodies of big files may be loaded on demand
+ */
+boolean parser_game(const char *file, boolean lazy);
+
+/*
+ * Unmaps the game file, if it's still mapped
+ * for loading bodies on demand.
+ */
+void parser_close(void);
+
+/*
+ * Loads the body of an object on demand. The IDs
+ * are allocated with malloc() and must be freed
+ * by the caller.
+ *
+ * text: Text to load
  */
-void parser_game(const char *file);
+void parser_text_load(game_text_s *text);
 
 // ---------
 
@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <termios.h>
 #include <unistd.h>
 
 #include "curses.h"
@@ -23,6 +24,12 @@
 
 // --------
 
+// Terminal settings before curses changed them
+static struct termios term;
+static boolean has_term;
+
+// --------
+
 /*********************************************************************
  *                                                                   *
  *                          Support Functions                        *
@@ -39,6 +46,14 @@ quit_errcodetostr(errcode error)
 {
 	switch (error)
 	{
+		case PBROKENGAME:
+			return i18n_error_brokengame;
+			break;
+
+		case PBROKENIMAGE:
+			return i18n_error_brokenimage;
+			break;
+
 		case PBROKENSAVE:
 			return i18n_error_brokensave;
 			break;
@@ -75,6 +90,10 @@ quit_errcodetostr(errcode error)
 			return i18n_error_couldntsavehistory;
 			break;
 
+		case PCOULDNTWRITEIMAGE:
+			return i18n_error_couldntwriteimage;
+			break;
+
 		case PCOULDNTWRITELOGMSG:
 			return i18n_error_couldntwritelogmsg;
 			break;
@@ -138,24 +157,40 @@ quit_errcodetostr(errcode error)
  *********************************************************************/
 
 /*
- * The game crashed.
+ * The game crashed. Runs on its own stack, so
+ * it works after a stack overflow. Everything
+ * is done with syscalls, curses can't be used
+ * here. The savegame is written first, then
+ * the terminal is reset by hand: Leave the
+ * alternate screen, reset the attributes, show
+ * the cursor and restore the tty settings.
  *
  * sig: The signal
  */
 void
 quit_signal_error(int32_t sig)
 {
-	save_write("panic");
-	curses_quit();
+	static const char msg[] = "PANIC: Crash\n";
+	static const char reset[] = "\033[?1049l\033[0m\033[?25h\r\n";
 
-	fprintf(stderr, "PANIC: Crash\n");
-	fflush(stderr);
+	save_panic();
+
+	if (has_term)
+	{
+		if (write(STDOUT_FILENO, reset, sizeof(reset) - 1) == -1)
+		{
+			// Nothing left to do
+		}
+
+		tcsetattr(STDIN_FILENO, TCSANOW, &term);
+	}
 
-	signal(SIGSEGV, SIG_DFL);
-	signal(SIGILL, SIG_DFL);
-	signal(SIGFPE, SIG_DFL);
-	signal(SIGABRT, SIG_DFL);
+	if (write(STDERR_FILENO, msg, sizeof(msg) - 1) == -1)
+	{
+		// Nothing left to do
+	}
 
+	signal(sig, SIG_DFL);
 	raise(sig);
 }
 
@@ -175,11 +210,30 @@ quit_signal_success(int32_t sig)
 void
 quit_signal_register(void)
 {
+	stack_t stack;
+	struct sigaction crash;
+
+	static char altstack[SIGNALSTACK];
+
+	// Must be called before curses is started
+	has_term = isatty(STDOUT_FILENO) && tcgetattr(STDIN_FILENO, &term) == 0;
+
 	/* Crash */
-	signal(SIGSEGV, quit_signal_error);
-	signal(SIGILL, quit_signal_error);
-	signal(SIGFPE, quit_signal_error);
-	signal(SIGABRT, quit_signal_error);
+	stack.ss_sp = altstack;
+	stack.ss_size = sizeof(altstack);
+	stack.ss_flags = 0;
+
+	sigaltstack(&stack, NULL);
+
+	memset(&crash, 0, sizeof(crash));
+	crash.sa_handler = quit_signal_error;
+	crash.sa_flags = SA_ONSTACK | SA_RESETHAND;
+	sigemptyset(&crash.sa_mask);
+
+	sigaction(SIGSEGV, &crash, NULL);
+	sigaction(SIGILL, &crash, NULL);
+	sigaction(SIGFPE, &crash, NULL);
+	sigaction(SIGABRT, &crash, NULL);
 
 	/* User abort */
 	signal(SIGINT, quit_signal_success);
@@ -214,7 +268,8 @@ quit_error(errcode error)
 	}
 
 	status = quit_errcodetostr(error);
-	save_write("panic");
+	save_panic();
+	log_close();
 	curses_quit();
 
 	if (err)
@@ -247,6 +302,7 @@ quit_success(void)
 	}
 
 	save_write("shutdown");
+	save_quit();
 	game_quit();
 	curses_quit();
 	input_quit();
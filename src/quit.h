@@ -34,6 +34,11 @@ typedef enum
 	PROOMNOTFOUND,
 	PSCENENOTFOUND,
 	PUNKNOWNLOGTYPE,
+
+	// Appended, the codes above keep their numbers
+	PBROKENIMAGE,
+	PCOULDNTWRITEIMAGE,
+	PBROKENGAME,
 } errcode;
 
 // ---------
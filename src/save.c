@@ -3,17 +3,49 @@
  * ------
  *
  * Code to save the game state into a file and
- * load it back at a later time.
+ * load it back at a later time. Savegames are
+ * binary, the state sets are written as they
+ * are. Older text savegames can still be read.
+ *
+ * The state is copied when the game is saved,
+ * the copy is written by a background thread.
+ * Each save goes to a temporary file which is
+ * synced and renamed over the old savegame, so
+ * a crash never leaves a partial savegame.
+ *
+ * Every change of the state is appended to a
+ * journal, a savegame followed by records of
+ * the changes. From time to time it's replaced
+ * by a fresh savegame. A clean shutdown deletes
+ * it, a journal found at startup is kept as
+ * another savegame.
+ *
+ * A copy of the savegame is kept up to date in
+ * memory. After a crash it's written with raw
+ * syscalls from the signal handler.
+ *
+ * Each savegame starts with a summary of the
+ * game. The summaries of all savegames are
+ * kept in an index, so listing them doesn't
+ * need to open every savegame.
  */
 
 #define _WITH_GETLINE
+#define LOG_MODULE LOG_SAVE
 
 #include <assert.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include "curses.h"
@@ -21,14 +53,219 @@
 #include "log.h"
 #include "misc.h"
 #include "quit.h"
+#include "save.h"
 
 #include "i18n/i18n.h"
 
 // --------
 
+// Magic bytes at the start of a binary savegame
+#define SAVE_MAGIC "TOUKASAV"
+
+// Must be bumped when the format changes
+#define SAVE_VERSION 2
+
+// Detects savegames with another byte order
+#define SAVE_ENDIAN 0x01020304
+
+// Longest UID accepted from a savegame
+#define SAVE_MAXUID 4096
+
+// Savegame with the journal
+#define SAVE_JOURNAL "journal"
+
+// Journal of the last run
+#define SAVE_RECOVERED "recovered"
+
+// Savegame written after a crash
+#define SAVE_PANIC "panic"
+
+// Index of all savegames, not a savegame itself
+#define SAVE_INDEX "index"
+
+// Magic bytes at the start of the index
+#define SAVE_INDEX_MAGIC "TOUKAIDX"
+
+// Longest name of a savegame, including the 0
+#define SAVE_NAMEMAX 128
+
+/*
+ * Summary of a savegame, shown when the
+ * savegames are listed.
+ */
+typedef struct
+{
+	// When it was saved
+	int64_t time;
+
+	// Hash of the object names, see save_objects_hash()
+	uint32_t objects_hash;
+
+	// ID of the current scene, 0 if none
+	uint32_t current_scene;
+	uint32_t game_end;
+
+	// Objects in their progress state, see save_progress()
+	uint32_t progress[GAME_KINDS];
+} save_meta;
+
+/*
+ * Header of a binary savegame. It's followed
+ * by the games UID and the state sets. For
+ * each kind and state there are as many 64
+ * bit words as needed for the objects.
+ */
+typedef struct
+{
+	char magic[8];
+
+	uint32_t version;
+	uint32_t endian;
+
+	// Number of objects of each kind
+	uint32_t objects[GAME_KINDS];
+	uint32_t uid_length;
+
+	save_meta meta;
+} save_header;
+
+/*
+ * An entry of the index.
+ */
+typedef struct
+{
+	char name[SAVE_NAMEMAX];
+	save_meta meta;
+} save_entry;
+
+/*
+ * Header of the index. It's followed by the
+ * entries, in no particular order.
+ */
+typedef struct
+{
+	char magic[8];
+
+	uint32_t version;
+	uint32_t endian;
+	uint32_t count;
+	uint32_t unused;
+} save_index_header;
+
+/*
+ * A savegame waiting to be written.
+ */
+typedef struct save_job
+{
+	struct save_job *next;
+
+	// Name of the savegame and its file
+	char name[SAVE_NAMEMAX];
+	char file[PATH_MAX];
+
+	// Copy of the state
+	char *buf;
+	size_t len;
+
+	boolean written;
+
+	// Replaces the journal
+	boolean journal;
+} save_job;
+
+/*
+ * Kinds of journal records.
+ */
+enum
+{
+	// An object got into a state
+	SAVE_RECORD_STATE,
+
+	// The current scene or the end flag changed
+	SAVE_RECORD_SCENE,
+
+	// An object left a state
+	SAVE_RECORD_CLEAR
+};
+
+/*
+ * A record in the journal.
+ */
+typedef struct
+{
+	uint32_t type;
+
+	// Object ID, 0 if there's no current scene
+	uint32_t id;
+
+	// State or end flag
+	uint32_t value;
+} save_record;
+
+// --------
+
 static char savedir[PATH_MAX];
 static boolean is_initialized;
 
+// Savegames to write and written ones
+static struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t writer;
+	boolean running;
+
+	// Written in this order, the first one is in progress
+	save_job *first;
+	save_job *last;
+
+	// Not yet reported, newest first
+	save_job *done;
+} queue = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+// Hash of the games objects
+static uint32_t objects_hash;
+
+// All savegames, guarded by queue.lock
+static struct
+{
+	save_entry *entries;
+	uint32_t count;
+	uint32_t size;
+} slots;
+
+// The journal, guarded by queue.lock
+static struct
+{
+	int fd;
+
+	// Appended since the last compaction
+	uint32_t records;
+
+	// Don't record the changes while loading
+	boolean paused;
+
+	// Records for the compacted journal
+	boolean compacting;
+	char *pending;
+	size_t len;
+	size_t size;
+} journal = {-1};
+
+// Savegame written by save_panic()
+static struct
+{
+	char file[PATH_MAX];
+	char tmpfile[PATH_MAX + 8];
+
+	// Always a complete savegame
+	char *buf;
+	size_t len;
+
+	// Offsets of the state sets in 'buf'
+	size_t sets[GAME_KINDS][GAME_STATES];
+} panic;
+
 // --------
 
 /*********************************************************************
@@ -44,172 +281,1630 @@ static boolean is_initialized;
 static void
 save_reset_state(void)
 {
-	game_glossary_s *glossary;
-	game_room_s *room;
-	game_scene_s *scene;
-	list *tmp;
-
-	// Global state
 	current_scene = NULL;
 	game_end = FALSE;
 
-	// Glossary
-	tmp = hashmap_to_list(game_glossary);
+	game_state_reset();
+}
+
+/*
+ * Checks if a savegame is written by the
+ * engine itself. The player can load it, but
+ * not save to it.
+ *
+ * name: Name of the savegame, without ".sav"
+ */
+static boolean
+save_reserved(const char *name)
+{
+	static const char *reserved[] = {SAVE_INDEX, SAVE_JOURNAL, SAVE_PANIC, SAVE_RECOVERED};
+	uint8_t i;
+
+	for (i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i++)
+	{
+		if (!strcmp(name, reserved[i]))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * Returns the state which counts as progress
+ * for a kind of objects. Like on the end screen
+ * glossary entries count when mentioned, rooms
+ * and scenes when visited.
+ *
+ * kind: Kind of the objects
+ */
+static uint8_t
+save_progress(uint8_t kind)
+{
+	return kind == GAME_GLOSSARY ? GAME_MENTIONED : GAME_VISITED;
+}
+
+/*
+ * Applies a journal record to the summary
+ * of a savegame.
+ *
+ * meta: Summary to update
+ * record: Record to apply
+ */
+static void
+save_meta_apply(save_meta *meta, const save_record *record)
+{
+	if (record->type == SAVE_RECORD_STATE || record->type == SAVE_RECORD_CLEAR)
+	{
+		// Records are only written for changed states
+		if (GAME_ID_KIND(record->id) < GAME_KINDS
+				&& record->value == save_progress(GAME_ID_KIND(record->id)))
+		{
+			if (record->type == SAVE_RECORD_STATE)
+			{
+				meta->progress[GAME_ID_KIND(record->id)]++;
+			}
+			else if (meta->progress[GAME_ID_KIND(record->id)])
+			{
+				meta->progress[GAME_ID_KIND(record->id)]--;
+			}
+		}
+	}
+	else
+	{
+		meta->current_scene = record->id;
+		meta->game_end = record->value;
+	}
+}
+
+/*
+ * Returns the name of an object.
+ *
+ * kind: Kind of the object
+ * index: Index of the object
+ */
+static const char
+*save_object_name(uint8_t kind, uint32_t index)
+{
+	switch (kind)
+	{
+		case GAME_GLOSSARY:
+			return ((game_glossary_s *)game_objects[kind].objects[index])->name;
+
+		case GAME_ROOM:
+			return ((game_room_s *)game_objects[kind].objects[index])->name;
+
+		default:
+			return ((game_scene_s *)game_objects[kind].objects[index])->name;
+	}
+}
+
+/*
+ * Hashes the names of all objects, in the order
+ * of their IDs. Binary savegames store objects
+ * by their IDs, so they can only be loaded if
+ * the hash is unchanged. This is FNV-1a over the
+ * hashes of the interned names.
+ */
+static uint32_t
+save_objects_hash(void)
+{
+	uint32_t hash;
+	uint32_t i;
+	uint8_t kind;
+
+	hash = 2166136261u;
 
-	while (tmp->count)
+	for (kind = 0; kind < GAME_KINDS; kind++)
 	{
-		glossary = list_shift(tmp);
+		hash = (hash ^ game_objects[kind].count) * 16777619u;
 
-		if (glossary->mentioned)
+		for (i = 0; i < game_objects[kind].count; i++)
 		{
-			glossary->mentioned = FALSE;
+			hash = (hash ^ strpool_hash(save_object_name(kind, i))) * 16777619u;
 		}
 	}
 
-	game_stats->glossary_mentioned = 0;
-	free(tmp);
+	return hash;
+}
+
+/*
+ * Applies a journal record to the state.
+ *
+ * record: Record to apply
+ */
+static void
+save_replay(const save_record *record)
+{
+	uint8_t kind;
+
+	if (record->type == SAVE_RECORD_STATE || record->type == SAVE_RECORD_CLEAR)
+	{
+		kind = GAME_ID_KIND(record->id);
+
+		if (!record->id || kind >= GAME_KINDS || record->value >= GAME_STATES
+				|| GAME_ID_INDEX(record->id) >= game_objects[kind].count)
+		{
+			quit_error(PBROKENSAVE);
+		}
+
+		if (record->type == SAVE_RECORD_STATE)
+		{
+			game_state_set(record->id, record->value);
+		}
+		else
+		{
+			game_state_clear(record->id, record->value);
+		}
+	}
+	else if (record->type == SAVE_RECORD_SCENE)
+	{
+		if (record->id && (GAME_ID_KIND(record->id) != GAME_SCENE
+				|| GAME_ID_INDEX(record->id) >= game_objects[GAME_SCENE].count))
+		{
+			quit_error(PBROKENSAVE);
+		}
+
+		current_scene = record->id ? game_object_get(record->id) : NULL;
+		game_end = record->value ? TRUE : FALSE;
+	}
+	else
+	{
+		quit_error(PBROKENSAVE);
+	}
+}
+
+/*
+ * Reads a binary savegame. The magic bytes were
+ * already read. The header is checked before the
+ * state is touched, a savegame that doesn't fit
+ * the game leaves it alone. The state sets are
+ * read into place, bits behind the last object
+ * must be 0.
+ *
+ * save: File to read from
+ */
+static boolean
+save_read_binary(FILE *save)
+{
+	bitset *set;
+	char *uid;
+	save_header header;
+	save_record record;
+	size_t head;
+	uint8_t kind;
+	uint8_t state;
+	uint32_t words;
+
+	rewind(save);
+
+	// Other versions may have another header
+	head = offsetof(save_header, objects);
+
+	if (fread(&header, head, 1, save) != 1)
+	{
+		quit_error(PBROKENSAVE);
+	}
+
+	if (header.version != SAVE_VERSION || header.endian != SAVE_ENDIAN)
+	{
+		curses_text(TINT_NORM, "%s\n", i18n_save_unsupported);
+
+		return FALSE;
+	}
+
+	if (fread((char *)&header + head, sizeof(header) - head, 1, save) != 1)
+	{
+		quit_error(PBROKENSAVE);
+	}
+
+	if (header.uid_length > SAVE_MAXUID)
+	{
+		quit_error(PBROKENSAVE);
+	}
+
+	if ((uid = calloc(1, header.uid_length + 1)) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	if (header.uid_length && fread(uid, header.uid_length, 1, save) != 1)
+	{
+		quit_error(PBROKENSAVE);
+	}
+
+	if (strcmp(uid, game_header->uid))
+	{
+		curses_text(TINT_NORM, "%s\n", i18n_save_fromanothergame);
+		free(uid);
+
+		return FALSE;
+	}
 
-	// Rooms
-	tmp = hashmap_to_list(game_rooms);
+	free(uid);
+
+	// The game was changed, IDs may point to other objects
+	if (header.meta.objects_hash != objects_hash)
+	{
+		curses_text(TINT_NORM, "%s\n", i18n_save_fromanotherversion);
+
+		return FALSE;
+	}
 
-	while (tmp->count)
+	for (kind = 0; kind < GAME_KINDS; kind++)
 	{
-		room = list_shift(tmp);
+		if (header.objects[kind] != game_objects[kind].count)
+		{
+			quit_error(PBROKENSAVE);
+		}
+	}
 
-		if (room->mentioned)
+	if (header.meta.current_scene)
+	{
+		if (GAME_ID_KIND(header.meta.current_scene) != GAME_SCENE
+				|| GAME_ID_INDEX(header.meta.current_scene) >= game_objects[GAME_SCENE].count)
 		{
-			room->mentioned = FALSE;
+			quit_error(PBROKENSAVE);
 		}
+	}
+
+	// Header is fine, replace the state
+	save_reset_state();
 
-		if (room->visited)
+	for (kind = 0; kind < GAME_KINDS; kind++)
+	{
+		words = BITSET_WORDS(header.objects[kind]);
+
+		for (state = 0; state < GAME_STATES; state++)
 		{
-			room->visited = FALSE;
+			set = game_state[kind][state];
+
+			if (words && fread(set->words, sizeof(uint64_t), words, save) != words)
+			{
+				quit_error(PBROKENSAVE);
+			}
+
+			if (set->size % 64 && set->words[words - 1] >> (set->size % 64))
+			{
+				quit_error(PBROKENSAVE);
+			}
 		}
 	}
 
-	game_stats->rooms_visited = 0;
-	free(tmp);
+	if (header.meta.current_scene)
+	{
+		current_scene = game_object_get(header.meta.current_scene);
+	}
+
+	game_end = header.meta.game_end ? TRUE : FALSE;
+
+	// Journal records, a torn last one is ignored
+	while (fread(&record, sizeof(record), 1, save) == 1)
+	{
+		save_replay(&record);
+	}
+
+	return TRUE;
+}
+
+/*
+ * Reads a savegame in the old text format. Each
+ * block starts with a head and lists the names
+ * of the objects, an empty line ends it.
+ *
+ * save: File to read from
+ */
+static boolean
+save_read_text(FILE *save)
+{
+	boolean glossary_mentioned;
+	boolean header;
+	boolean rooms_mentioned;
+	boolean rooms_seen;
+	boolean scenes_visited;
+	char *cur;
+	char *line;
+	char *token;
+	game_id id;
+	size_t linecap;
+	ssize_t linelen;
+
+	glossary_mentioned = FALSE;
+	header = TRUE;
+	rooms_mentioned = FALSE;
+	rooms_seen = FALSE;
+	scenes_visited = FALSE;
+
+	line = NULL;
+	linecap = 0;
+
+	// Check the UID in the header before the
+	// state is touched
+	while ((linelen = getline(&line, &linecap, save)) > 1)
+	{
+		line[linelen - 1] = '\0';
+
+		if (!strncmp(line, "#UID: ", strlen("#UID: ")) && strcmp(line + strlen("#UID: "), game_header->uid))
+		{
+			curses_text(TINT_NORM, "%s\n", i18n_save_fromanothergame);
+			free(line);
+
+			return FALSE;
+		}
+	}
 
-	// Scenes
-	tmp = hashmap_to_list(game_scenes);
+	rewind(save);
+	save_reset_state();
 
-	while (tmp->count)
+	while ((linelen = getline(&line, &linecap, save)) > 0)
 	{
-		scene = list_shift(tmp);
+		cur = line;
 
-		if (scene->visited)
+		// Empty line ends block
+		if (linelen == 1)
+		{
+			glossary_mentioned = FALSE;
+			header = FALSE;
+			rooms_mentioned = FALSE;
+			rooms_seen = FALSE;
+			scenes_visited = FALSE;
+
+			continue;
+		}
+
+		// Remove newline character
+		cur[strlen(cur) - 1] = '\0';
+
+		// New block
+		if (!(glossary_mentioned || header || rooms_mentioned || rooms_seen || scenes_visited))
+		{
+			if (!strncmp(cur, "#GLOSSARY_MENTIONED:", strlen("GLOSSARY_MENTIONED:")))
+			{
+				glossary_mentioned = TRUE;
+			}
+
+			if (!strncmp(cur, "#ROOMS_MENTIONED:", strlen("#ROOMS_MENTIONED:")))
+			{
+				rooms_mentioned = TRUE;
+			}
+
+			if (!strncmp(cur, "#ROOMS_SEEN:", strlen("#ROOMS_SEEN:")))
+			{
+				rooms_seen = TRUE;
+			}
+
+			if (!strncmp(cur, "#SCENES_VISITED:", strlen("#SCENES_VISITED:")))
+			{
+				scenes_visited = TRUE;
+			}
+
+			continue;
+		}
+
+		// Glossary
+		if (glossary_mentioned)
+		{
+			if ((id = game_symbol_get(cur, GAME_GLOSSARY)) == 0)
+			{
+				quit_error(PBROKENSAVE);
+			}
+
+			game_state_set(id, GAME_MENTIONED);
+		}
+
+		// Header
+		if (header)
+		{
+			token = strsep(&cur, " ");
+
+			if (!strcmp(token, "#UID:"))
+			{
+				if (strcmp(cur, game_header->uid))
+				{
+					curses_text(TINT_NORM, "%s\n", i18n_save_fromanothergame);
+					free(line);
+
+					return FALSE;
+				}
+			}
+
+			if (!strcmp(token, "#CURSCENE:"))
+			{
+				if ((id = game_symbol_get(cur, GAME_SCENE)) == 0)
+				{
+					quit_error(PBROKENSAVE);
+				}
+
+				current_scene = game_object_get(id);
+			}
+
+			if (!strcmp(token, "#GAMEEND"))
+			{
+				game_end = TRUE;
+			}
+		}
+
+		// Rooms mentioned
+		if (rooms_mentioned)
+		{
+			if ((id = game_symbol_get(cur, GAME_ROOM)) == 0)
+			{
+				quit_error(PBROKENSAVE);
+			}
+
+			game_state_set(id, GAME_MENTIONED);
+		}
+
+		// Rooms visited
+		if (rooms_seen)
+		{
+			if ((id = game_symbol_get(cur, GAME_ROOM)) == 0)
+			{
+				quit_error(PBROKENSAVE);
+			}
+
+			game_state_set(id, GAME_VISITED);
+		}
+
+		// Scenes visited
+		if (scenes_visited)
+		{
+			if ((id = game_symbol_get(cur, GAME_SCENE)) == 0)
+			{
+				quit_error(PBROKENSAVE);
+			}
+
+			game_state_set(id, GAME_VISITED);
+		}
+	}
+
+	free(line);
+
+	return TRUE;
+}
+
+// --------
+
+/*
+ * Copies the state into a new savegame.
+ *
+ * name: Name of the savegame, without ".sav"
+ */
+static save_job
+*save_snapshot(const char *name)
+{
+	char *buf;
+	save_header header;
+	save_job *job;
+	size_t len;
+	uint8_t kind;
+	uint8_t state;
+
+	// Header
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SAVE_MAGIC, sizeof(header.magic));
+
+	header.version = SAVE_VERSION;
+	header.endian = SAVE_ENDIAN;
+	header.uid_length = strlen(game_header->uid);
+
+	header.meta.time = time(NULL);
+	header.meta.objects_hash = objects_hash;
+	header.meta.current_scene = current_scene ? current_scene->id : 0;
+	header.meta.game_end = game_end ? 1 : 0;
+
+	len = sizeof(header) + header.uid_length;
+
+	for (kind = 0; kind < GAME_KINDS; kind++)
+	{
+		header.objects[kind] = game_objects[kind].count;
+		header.meta.progress[kind] = game_state_count(kind, save_progress(kind));
+		len += GAME_STATES * BITSET_WORDS(game_objects[kind].count) * sizeof(uint64_t);
+	}
+
+	if ((job = calloc(1, sizeof(save_job))) == NULL || (job->buf = malloc(len)) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	misc_strlcpy(job->name, name, sizeof(job->name));
+	snprintf(job->file, sizeof(job->file), "%s/%s.sav", savedir, name);
+
+	// The game goes on while it's written
+	buf = job->buf;
+
+	memcpy(buf, &header, sizeof(header));
+	buf += sizeof(header);
+	memcpy(buf, game_header->uid, header.uid_length);
+	buf += header.uid_length;
+
+	for (kind = 0; kind < GAME_KINDS; kind++)
+	{
+		for (state = 0; state < GAME_STATES; state++)
+		{
+			memcpy(buf, game_state[kind][state]->words,
+					BITSET_WORDS(game_objects[kind].count) * sizeof(uint64_t));
+			buf += BITSET_WORDS(game_objects[kind].count) * sizeof(uint64_t);
+		}
+	}
+
+	job->len = buf - job->buf;
+
+	return job;
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                          Index Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Reads the summary of a savegame from its
+ * file, journal records are applied to it.
+ * Text savegames have none, only the time
+ * is known.
+ *
+ * file: The savegame
+ * meta: Filled with the summary
+ */
+static boolean
+save_index_read(const char *file, save_meta *meta)
+{
+	FILE *save;
+	long offset;
+	save_header header;
+	save_record record;
+	struct stat sb;
+	uint8_t kind;
+
+	memset(meta, 0, sizeof(save_meta));
+
+	if (stat(file, &sb) != 0 || !S_ISREG(sb.st_mode) || (save = fopen(file, "r")) == NULL)
+	{
+		return FALSE;
+	}
+
+	if (fread(&header, sizeof(header), 1, save) == 1
+			&& !memcmp(header.magic, SAVE_MAGIC, sizeof(header.magic))
+			&& header.version == SAVE_VERSION && header.endian == SAVE_ENDIAN)
+	{
+		*meta = header.meta;
+
+		// Skip to the journal records, if any
+		offset = header.uid_length;
+
+		for (kind = 0; kind < GAME_KINDS; kind++)
+		{
+			offset += (long)BITSET_WORDS(header.objects[kind]) * GAME_STATES * sizeof(uint64_t);
+		}
+
+		if (fseek(save, offset, SEEK_CUR) == 0)
+		{
+			while (fread(&record, sizeof(record), 1, save) == 1)
+			{
+				save_meta_apply(meta, &record);
+			}
+		}
+	}
+
+	fclose(save);
+
+	// Journals are appended to after their header was written
+	if (sb.st_mtime > meta->time)
+	{
+		meta->time = sb.st_mtime;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Adds a savegame to the index or updates its
+ * entry. queue.lock must be held.
+ *
+ * name: Name of the savegame
+ * meta: Its summary
+ */
+static void
+save_index_set(const char *name, const save_meta *meta)
+{
+	save_entry *entry;
+	uint32_t i;
+
+	// The journal changes all the time, it's not listed
+	if (!strcmp(name, SAVE_JOURNAL) || strlen(name) >= SAVE_NAMEMAX)
+	{
+		return;
+	}
+
+	for (i = 0; i < slots.count; i++)
+	{
+		if (!strcmp(slots.entries[i].name, name))
+		{
+			slots.entries[i].meta = *meta;
+
+			return;
+		}
+	}
+
+	if (slots.count == slots.size)
+	{
+		slots.size = slots.size ? slots.size * 2 : 64;
+
+		if ((slots.entries = realloc(slots.entries, slots.size * sizeof(save_entry))) == NULL)
+		{
+			quit_error(POUTOFMEM);
+		}
+	}
+
+	entry = &slots.entries[slots.count++];
+	memset(entry, 0, sizeof(save_entry));
+	misc_strlcpy(entry->name, name, sizeof(entry->name));
+	entry->meta = *meta;
+}
+
+/*
+ * Updates the entry of a savegame from its file.
+ * If there's no file, the entry is removed. The
+ * file is read without queue.lock, it's only
+ * taken to update the entry.
+ *
+ * name: Name of the savegame
+ */
+static void
+save_index_refresh(const char *name)
+{
+	boolean found;
+	char file[PATH_MAX];
+	save_meta meta;
+	uint32_t i;
+
+	snprintf(file, sizeof(file), "%s/%s.sav", savedir, name);
+	found = save_index_read(file, &meta);
+
+	pthread_mutex_lock(&queue.lock);
+
+	if (found)
+	{
+		save_index_set(name, &meta);
+	}
+	else
+	{
+		for (i = 0; i < slots.count; i++)
+		{
+			if (!strcmp(slots.entries[i].name, name))
+			{
+				slots.entries[i] = slots.entries[--slots.count];
+
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&queue.lock);
+}
+
+/*
+ * Writes the index. Like a savegame it's written
+ * into a temporary file first. Failing isn't
+ * fatal, the index is rebuild at next start.
+ * The entries are copied under queue.lock, the
+ * file is written without it.
+ */
+static void
+save_index_write(void)
+{
+	FILE *out;
+	char file[PATH_MAX];
+	char tmpfile[PATH_MAX + 8];
+	save_entry *entries;
+	save_index_header header;
+
+	snprintf(file, sizeof(file), "%s/%s", savedir, SAVE_INDEX);
+	snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SAVE_INDEX_MAGIC, sizeof(header.magic));
+
+	header.version = SAVE_VERSION;
+	header.endian = SAVE_ENDIAN;
+
+	pthread_mutex_lock(&queue.lock);
+
+	header.count = slots.count;
+
+	if ((entries = malloc((slots.count ? slots.count : 1) * sizeof(save_entry))) != NULL && slots.count)
+	{
+		memcpy(entries, slots.entries, slots.count * sizeof(save_entry));
+	}
+
+	pthread_mutex_unlock(&queue.lock);
+
+	if (!entries)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	if ((out = fopen(tmpfile, "w")) == NULL)
+	{
+		log_warn_f("%s: %s", i18n_save_failed, tmpfile);
+		free(entries);
+
+		return;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, out) != 1
+			|| (header.count && fwrite(entries, sizeof(save_entry), header.count, out) != header.count)
+			|| fclose(out) != 0 || rename(tmpfile, file) != 0)
+	{
+		log_warn_f("%s: %s", i18n_save_failed, tmpfile);
+		unlink(tmpfile);
+	}
+
+	free(entries);
+}
+
+/*
+ * Loads the index. If it's missing or broken,
+ * it's rebuild from the savegames. That's the
+ * only time all of them are read.
+ */
+static void
+save_index_load(void)
+{
+	DIR *dir;
+	FILE *in;
+	char file[PATH_MAX];
+	save_index_header header;
+	size_t len;
+	struct dirent *cur;
+
+	snprintf(file, sizeof(file), "%s/%s", savedir, SAVE_INDEX);
+
+	pthread_mutex_lock(&queue.lock);
+
+	slots.count = 0;
+
+	if ((in = fopen(file, "r")) != NULL)
+	{
+		if (fread(&header, sizeof(header), 1, in) == 1
+				&& !memcmp(header.magic, SAVE_INDEX_MAGIC, sizeof(header.magic))
+				&& header.version == SAVE_VERSION && header.endian == SAVE_ENDIAN)
+		{
+			slots.size = header.count ? header.count : 1;
+
+			if ((slots.entries = realloc(slots.entries, slots.size * sizeof(save_entry))) == NULL)
+			{
+				quit_error(POUTOFMEM);
+			}
+
+			if (fread(slots.entries, sizeof(save_entry), header.count, in) == header.count)
+			{
+				slots.count = header.count;
+			}
+		}
+
+		fclose(in);
+	}
+
+	pthread_mutex_unlock(&queue.lock);
+
+	if (slots.count)
+	{
+		return;
+	}
+
+	log_info_f("Rebuilding %s", file);
+
+	if ((dir = opendir(savedir)) != NULL)
+	{
+		while ((cur = readdir(dir)) != NULL)
+		{
+			len = strlen(cur->d_name);
+
+			if (len > strlen(".sav") && !strcmp(&cur->d_name[len - strlen(".sav")], ".sav"))
+			{
+				snprintf(file, sizeof(file), "%.*s", (int)(len - strlen(".sav")), cur->d_name);
+				save_index_refresh(file);
+			}
+		}
+
+		closedir(dir);
+	}
+
+	save_index_write();
+}
+
+/*
+ * Returns the name of the current scene of a
+ * savegame or "-", if it's unknown.
+ *
+ * meta: Summary of the savegame
+ */
+static const char
+*save_index_scene(const save_meta *meta)
+{
+	const game_scene_s *scene;
+
+	// IDs are only valid for this version of the game
+	if (meta->objects_hash != objects_hash || !meta->current_scene
+			|| GAME_ID_KIND(meta->current_scene) != GAME_SCENE
+			|| GAME_ID_INDEX(meta->current_scene) >= game_objects[GAME_SCENE].count)
+	{
+		return "-";
+	}
+
+	scene = game_object_get(meta->current_scene);
+
+	return scene->name;
+}
+
+/*
+ * Sorts the entries by time, newest first.
+ */
+static int
+save_index_sort_callback(const void *e1, const void *e2)
+{
+	const save_entry *entry1;
+	const save_entry *entry2;
+
+	entry1 = e1;
+	entry2 = e2;
+
+	if (entry1->meta.time != entry2->meta.time)
+	{
+		return entry1->meta.time < entry2->meta.time ? 1 : -1;
+	}
+
+	return strcmp(entry1->name, entry2->name);
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                           Writer Thread                           *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Writes a savegame. It's written into a temporary
+ * file, synced and renamed over the old savegame.
+ * Failing isn't fatal, the old savegame is kept.
+ *
+ * job: Savegame to write
+ */
+static boolean
+save_write_file(const save_job *job)
+{
+	char tmpfile[PATH_MAX + 8];
+	int fd;
+	size_t written;
+	ssize_t ret;
+
+	snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", job->file);
+
+	if ((fd = open(tmpfile, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1)
+	{
+		log_warn_f("%s: %s", i18n_save_failed, tmpfile);
+
+		return FALSE;
+	}
+
+	for (written = 0; written < job->len; written += ret)
+	{
+		if ((ret = write(fd, job->buf + written, job->len - written)) <= 0)
+		{
+			break;
+		}
+	}
+
+	if (written != job->len || fsync(fd) != 0 || close(fd) != 0
+			|| rename(tmpfile, job->file) != 0)
+	{
+		log_warn_f("%s: %s", i18n_save_failed, tmpfile);
+		unlink(tmpfile);
+
+		return FALSE;
+	}
+
+	// Make the rename itself durable
+	if ((fd = open(savedir, O_RDONLY)) != -1)
+	{
+		fsync(fd);
+		close(fd);
+	}
+
+	log_info_f("Saved game to %s", job->file);
+
+	return TRUE;
+}
+
+/*
+ * Switches to a compacted journal. The records
+ * appended since it was copied are added. If it
+ * couldn't be written, the old journal is kept.
+ * queue.lock is only held to take the pending
+ * records and to switch the descriptors, the
+ * writes are done without it.
+ *
+ * job: The compacted journal
+ */
+static void
+save_journal_swap(const save_job *job)
+{
+	char *buf;
+	char *tmp;
+	int fd;
+	int old;
+	size_t len;
+	size_t size;
+	uint32_t records;
+
+	fd = job->written ? open(job->file, O_WRONLY | O_APPEND) : -1;
+
+	buf = NULL;
+	size = 0;
+	records = 0;
+
+	pthread_mutex_lock(&queue.lock);
+
+	// Records appended meanwhile are pending again
+	while (fd != -1 && journal.len)
+	{
+		// Take the buffer, appends go to the other one
+		tmp = journal.pending;
+		journal.pending = buf;
+		buf = tmp;
+
+		len = journal.size;
+		journal.size = size;
+		size = len;
+
+		len = journal.len;
+		journal.len = 0;
+
+		pthread_mutex_unlock(&queue.lock);
+
+		if (write(fd, buf, len) != (ssize_t)len)
+		{
+			log_warn_f("%s: %s", i18n_save_failed, job->file);
+		}
+
+		records += len / sizeof(save_record);
+
+		pthread_mutex_lock(&queue.lock);
+	}
+
+	if (fd != -1)
+	{
+		old = journal.fd;
+		journal.fd = fd;
+		journal.records = records;
+		fd = old;
+	}
+
+	journal.compacting = FALSE;
+	journal.len = 0;
+
+	pthread_mutex_unlock(&queue.lock);
+
+	// The old journal, or the new one on failure
+	if (fd != -1)
+	{
+		close(fd);
+	}
+
+	free(buf);
+}
+
+/*
+ * Writes the queued savegames, one after another.
+ * The job stays at the head of the queue while
+ * it's written, so save_wait() waits for it.
+ */
+static void
+*save_thread(void *unused)
+{
+	save_job *job;
+	save_meta meta;
+
+	pthread_mutex_lock(&queue.lock);
+
+	while (TRUE)
+	{
+		while (!queue.first)
+		{
+			pthread_cond_wait(&queue.cond, &queue.lock);
+		}
+
+		job = queue.first;
+		pthread_mutex_unlock(&queue.lock);
+
+		meta = ((const save_header *)job->buf)->meta;
+		job->written = save_write_file(job);
+		free(job->buf);
+		job->buf = NULL;
+
+		// The compacted journal isn't listed
+		if (job->journal)
+		{
+			save_journal_swap(job);
+		}
+		else if (job->written)
+		{
+			pthread_mutex_lock(&queue.lock);
+			save_index_set(job->name, &meta);
+			pthread_mutex_unlock(&queue.lock);
+
+			save_index_write();
+		}
+
+		pthread_mutex_lock(&queue.lock);
+
+		if ((queue.first = job->next) == NULL)
+		{
+			queue.last = NULL;
+		}
+
+		job->next = queue.done;
+		queue.done = job;
+
+		pthread_cond_broadcast(&queue.cond);
+	}
+
+	return NULL;
+}
+
+/*
+ * Queues a savegame for the writer thread. If
+ * it can't be started, it's written at once.
+ *
+ * job: Savegame to write
+ */
+static void
+save_queue(save_job *job)
+{
+	log_info_f("Saving game to %s", job->file);
+
+	pthread_mutex_lock(&queue.lock);
+
+	if (!queue.running)
+	{
+		if (pthread_create(&queue.writer, NULL, save_thread, NULL) != 0)
+		{
+			pthread_mutex_unlock(&queue.lock);
+
+			// Better late than never
+			job->written = save_write_file(job);
+
+			if (job->journal)
+			{
+				save_journal_swap(job);
+			}
+			else if (job->written)
+			{
+				pthread_mutex_lock(&queue.lock);
+				save_index_set(job->name, &((const save_header *)job->buf)->meta);
+				pthread_mutex_unlock(&queue.lock);
+
+				save_index_write();
+			}
+
+			free(job->buf);
+			free(job);
+
+			return;
+		}
+
+		pthread_detach(queue.writer);
+		queue.running = TRUE;
+	}
+
+	if (queue.last)
+	{
+		queue.last->next = job;
+	}
+	else
+	{
+		queue.first = job;
+	}
+
+	queue.last = job;
+
+	pthread_cond_broadcast(&queue.cond);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                          Panic Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Copies the whole state into the panic
+ * savegame. The size never changes, so it's
+ * copied in place.
+ */
+static void
+save_panic_refresh(void)
+{
+	save_job *job;
+	uint8_t kind;
+	uint8_t state;
+	size_t offset;
+
+	job = save_snapshot(SAVE_PANIC);
+
+	if (!panic.buf)
+	{
+		snprintf(panic.file, sizeof(panic.file), "%s", job->file);
+		snprintf(panic.tmpfile, sizeof(panic.tmpfile), "%s.tmp", job->file);
+
+		offset = sizeof(save_header) + strlen(game_header->uid);
+
+		for (kind = 0; kind < GAME_KINDS; kind++)
+		{
+			for (state = 0; state < GAME_STATES; state++)
+			{
+				panic.sets[kind][state] = offset;
+				offset += BITSET_WORDS(game_objects[kind].count) * sizeof(uint64_t);
+			}
+		}
+
+		// Set last, save_panic() checks it
+		panic.len = job->len;
+		panic.buf = job->buf;
+	}
+	else
+	{
+		memcpy(panic.buf, job->buf, job->len);
+		free(job->buf);
+	}
+
+	free(job);
+}
+
+/*
+ * Applies a journal record to the panic
+ * savegame.
+ *
+ * record: Record to apply
+ */
+static void
+save_panic_update(const save_record *record)
+{
+	uint64_t word;
+	char *pos;
+
+	if (!panic.buf)
+	{
+		return;
+	}
+
+	if (record->type == SAVE_RECORD_STATE || record->type == SAVE_RECORD_CLEAR)
+	{
+		pos = panic.buf + panic.sets[GAME_ID_KIND(record->id)][record->value]
+			+ GAME_ID_INDEX(record->id) / 64 * sizeof(uint64_t);
+
+		// 'buf' isn't aligned
+		memcpy(&word, pos, sizeof(word));
+
+		if (record->type == SAVE_RECORD_STATE)
+		{
+			word |= (uint64_t)1 << (GAME_ID_INDEX(record->id) % 64);
+		}
+		else
+		{
+			word &= ~((uint64_t)1 << (GAME_ID_INDEX(record->id) % 64));
+		}
+
+		memcpy(pos, &word, sizeof(word));
+	}
+
+	save_meta_apply(&((save_header *)panic.buf)->meta, record);
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                         Journal Functions                         *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Replaces the journal by a savegame of the
+ * current state. It's written in background,
+ * changes until then are recorded twice. The
+ * counter starts over, so if the compaction
+ * fails the next try is JOURNALSIZE records
+ * later.
+ */
+static void
+save_journal_compact(void)
+{
+	save_job *job;
+
+	job = save_snapshot(SAVE_JOURNAL);
+	job->journal = TRUE;
+
+	pthread_mutex_lock(&queue.lock);
+	journal.compacting = TRUE;
+	journal.len = 0;
+	journal.records = 0;
+	pthread_mutex_unlock(&queue.lock);
+
+	save_queue(job);
+}
+
+/*
+ * Appends a record to the journal. It's one
+ * write() without sync, a crash of the engine
+ * doesn't lose it.
+ *
+ * type: Type of the record
+ * id: Object ID
+ * value: State or end flag
+ */
+static void
+save_journal_append(uint32_t type, game_id id, uint32_t value)
+{
+	boolean compact;
+	save_record record;
+
+	if (!is_initialized || journal.paused)
+	{
+		return;
+	}
+
+	memset(&record, 0, sizeof(record));
+	record.type = type;
+	record.id = id;
+	record.value = value;
+
+	save_panic_update(&record);
+
+	pthread_mutex_lock(&queue.lock);
+
+	if (journal.fd != -1 && write(journal.fd, &record, sizeof(record)) != sizeof(record))
+	{
+		log_warn_f("%s: %s", i18n_save_failed, SAVE_JOURNAL);
+	}
+
+	// Must be in the compacted journal, too
+	if (journal.compacting)
+	{
+		if (journal.len + sizeof(record) > journal.size)
+		{
+			journal.size = journal.size ? journal.size * 2 : 4096;
+
+			if ((journal.pending = realloc(journal.pending, journal.size)) == NULL)
+			{
+				quit_error(POUTOFMEM);
+			}
+		}
+
+		memcpy(journal.pending + journal.len, &record, sizeof(record));
+		journal.len += sizeof(record);
+	}
+
+	compact = ++journal.records >= JOURNALSIZE && !journal.compacting;
+
+	pthread_mutex_unlock(&queue.lock);
+
+	if (compact)
+	{
+		save_journal_compact();
+	}
+}
+
+/*
+ * Starts the journal. A clean shutdown deletes
+ * it, so a journal left behind is from a run
+ * that crashed or was killed. It's kept as
+ * another savegame, the new one starts with
+ * the current state.
+ */
+static void
+save_journal_open(void)
+{
+	char file[PATH_MAX];
+	char recovered[PATH_MAX];
+	save_job *job;
+
+	snprintf(file, sizeof(file), "%s/%s.sav", savedir, SAVE_JOURNAL);
+	snprintf(recovered, sizeof(recovered), "%s/%s.sav", savedir, SAVE_RECOVERED);
+
+	if (rename(file, recovered) == 0)
+	{
+		log_info_f("Journal of an unclean shutdown kept as %s", recovered);
+	}
+
+	// Written at once, so the journal is there at the first change
+	job = save_snapshot(SAVE_JOURNAL);
+	job->journal = TRUE;
+	job->written = save_write_file(job);
+
+	save_journal_swap(job);
+
+	free(job->buf);
+	free(job);
+}
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                          Public Interface                         *
+ *                                                                   *
+ *********************************************************************/
+
+void
+save_init(const char *homedir)
+{
+	struct stat sb;
+
+	assert(game_header);
+	assert(homedir);
+
+	log_info(i18n_save_init);
+	snprintf(savedir, sizeof(savedir), "%s/%s/%s", homedir, "save", game_header->uid);
+
+	if ((stat(savedir, &sb)) == 0)
+	{
+		if (!S_ISDIR(sb.st_mode))
+		{
+			log_error_f("Not a directory: %s", savedir);
+			quit_error(PNOTADIR);
+		}
+	}
+	else
+	{
+		misc_rmkdir(savedir);
+	}
+
+	objects_hash = save_objects_hash();
+	is_initialized = TRUE;
+
+	save_index_load();
+	save_journal_open();
+	save_panic_refresh();
+
+	// Both are written behind the index' back
+	save_index_refresh(SAVE_PANIC);
+	save_index_refresh(SAVE_RECOVERED);
+	save_index_write();
+}
+
+void
+save_journal_clear(game_id id, uint8_t state)
+{
+	save_journal_append(SAVE_RECORD_CLEAR, id, state);
+}
+
+void
+save_journal_scene(void)
+{
+	save_journal_append(SAVE_RECORD_SCENE, current_scene ? current_scene->id : 0, game_end ? 1 : 0);
+}
+
+void
+save_journal_state(game_id id, uint8_t state)
+{
+	save_journal_append(SAVE_RECORD_STATE, id, state);
+}
+
+void
+save_list(void)
+{
+	char date[32];
+	const char *heads[4];
+	save_entry *entries;
+	size_t widths[4];
+	struct tm tm;
+	time_t when;
+	uint32_t count;
+	uint32_t i;
+	uint32_t j;
+
+	// Saves still in progress must be listed
+	save_wait();
+
+	pthread_mutex_lock(&queue.lock);
+
+	count = slots.count;
+
+	if ((entries = malloc((count ? count : 1) * sizeof(save_entry))) == NULL)
+	{
+		quit_error(POUTOFMEM);
+	}
+
+	memcpy(entries, slots.entries, count * sizeof(save_entry));
+
+	pthread_mutex_unlock(&queue.lock);
+
+	qsort(entries, count, sizeof(save_entry), save_index_sort_callback);
+
+	curses_text(TINT_NORM, "%s\n", i18n_head_saves);
+
+	for (i = 0; i < strlen(i18n_head_saves); i++)
+	{
+		curses_text(TINT_NORM, "-");
+	}
+
+	curses_text(TINT_NORM, "\n");
+
+	heads[0] = i18n_name;
+	heads[1] = i18n_head_date;
+	heads[2] = i18n_scene;
+	heads[3] = i18n_head_progress;
+
+	for (j = 0; j < 4; j++)
+	{
+		widths[j] = strlen(heads[j]);
+	}
+
+	if (widths[1] < strlen("YYYY-MM-DD HH:MM"))
+	{
+		widths[1] = strlen("YYYY-MM-DD HH:MM");
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (widths[0] < strlen(entries[i].name))
+		{
+			widths[0] = strlen(entries[i].name);
+		}
+
+		if (widths[2] < strlen(save_index_scene(&entries[i].meta)))
+		{
+			widths[2] = strlen(save_index_scene(&entries[i].meta));
+		}
+	}
+
+	for (j = 0; j < 3; j++)
+	{
+		curses_text(TINT_NORM, "%-*s", (int)widths[j] + 2, heads[j]);
+	}
+
+	curses_text(TINT_NORM, "%s\n", heads[3]);
+
+	for (j = 0; j < 4; j++)
+	{
+		for (i = 0; i < strlen(heads[j]); i++)
+		{
+			curses_text(TINT_NORM, "-");
+		}
+
+		if (j < 3)
+		{
+			curses_text(TINT_NORM, "%-*s", (int)(widths[j] + 2 - strlen(heads[j])), "");
+		}
+	}
+
+	curses_text(TINT_NORM, "\n");
+
+	for (i = 0; i < count; i++)
+	{
+		when = entries[i].meta.time;
+		localtime_r(&when, &tm);
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M", &tm);
+
+		curses_text(TINT_NORM, "%-*s%-*s%-*s", (int)widths[0] + 2, entries[i].name, (int)widths[1] + 2, date,
+				(int)widths[2] + 2, save_index_scene(&entries[i].meta));
+
+		// Progress only makes sense for this version of the game
+		if (entries[i].meta.objects_hash == objects_hash)
+		{
+			curses_text(TINT_NORM, "%u/%u\n", entries[i].meta.progress[GAME_SCENE], game_objects[GAME_SCENE].count);
+		}
+		else
 		{
-			scene->visited = FALSE;
+			curses_text(TINT_NORM, "-\n");
 		}
 	}
 
-	game_stats->scenes_visited = 0;
-	free(tmp);
+	free(entries);
+	log_info_f("%s: %i", i18n_save_listedsaves, count);
 }
 
-// --------
-
-/*********************************************************************
- *                                                                   *
- *                          Public Interface                         *
- *                                                                   *
- *********************************************************************/
-
 void
-save_init(const char *homedir)
+save_panic(void)
 {
-	struct stat sb;
+	int fd;
+	size_t written;
+	ssize_t ret;
+	struct timespec now;
 
-	assert(game_header);
-	assert(homedir);
+	if (!panic.len)
+	{
+		return;
+	}
 
-	log_info(i18n_save_init);
-	snprintf(savedir, sizeof(savedir), "%s/%s/%s", homedir, "save", game_header->uid);
+	// Async-signal-safe, unlike time()
+	if (clock_gettime(CLOCK_REALTIME, &now) == 0)
+	{
+		((save_header *)panic.buf)->meta.time = now.tv_sec;
+	}
 
-	if ((stat(savedir, &sb)) == 0)
+	if ((fd = open(panic.tmpfile, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1)
 	{
-		if (!S_ISDIR(sb.st_mode))
-		{
-			log_error_f("Not a directory: %s", savedir);
-			quit_error(PNOTADIR);
-		}
+		return;
 	}
-	else
+
+	for (written = 0; written < panic.len; written += ret)
 	{
-		misc_rmkdir(savedir);
+		if ((ret = write(fd, panic.buf + written, panic.len - written)) <= 0)
+		{
+			close(fd);
+
+			return;
+		}
 	}
 
-	is_initialized = TRUE;
+	close(fd);
+	rename(panic.tmpfile, panic.file);
 }
 
 void
-save_list(void)
+save_poll(void)
 {
-	DIR *dir;
-	char buf[PATH_MAX];
-	struct dirent *cur;
-	struct stat sb;
-	uint16_t count;
-	uint16_t i;
-
-	if ((dir = opendir(savedir)) == NULL)
-	{
-		log_error_f("Couldn't open directory: %s", savedir);
-		quit_error(PCOULDNTOPENDIR);
-	}
-
-	count = 0;
+	save_job *done;
+	save_job *job;
+	save_job *prev;
 
-	curses_text(TINT_NORM, "%s\n", i18n_head_saves);
+	pthread_mutex_lock(&queue.lock);
+	done = queue.done;
+	queue.done = NULL;
+	pthread_mutex_unlock(&queue.lock);
 
-	for (i = 0; i < strlen(i18n_head_saves); i++)
+	// Report them in the order they were saved
+	for (prev = NULL; done; done = job)
 	{
-		curses_text(TINT_NORM, "-");
+		job = done->next;
+		done->next = prev;
+		prev = done;
 	}
 
-	curses_text(TINT_NORM, "\n");
-
-	while ((cur = readdir(dir)) != NULL)
+	while (prev)
 	{
-		snprintf(buf, sizeof(buf), "%s/%s", savedir, cur->d_name);
-		stat(buf, &sb);
+		job = prev;
+		prev = job->next;
 
-		if (S_ISREG(sb.st_mode))
+		// The journal is no savegame of the player
+		if (job->journal)
 		{
-			if (strlen(cur->d_name) > strlen(".sav"))
-			{
-				if (!strcmp(&cur->d_name[strlen(cur->d_name) - strlen(".sav")], ".sav"))
-				{
-					snprintf(buf, strlen(cur->d_name) - strlen(".sav") + 1, "%s", cur->d_name);
-					curses_text(TINT_NORM, "%s\n", buf);
-					count++;
-				}
-			}
+			// Failures were logged by save_write_file()
+		}
+		else if (job->written)
+		{
+			curses_text(TINT_NORM, "%s: %s\n", i18n_save_written, job->name);
+		}
+		else
+		{
+			curses_text(TINT_NORM, "%s: %s\n", i18n_save_failed, job->name);
 		}
-	}
 
-	log_info_f("%s: %i", i18n_save_listedsaves, count);
+		free(job);
+	}
 }
 
 boolean
 save_read(char *name)
 {
 	FILE *save;
-	boolean glossary_mentioned;
-	boolean header;
-	boolean rooms_mentioned;
-	boolean rooms_seen;
-	boolean scenes_visited;
-	game_glossary_s *glossary;
-	char *cur;
-	char *line;
+	boolean ret;
+	char magic[sizeof(SAVE_MAGIC) - 1];
 	char savefile[PATH_MAX];
 	char savename[PATH_MAX];
-	char *token;
-	game_room_s *room;
-	game_scene_s *scene;
-	size_t linecap;
-	ssize_t linelen;
 	struct stat sb;
 
 	assert(name);
@@ -235,6 +1930,9 @@ save_read(char *name)
 	snprintf(savefile, sizeof(savefile), "%s/%s", savedir, savename);
 	log_info_f("Loading game from %s", savefile);
 
+	// It may still be written
+	save_wait();
+
 	// Existing?
 	if ((stat(savefile, &sb)) == 0)
 	{
@@ -253,294 +1951,125 @@ save_read(char *name)
 	}
 
 	// Load it
-	glossary_mentioned = FALSE;
-	header = TRUE;
-	rooms_mentioned = FALSE;
-	rooms_seen = FALSE;
-	scenes_visited = FALSE;
-
-	line = NULL;
-	linecap = 0;
-
-	current_scene = NULL;
-
 	if ((save = fopen(savefile, "r")) == NULL)
 	{
 		quit_error(PCOULDNTLOADSAVE);
 	}
 
-	// Reset state
-	save_reset_state();
+	// The state is replaced by the readers
+	journal.paused = TRUE;
 
-	while ((linelen = getline(&line, &linecap, save)) > 0)
+	// Older savegames are plain text
+	if (fread(magic, sizeof(magic), 1, save) == 1 && !memcmp(magic, SAVE_MAGIC, sizeof(magic)))
 	{
-		cur = line;
-
-		// Empty line ends block
-		if (linelen == 1)
-		{
-			glossary_mentioned = FALSE;
-			header = FALSE;
-			rooms_mentioned = FALSE;
-			rooms_seen = FALSE;
-			scenes_visited = FALSE;
-
-			continue;
-		}
-
-		// Remove newline character
-		cur[strlen(cur) - 1] = '\0';
-
-		// New block
-		if (!(glossary_mentioned || header || rooms_mentioned || rooms_seen || scenes_visited))
-		{
-			if (!strncmp(cur, "#GLOSSARY_MENTIONED:", strlen("GLOSSARY_MENTIONED:")))
-			{
-				glossary_mentioned = TRUE;
-			}
-
-			if (!strncmp(cur, "#ROOMS_MENTIONED:", strlen("#ROOMS_MENTIONED:")))
-			{
-				rooms_mentioned = TRUE;
-			}
-
-			if (!strncmp(cur, "#ROOMS_SEEN:", strlen("#ROOMS_SEEN:")))
-			{
-				rooms_seen = TRUE;
-			}
-
-			if (!strncmp(cur, "#SCENES_VISITED:", strlen("#SCENES_VISITED:")))
-			{
-				scenes_visited = TRUE;
-			}
-
-			continue;
-		}
-
-		// Glossary
-		if (glossary_mentioned)
-		{
-			if ((glossary = hashmap_get(game_glossary, cur)) == NULL)
-			{
-				quit_error(PBROKENSAVE);
-			}
-
-			glossary->mentioned = TRUE;
-		}
-
-		// Header
-		if (header)
-		{
-			token = strsep(&cur, " ");
-
-			if (!strcmp(token, "#UID:"))
-			{
-				if (strcmp(cur, game_header->uid))
-				{
-					curses_text(TINT_NORM, "%s\n", i18n_save_fromanothergame);
-
-					return FALSE;
-				}
-			}
-
-			if (!strcmp(token, "#CURSCENE:"))
-			{
-				if ((scene = hashmap_get(game_scenes, cur)) == NULL)
-				{
-					quit_error(PBROKENSAVE);
-				}
-
-				current_scene = scene;
-			}
-
-			if (!strcmp(token, "#GAMEEND"))
-			{
-				game_end = TRUE;
-			}
-		}
-
-		// Rooms mentioned
-		if (rooms_mentioned)
-		{
-			if ((room = hashmap_get(game_rooms, cur)) == NULL)
-			{
-				quit_error(PBROKENSAVE);
-			}
-
-			room->mentioned = TRUE;
-		}
-
-		// Rooms visited
-		if (rooms_seen)
-		{
-			if ((room = hashmap_get(game_rooms, cur)) == NULL)
-			{
-				quit_error(PBROKENSAVE);
-			}
+		ret = save_read_binary(save);
+	}
+	else
+	{
+		rewind(save);
+		ret = save_read_text(save);
+	}
 
-			room->visited = TRUE;
-		}
+	fclose(save);
 
-		// Scenes visited
-		if (scenes_visited)
-		{
-			if ((scene = hashmap_get(game_scenes, cur)) == NULL)
-			{
-				quit_error(PBROKENSAVE);
-			}
+	journal.paused = FALSE;
 
-			scene->visited = TRUE;
-		}
+	// The journal continues from the loaded state
+	if (ret)
+	{
+		save_journal_compact();
+		save_panic_refresh();
 	}
 
-	free(line);
-
-	return TRUE;
+	return ret;
 }
 
 void
-save_write(char *name)
+save_quit(void)
 {
-	FILE *save;
-	char savefile[PATH_MAX];
-	char savename[PATH_MAX];
-	game_glossary_s *glossary;
-	game_room_s *room;
-	game_scene_s *scene;
-	list *tmp;
+	char file[PATH_MAX];
+	int fd;
 
-	assert(name);
-	assert(savedir);
-
-	/* Protect against recursions between
-	   quit_error() and save_write() */
 	if (!is_initialized)
 	{
 		return;
 	}
 
-	// Construct name
-	if (strlen(name) > strlen(".sav"))
-	{
-		if (!strcmp(&name[strlen(name) - strlen(".sav")], ".sav"))
-		{
-			misc_strlcpy(savename, name, sizeof(savename));
-		}
-		else
-		{
-			snprintf(savename, sizeof(savename), "%s.sav", name);
-		}
-	}
-	else
-	{
-		snprintf(savename, sizeof(savename), "%s.sav", name);
-	}
+	// The last compaction may still be written
+	save_wait();
 
-	snprintf(savefile, sizeof(savefile), "%s/%s", savedir, savename);
-	log_info_f("Saving game to %s", savefile);
+	is_initialized = FALSE;
 
-	// Open file
-	if ((save = fopen(savefile, "w")) == NULL)
+	pthread_mutex_lock(&queue.lock);
+	fd = journal.fd;
+	journal.fd = -1;
+	pthread_mutex_unlock(&queue.lock);
+
+	if (fd != -1)
 	{
-		quit_error(PCOULDNTOPENFILE);
+		close(fd);
 	}
 
-	// Write metadata
-	fwrite("#UID: ", strlen("#UID: "), 1, save);
-	fwrite(game_header->uid, strlen(game_header->uid), 1, save);
-	fwrite("\n ", strlen("\n"), 1, save);
+	// Nothing to recover at the next start
+	snprintf(file, sizeof(file), "%s/%s.sav", savedir, SAVE_JOURNAL);
 
-	if (current_scene)
+	if (unlink(file) == -1 && errno != ENOENT)
 	{
-		fwrite("#CURSCENE: ", strlen("#CURSCENE: "), 1, save);
-		fwrite(current_scene->name, strlen(current_scene->name), 1, save);
-		fwrite("\n ", strlen("\n"), 1, save);
+		log_warn_f("Couldn't remove journal: %s", file);
 	}
+}
+
+void
+save_wait(void)
+{
+	pthread_mutex_lock(&queue.lock);
 
-	if (game_end)
+	while (queue.first)
 	{
-		fwrite("#GAMEEND\n", strlen("#GAMEEND\n"), 1, save);
+		pthread_cond_wait(&queue.cond, &queue.lock);
 	}
 
-	fwrite("\n ", strlen("\n"), 1, save);
+	pthread_mutex_unlock(&queue.lock);
+}
 
-	// Write mentioned glossar entries
-	fwrite("#GLOSSAR_MENTIONED:\n", strlen("#GLOSSAR_MENTIONED:\n"), 1, save);
+void
+save_write(char *name)
+{
+	char slot[PATH_MAX];
+	size_t len;
 
-	tmp = hashmap_to_list(game_glossary);
+	assert(name);
+	assert(savedir);
 
-	while (tmp->count)
+	// Before save_init() or after save_quit()
+	if (!is_initialized)
 	{
-		glossary = list_shift(tmp);
-
-		if (glossary->mentioned)
-		{
-			fwrite(glossary->name, strlen(glossary->name), 1, save);
-			fwrite("\n", strlen("\n"), 1, save);
-		}
+		return;
 	}
 
-	fwrite("\n", strlen("\n"), 1, save);
-	list_destroy(tmp, NULL);
-
-	// Write mentioned rooms
-	fwrite("#ROOMS_MENTIONED:\n", strlen("#ROOMS_MENTIONED:\n"), 1, save);
-
-	tmp = hashmap_to_list(game_rooms);
+	// Construct name
+	misc_strlcpy(slot, name, sizeof(slot));
+	len = strlen(slot);
 
-	while (tmp->count)
+	if (len > strlen(".sav") && !strcmp(&slot[len - strlen(".sav")], ".sav"))
 	{
-		room = list_shift(tmp);
-
-		if (room->mentioned)
-		{
-			fwrite(room->name, strlen(room->name), 1, save);
-			fwrite("\n", strlen("\n"), 1, save);
-		}
+		slot[len - strlen(".sav")] = '\0';
 	}
 
-	fwrite("\n", strlen("\n"), 1, save);
-	list_destroy(tmp, NULL);
-
-	// Write seen rooms
-	fwrite("#ROOMS_SEEN:\n", strlen("#ROOMS_SEEN:\n"), 1, save);
-
-	tmp = hashmap_to_list(game_rooms);
-
-	while (tmp->count)
+	if (save_reserved(slot))
 	{
-		room = list_shift(tmp);
+		curses_text(TINT_NORM, "%s\n", i18n_save_namereserved);
 
-		if (room->visited)
-		{
-			fwrite(room->name, strlen(room->name), 1, save);
-			fwrite("\n", strlen("\n"), 1, save);
-		}
+		return;
 	}
 
-	fwrite("\n", strlen("\n"), 1, save);
-	list_destroy(tmp, NULL);
-
-	// Write visited scenes
-	fwrite("#SCENES_VISITED:\n", strlen("#SCENES_VISITED:\n"), 1, save);
-
-	tmp = hashmap_to_list(game_scenes);
-
-	while (tmp->count)
+	// Must fit into the index
+	if (strlen(slot) >= SAVE_NAMEMAX)
 	{
-		scene = list_shift(tmp);
+		curses_text(TINT_NORM, "%s\n", i18n_save_nametoolong);
 
-		if (scene->visited)
-		{
-			fwrite(scene->name, strlen(scene->name), 1, save);
-			fwrite("\n", strlen("\n"), 1, save);
-		}
+		return;
 	}
 
-	fwrite("\n", strlen("\n"), 1, save);
-	list_destroy(tmp, NULL);
-
-	// Close
-	fflush(save);
-	fclose(save);
+	save_queue(save_snapshot(slot));
 }
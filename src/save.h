@@ -3,10 +3,16 @@
  * load it back at a later time. All available
  * savegame files can be listed, too.
  *
- * Since the save games are written in plain
- * text and parsed at load, they shouled be
- * portable between engine versions and even
- * operating systems or platforms.
+ * Savegames are binary. They store the state
+ * of all objects by their IDs, so they can only
+ * be loaded into the same version of the game
+ * and on platforms with the same byte order.
+ * Older savegames in plain text are still read.
+ *
+ * All changes are recorded in the journal, the
+ * savegame "journal". It's deleted by a clean
+ * shutdown. A journal found at startup becomes
+ * the savegame "recovered".
  */
 
 #ifndef SAVE_H_
@@ -16,6 +22,8 @@
 
 #include <stdint.h>
 
+#include "game.h"
+
 // --------
 
 /*
@@ -26,10 +34,48 @@
 void save_init(const char *homedir);
 
 /*
- * Prints a list of all available savegames.
+ * Records a change of the current scene or
+ * of the end flag in the journal.
+ */
+void save_journal_scene(void);
+
+/*
+ * Records in the journal that an object left
+ * a state.
+ *
+ * id: ID of the object
+ * state: The old state
+ */
+void save_journal_clear(game_id id, uint8_t state);
+
+/*
+ * Records in the journal that an object got
+ * into a state.
+ *
+ * id: ID of the object
+ * state: The new state
+ */
+void save_journal_state(game_id id, uint8_t state);
+
+/*
+ * Prints a list of all available savegames,
+ * newest first, with a summary of each.
  */
 void save_list(void);
 
+/*
+ * Writes the savegame "panic". Only open(),
+ * write(), close() and rename() are used, so
+ * it's safe to call from a signal handler.
+ */
+void save_panic(void);
+
+/*
+ * Reports savegames written since the last
+ * call. Must be called from the main thread.
+ */
+void save_poll(void);
+
 /*
  * Load a savegame. If successfull 0 is
  * returned, otherwise -1.
@@ -39,9 +85,23 @@ void save_list(void);
 boolean save_read(char *name);
 
 /*
- * Saves the game.
+ * Writes the waiting savegames and deletes the
+ * journal, the shutdown was clean. No changes
+ * are recorded afterwards.
+ */
+void save_quit(void);
+
+/*
+ * Waits until all savegames are written.
+ */
+void save_wait(void);
+
+/*
+ * Saves the game. The state is copied and
+ * written in the background, save_poll()
+ * reports when it's done.
  *
- * name: Name of the savegame
+ * name: Name of the savegame, ".sav" is optional
  */
 void save_write(char *name);
 
@@ -0,0 +1,232 @@
+/*
+ * scan.c
+ * ------
+ *
+ * Character classification kernels. All kernels
+ * classify exactly SCAN_BLOCK bytes, shorter
+ * blocks are copied into a padded buffer first.
+ * The SIMD kernels are only build on x86, other
+ * platforms always use plain C.
+ */
+
+#define LOG_MODULE LOG_PARSER
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "scan.h"
+
+#include "i18n/i18n.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+// --------
+
+// Pads short blocks, mustn't be in any class
+#define PADDING 'x'
+
+// --------
+
+// Classes of all bytes, one bit per class
+static const uint8_t classes[256] = {
+	['\0'] = 1 << SCAN_STOP,
+	['\n'] = 1 << SCAN_NEWLINE,
+	[' '] = 1 << SCAN_SPACE,
+	['#'] = 1 << SCAN_STOP
+};
+
+// Kernel used by scan_block()
+static void (*kernel)(const char *start, uint64_t masks[SCAN_CLASSES]);
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                        Support Functions                          *
+ *                                                                   *
+ *********************************************************************/
+
+/*
+ * Plain C kernel. Works everywhere.
+ *
+ * start: Start of the block
+ * masks: Filled with the masks
+ */
+static void
+scan_kernel_scalar(const char *start, uint64_t masks[SCAN_CLASSES])
+{
+	uint8_t class;
+	uint32_t i;
+	uint32_t j;
+
+	memset(masks, 0, SCAN_CLASSES * sizeof(uint64_t));
+
+	for (i = 0; i < SCAN_BLOCK; i++)
+	{
+		if ((class = classes[(uint8_t)start[i]]) == 0)
+		{
+			continue;
+		}
+
+		for (j = 0; j < SCAN_CLASSES; j++)
+		{
+			masks[j] |= (uint64_t)((class >> j) & 1) << i;
+		}
+	}
+}
+
+#ifdef SCAN_X86
+
+/*
+ * SSE2 kernel, 16 bytes at once.
+ *
+ * start: Start of the block
+ * masks: Filled with the masks
+ */
+__attribute__((target("sse2"))) static void
+scan_kernel_sse2(const char *start, uint64_t masks[SCAN_CLASSES])
+{
+	__m128i data;
+	uint32_t i;
+
+	__m128i stop;
+	const __m128i hash = _mm_set1_epi8('#');
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i nul = _mm_setzero_si128();
+	const __m128i space = _mm_set1_epi8(' ');
+
+	memset(masks, 0, SCAN_CLASSES * sizeof(uint64_t));
+
+	for (i = 0; i < SCAN_BLOCK; i += 16)
+	{
+		data = _mm_loadu_si128((const __m128i *)(start + i));
+		stop = _mm_or_si128(_mm_cmpeq_epi8(data, hash), _mm_cmpeq_epi8(data, nul));
+
+		masks[SCAN_NEWLINE] |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(data, newline)) << i;
+		masks[SCAN_SPACE] |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(data, space)) << i;
+		masks[SCAN_STOP] |= (uint64_t)(uint16_t)_mm_movemask_epi8(stop) << i;
+	}
+}
+
+/*
+ * AVX2 kernel, 32 bytes at once.
+ *
+ * start: Start of the block
+ * masks: Filled with the masks
+ */
+__attribute__((target("avx2"))) static void
+scan_kernel_avx2(const char *start, uint64_t masks[SCAN_CLASSES])
+{
+	__m256i data;
+	uint32_t i;
+
+	__m256i stop;
+	const __m256i hash = _mm256_set1_epi8('#');
+	const __m256i newline = _mm256_set1_epi8('\n');
+	const __m256i nul = _mm256_setzero_si256();
+	const __m256i space = _mm256_set1_epi8(' ');
+
+	memset(masks, 0, SCAN_CLASSES * sizeof(uint64_t));
+
+	for (i = 0; i < SCAN_BLOCK; i += 32)
+	{
+		data = _mm256_loadu_si256((const __m256i *)(start + i));
+		stop = _mm256_or_si256(_mm256_cmpeq_epi8(data, hash), _mm256_cmpeq_epi8(data, nul));
+
+		masks[SCAN_NEWLINE] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(data, newline)) << i;
+		masks[SCAN_SPACE] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(data, space)) << i;
+		masks[SCAN_STOP] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(stop) << i;
+	}
+}
+
+#endif // SCAN_X86
+
+// --------
+
+/*********************************************************************
+ *                                                                   *
+ *                         Public Interface                          *
+ *                                                                   *
+ *********************************************************************/
+
+void
+scan_block(const char *start, size_t len, uint64_t masks[SCAN_CLASSES])
+{
+	char buf[SCAN_BLOCK];
+
+	assert(start);
+	assert(len <= SCAN_BLOCK);
+
+	if (!kernel)
+	{
+		kernel = scan_kernel_scalar;
+	}
+
+	if (len == SCAN_BLOCK)
+	{
+		kernel(start, masks);
+	}
+	else
+	{
+		// Never read behind the end, it may be unmapped
+		memcpy(buf, start, len);
+		memset(buf + len, PADDING, SCAN_BLOCK - len);
+
+		kernel(buf, masks);
+	}
+}
+
+const char
+*scan_find(const char *start, const char *end, int kind)
+{
+	const char *cur;
+	uint64_t masks[SCAN_CLASSES];
+
+	assert(start);
+	assert(end);
+	assert(kind >= 0 && kind < SCAN_CLASSES);
+
+	for (cur = start; cur < end; cur += SCAN_BLOCK)
+	{
+		scan_block(cur, end - cur < SCAN_BLOCK ? end - cur : SCAN_BLOCK, masks);
+
+		if (masks[kind])
+		{
+			return cur + scan_first(masks[kind]);
+		}
+	}
+
+	return NULL;
+}
+
+void
+scan_init(void)
+{
+	const char *name;
+
+	kernel = scan_kernel_scalar;
+	name = "scalar";
+
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		kernel = scan_kernel_avx2;
+		name = "avx2";
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		kernel = scan_kernel_sse2;
+		name = "sse2";
+	}
+#endif
+
+	log_info_f("%s: %s", i18n_parser_kernel, name);
+}
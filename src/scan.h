@@ -0,0 +1,81 @@
+/*
+ * scan.h
+ * ------
+ *
+ * Character classification kernels. A block of
+ * up to 64 bytes is classified at once, for each
+ * class of interesting characters a bitmask with
+ * their positions is returned. Depending on the
+ * CPU AVX2, SSE2 or plain C is used, the choice
+ * is made at runtime.
+ */
+
+#ifndef SCAN_H_
+#define SCAN_H_
+
+// --------
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// --------
+
+// Bytes classified at once
+#define SCAN_BLOCK 64
+
+// Character classes. SCAN_STOP are the bytes
+// ending the tokens of a line, '#' and '\0'.
+enum
+{
+	SCAN_NEWLINE,
+	SCAN_SPACE,
+	SCAN_STOP,
+	SCAN_CLASSES
+};
+
+// --------
+
+/*
+ * Classifies a block of bytes. masks[kind] gets
+ * a bit for every byte of that class, the lowest
+ * bit is the first byte. Bytes after len are never
+ * read and their bits are cleared.
+ *
+ * start: Start of the block
+ * len: Length of the block, at most SCAN_BLOCK
+ * masks: Filled with the masks
+ */
+void scan_block(const char *start, size_t len, uint64_t masks[SCAN_CLASSES]);
+
+/*
+ * Returns the first byte of a class or NULL,
+ * if there's none.
+ *
+ * start: Start of the memory to search
+ * end: End of the memory to search
+ * kind: Class to search for
+ */
+const char *scan_find(const char *start, const char *end, int kind);
+
+/*
+ * Returns the position of the lowest set bit.
+ * The mask mustn't be 0.
+ *
+ * mask: Mask to search
+ */
+static inline uint32_t
+scan_first(uint64_t mask)
+{
+	return __builtin_ctzll(mask);
+}
+
+/*
+ * Selects the fastest kernel supported by the
+ * CPU. Must be called before any threads are
+ * using the kernels. Until then plain C is used.
+ */
+void scan_init(void);
+
+// --------
+
+#endif // SCAN_H_